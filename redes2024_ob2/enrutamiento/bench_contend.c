@@ -0,0 +1,266 @@
+/*-----------------------------------------------------------------------------
+ * file:  bench_contend.c
+ *
+ * Description:
+ *
+ * Reader contention timings, run with "make bench". N reader threads look
+ * up the ARP cache or the routing table as fast as they can while one
+ * writer keeps changing it, first through the lock-free read paths
+ * (the ARP sequence counter, the routing table's two-counter epochs) and
+ * then with readers and writer serialized on a mutex, as lookups were
+ * before. Lookups and writes per second are totals over each run. The
+ * numbers only mean much with at least N + 1 cores.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_arpcache.h"
+
+#define BENCH_SECONDS 0.2
+#define BENCH_ENTRIES 1024
+#define BENCH_MAX_READERS 8
+
+static const unsigned int bench_readers[] = { 1, 2, 4, BENCH_MAX_READERS };
+
+#define BENCH_NREADERS (sizeof(bench_readers) / sizeof(bench_readers[0]))
+
+/* -- one per thread, padded to its own cache line -- */
+struct bench_counter
+{
+    unsigned long ops;
+    char pad[64 - sizeof(unsigned long)];
+};
+
+static struct sr_instance bench_sr;
+static uint32_t bench_ips[BENCH_ENTRIES];
+static struct sr_rt* bench_routes;      /* the writer's full set */
+static pthread_mutex_t bench_rt_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile int bench_stop;
+static int bench_locked;                /* readers and writer share a mutex */
+static struct bench_counter bench_counts[BENCH_MAX_READERS + 1];
+
+/* -- sr_vns_comm.o wants it, it lives in sr_main.c -- */
+int sr_verify_routing_table(struct sr_instance* sr)
+{
+    return 0;
+} /* -- sr_verify_routing_table -- */
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- bench_now -- */
+
+static uint32_t bench_step(uint32_t* seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+} /* -- bench_step -- */
+
+static void* bench_arp_reader(void* arg)
+{
+    struct bench_counter* count = (struct bench_counter*)arg;
+    struct sr_arpentry entry;
+    uint32_t seed = 0x9e3779b9 ^ (uint32_t)(count - bench_counts);
+
+    while (!bench_stop)
+    {
+        uint32_t ip = bench_ips[bench_step(&seed) % BENCH_ENTRIES];
+
+        if (bench_locked)
+        {
+            pthread_mutex_lock(&(bench_sr.cache.lock));
+            sr_arpcache_lookup(&(bench_sr.cache), ip, &entry);
+            pthread_mutex_unlock(&(bench_sr.cache.lock));
+        }
+        else
+        { sr_arpcache_lookup(&(bench_sr.cache), ip, &entry); }
+        count->ops++;
+    }
+    return 0;
+} /* -- bench_arp_reader -- */
+
+/* -- rewrites one mapping after another, each a write section -- */
+static void* bench_arp_writer(void* arg)
+{
+    struct bench_counter* count = (struct bench_counter*)arg;
+    unsigned char mac[ETHER_ADDR_LEN];
+    uint32_t seed = 0x2545f491;
+
+    memset(mac, 0, sizeof(mac));
+    while (!bench_stop)
+    {
+        mac[5] = (unsigned char)count->ops;
+        sr_arpcache_insert(&(bench_sr.cache), mac, bench_ips[bench_step(&seed) % BENCH_ENTRIES]);
+        count->ops++;
+    }
+    return 0;
+} /* -- bench_arp_writer -- */
+
+static void* bench_rt_reader(void* arg)
+{
+    struct bench_counter* count = (struct bench_counter*)arg;
+    struct sr_rt match;
+    struct sr_rt* best;
+    uint32_t seed = 0x9e3779b9 ^ (uint32_t)(count - bench_counts);
+
+    while (!bench_stop)
+    {
+        uint32_t ip = bench_ips[bench_step(&seed) % BENCH_ENTRIES];
+
+        if (bench_locked)
+        {
+            pthread_mutex_lock(&bench_rt_mutex);
+            best = sr_fib_lookup(bench_sr.fib, ip);
+            if (best != NULL)
+            { memcpy(&match, best, sizeof(struct sr_rt)); }
+            pthread_mutex_unlock(&bench_rt_mutex);
+        }
+        else
+        { sr_find_rt_entry(&bench_sr, ip, &match); }
+        count->ops++;
+    }
+    return 0;
+} /* -- bench_rt_reader -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_rt_writer
+ *
+ * Withdraws one dynamic route and puts it back, alternately, through
+ * sr_rt_update_dynamic as SPF does.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* bench_rt_writer(void* arg)
+{
+    struct bench_counter* count = (struct bench_counter*)arg;
+    struct sr_rt* list;
+    struct sr_rt** tail;
+    struct sr_rt* route;
+    unsigned int skip;
+
+    while (!bench_stop)
+    {
+        skip = (count->ops & 1) ? BENCH_ENTRIES : count->ops % BENCH_ENTRIES;
+        list = 0;
+        tail = &list;
+        for (route = bench_routes; route != NULL; route = route->next, skip--)
+        {
+            if (skip == 0)
+            { continue; }
+            sr_rt_list_append(tail, route->dest, route->gw, route->mask, route->ifindex, 110);
+            tail = &((*tail)->next);
+        }
+
+        if (bench_locked)
+        { pthread_mutex_lock(&bench_rt_mutex); }
+        sr_rt_update_dynamic(&bench_sr, list);
+        if (bench_locked)
+        { pthread_mutex_unlock(&bench_rt_mutex); }
+        count->ops++;
+    }
+    return 0;
+} /* -- bench_rt_writer -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_run
+ *
+ * One run of n readers and the writer for BENCH_SECONDS; prints the
+ * lookups and writes per second.
+ *
+ *---------------------------------------------------------------------*/
+
+static void bench_run(void* (*reader)(void*), void* (*writer)(void*), unsigned int n)
+{
+    pthread_t threads[BENCH_MAX_READERS + 1];
+    unsigned long reads = 0;
+    unsigned int i;
+    double t;
+
+    memset(bench_counts, 0, sizeof(bench_counts));
+    bench_stop = 0;
+
+    t = bench_now();
+    pthread_create(&threads[n], 0, writer, &bench_counts[n]);
+    for (i = 0; i < n; i++)
+    { pthread_create(&threads[i], 0, reader, &bench_counts[i]); }
+
+    while (bench_now() - t < BENCH_SECONDS)
+    { sched_yield(); }
+    bench_stop = 1;
+
+    for (i = 0; i <= n; i++)
+    { pthread_join(threads[i], 0); }
+    t = bench_now() - t;
+
+    for (i = 0; i < n; i++)
+    { reads += bench_counts[i].ops; }
+    printf("  %8.2f M/s %8.0f /s", reads / t / 1e6, bench_counts[n].ops / t);
+} /* -- bench_run -- */
+
+static void bench_table(const char* name, const char* lock_free,
+                        void* (*reader)(void*), void* (*writer)(void*))
+{
+    unsigned int r;
+
+    printf("%s, %u entries\n", name, BENCH_ENTRIES);
+    printf("%-8s  %-12s %12s  %-12s %12s\n", "readers", lock_free, "writes", "mutex", "writes");
+    for (r = 0; r < BENCH_NREADERS; r++)
+    {
+        printf("%-8u", bench_readers[r]);
+        bench_locked = 0;
+        bench_run(reader, writer, bench_readers[r]);
+        bench_locked = 1;
+        bench_run(reader, writer, bench_readers[r]);
+        printf("\n");
+    }
+} /* -- bench_table -- */
+
+int main(void)
+{
+    unsigned char mac[ETHER_ADDR_LEN];
+    struct sr_rt** tail = &bench_routes;
+    struct in_addr dest, gw, mask;
+    unsigned int i;
+
+    memset(&bench_sr, 0, sizeof(bench_sr));
+    memset(mac, 0, sizeof(mac));
+
+    /* -- entries arm their expiry here; the run ends long before -- */
+    sr_timer_wheel_init(&(bench_sr.timers), &bench_sr);
+    sr_arpcache_init(&(bench_sr.cache), BENCH_ENTRIES, SR_ARPQ_DROP_OLDEST, &(bench_sr.timers));
+
+    sr_rt_init(&bench_sr);
+    sr_if_index(&bench_sr, "eth0");
+    gw.s_addr = 0;
+    mask.s_addr = htonl(0xffffff00);
+    for (i = 0; i < BENCH_ENTRIES; i++)
+    {
+        bench_ips[i] = htonl(0x0a000000 | (i << 8) | 1);
+        sr_arpcache_insert(&(bench_sr.cache), mac, bench_ips[i]);
+
+        dest.s_addr = bench_ips[i] & mask.s_addr;
+        sr_rt_list_append(tail, dest, gw, mask, 0, 110);
+        tail = &((*tail)->next);
+    }
+
+    bench_table("ARP cache", "seqlock", bench_arp_reader, bench_arp_writer);
+    bench_table("routing table", "epoch", bench_rt_reader, bench_rt_writer);
+
+    return 0;
+} /* -- main -- */
@@ -0,0 +1,192 @@
+/*-----------------------------------------------------------------------------
+ * file:  bench_fib.c
+ *
+ * Description:
+ *
+ * Route lookup timings, run with "make bench". Tables of 10, 1k and 100k
+ * random prefixes, mostly /24s as in a real table, are looked up through
+ * the trie FIB and through the list walk sr_find_rt_entry used to do,
+ * counting mask bits on every entry. Half of the addresses fall inside
+ * some prefix. Both must find the same route for every address.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+
+#define BENCH_LOOKUPS 1000000      /* per table through the FIB */
+#define BENCH_LIST_STEPS 100000000 /* list entries visited per table */
+#define BENCH_ADDRS 4096
+
+static const unsigned int bench_sizes[] = { 10, 1000, 100000 };
+
+#define BENCH_NSIZES (sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+
+static uint32_t bench_seed = 0x2545f491;
+static uint32_t bench_addrs[BENCH_ADDRS];
+
+/* -- keeps the compiler from dropping the timed work -- */
+static volatile uintptr_t bench_sink;
+
+static uint32_t bench_rand(void)
+{
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 17;
+    bench_seed ^= bench_seed << 5;
+    return bench_seed;
+} /* -- bench_rand -- */
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- bench_now -- */
+
+/* -- prefix length: 70% /24, the rest spread over /8 .. /32 -- */
+static unsigned int bench_len(void)
+{
+    if ((bench_rand() % 10) < 7)
+    { return 24; }
+    return 8 + bench_rand() % 25;
+} /* -- bench_len -- */
+
+static int bench_count_set_bits(uint32_t mask)
+{
+    int count = 0;
+
+    while (mask)
+    {
+        count += mask & 1;
+        mask >>= 1;
+    }
+    return count;
+} /* -- bench_count_set_bits -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_list_lookup
+ *
+ * The lookup sr_find_rt_entry did before the FIB: a walk of the whole
+ * list, the first of the longest matches wins.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rt* bench_list_lookup(struct sr_rt* list, uint32_t ip)
+{
+    struct sr_rt* best_match = NULL;
+    int longest_match_len = 0;
+    int mask_len;
+
+    for (; list != NULL; list = list->next)
+    {
+        if ((list->mask.s_addr & ip) == (list->dest.s_addr & list->mask.s_addr))
+        {
+            mask_len = bench_count_set_bits(ntohl(list->mask.s_addr));
+            if (mask_len > longest_match_len)
+            {
+                best_match = list;
+                longest_match_len = mask_len;
+            }
+        }
+    }
+    return best_match;
+} /* -- bench_list_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_table
+ *
+ * Builds a table of size prefixes, checks that the FIB and the list
+ * agree and prints ns per lookup for both. Returns 0 on a mismatch.
+ *
+ *---------------------------------------------------------------------*/
+
+static int bench_table(unsigned int size)
+{
+    struct sr_rt* list = 0;
+    struct sr_rt** tail = &list;
+    struct sr_fib fib;
+    struct in_addr dest, gw, mask;
+    unsigned int i, len, n;
+    double t_fib, t_list;
+    uintptr_t sum;
+
+    sr_fib_init(&fib);
+    gw.s_addr = 0;
+    for (i = 0; i < size; i++)
+    {
+        len = bench_len();
+        mask.s_addr = htonl(0xffffffffU << (32 - len));
+        dest.s_addr = bench_rand() & mask.s_addr;
+        sr_rt_list_append(tail, dest, gw, mask, 0, 110);
+        sr_fib_insert(&fib, *tail);
+        tail = &((*tail)->next);
+    }
+
+    /* -- half the addresses inside a prefix of the table -- */
+    for (i = 0; i < BENCH_ADDRS; i++)
+    { bench_addrs[i] = bench_rand(); }
+    for (i = 0; i < BENCH_ADDRS; i += 2)
+    {
+        struct sr_rt* route = list;
+        unsigned int skip = bench_rand() % size;
+
+        while (skip-- > 0)
+        { route = route->next; }
+        bench_addrs[i] = route->dest.s_addr | (bench_addrs[i] & ~route->mask.s_addr);
+    }
+
+    for (i = 0; i < BENCH_ADDRS; i++)
+    {
+        if (sr_fib_lookup(&fib, bench_addrs[i]) != bench_list_lookup(list, bench_addrs[i]))
+        {
+            fprintf(stderr, "%u prefixes: FIB and list disagree\n", size);
+            return 0;
+        }
+    }
+
+    sum = 0;
+    t_fib = bench_now();
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    { sum += (uintptr_t)sr_fib_lookup(&fib, bench_addrs[i % BENCH_ADDRS]); }
+    t_fib = bench_now() - t_fib;
+    bench_sink += sum;
+
+    n = BENCH_LIST_STEPS / size;
+    if (n > BENCH_LOOKUPS)
+    { n = BENCH_LOOKUPS; }
+    sum = 0;
+    t_list = bench_now();
+    for (i = 0; i < n; i++)
+    { sum += (uintptr_t)bench_list_lookup(list, bench_addrs[i % BENCH_ADDRS]); }
+    t_list = bench_now() - t_list;
+    bench_sink += sum;
+
+    printf("%-10u  %10.1f ns  %12.1f ns  %8.0fx\n", size, t_fib * 1e9 / BENCH_LOOKUPS,
+           t_list * 1e9 / n, (t_list / n) / (t_fib / BENCH_LOOKUPS));
+
+    sr_fib_clear(&fib);
+    sr_rt_list_free(list);
+    return 1;
+} /* -- bench_table -- */
+
+int main(void)
+{
+    unsigned int z;
+
+    printf("%-10s  %13s  %15s  %9s\n", "prefixes", "trie FIB", "list walk", "speedup");
+    for (z = 0; z < BENCH_NSIZES; z++)
+    {
+        if (!bench_table(bench_sizes[z]))
+        { return 1; }
+    }
+
+    return 0;
+} /* -- main -- */
@@ -0,0 +1,355 @@
+/*-----------------------------------------------------------------------------
+ * file:  bench_lsdb.c
+ *
+ * Description:
+ *
+ * LSU replay timings against database size, run with "make bench".
+ * Routers on a ring with one random chord each advertise their links
+ * and two stub networks, about six LSAs per LSU, for databases of 12k
+ * to 100k entries. Every router's first LSU fills the database; then
+ * random routers send newer LSUs with the same content, each delivered
+ * twice as flooding does, so half of them stop at the sequence check.
+ * Each LSU goes through check_sequence_number and refresh_topology_entry
+ * as the receive path does. The same replay also runs against the list
+ * the database used to be, filled without timing it, with its walks for
+ * every LSA; that replay is cut short on big databases. The router's
+ * debug output goes to /dev/null, for both.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "pwospf_topology.h"
+
+#define BENCH_STUBS 2           /* stub networks per router */
+#define BENCH_REPLAYS 20000     /* LSUs after the first flood, duplicates apart */
+#define BENCH_LIST_STEPS 200000000 /* list entries visited per database */
+
+static const unsigned int bench_sizes[] = { 2000, 5000, 17000 };
+
+#define BENCH_NSIZES (sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+
+/* -- an LSA as it comes in an LSU -- */
+struct bench_lsa
+{
+    struct in_addr net;
+    struct in_addr mask;
+    struct in_addr neighbor;
+};
+
+/* -- an entry of the old list -- */
+struct bench_entry
+{
+    struct in_addr router_id;
+    struct in_addr net_num;
+    struct in_addr net_mask;
+    struct in_addr neighbor_id;
+    uint16_t sequence_num;
+    struct bench_entry* next;
+};
+
+static uint32_t bench_seed = 0x2545f491;
+static FILE* bench_out;
+
+/* -- the LSAs of router r are bench_lsas[bench_first[r] .. bench_first[r + 1] - 1] -- */
+static unsigned int* bench_first;
+static struct bench_lsa* bench_lsas;
+static uint16_t* bench_seq;
+
+/* -- the timer wheel does not run here -- */
+void pwospf_topology_timeout(struct sr_instance* sr, void* arg)
+{
+} /* -- pwospf_topology_timeout -- */
+
+static uint32_t bench_rand(void)
+{
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 17;
+    bench_seed ^= bench_seed << 5;
+    return bench_seed;
+} /* -- bench_rand -- */
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- bench_now -- */
+
+static struct in_addr bench_rid(unsigned int router)
+{
+    struct in_addr addr;
+
+    addr.s_addr = htonl(0xc0000000 | (router + 1));
+    return addr;
+} /* -- bench_rid -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_lsus
+ *
+ * The LSAs of each router: wire i joins routers i and i + 1 for the
+ * ring, and router i - routers to a random one for the chords; each
+ * end advertises the /30 with the other as neighbor. Returns the LSA
+ * count, which is the database size once all are in.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int bench_lsus(unsigned int routers)
+{
+    unsigned int nwires = 2 * routers;
+    unsigned int* ends = (unsigned int*)malloc(2 * nwires * sizeof(unsigned int));
+    unsigned int* fill;
+    unsigned int i, r, k, total;
+    struct bench_lsa* lsa;
+
+    for (i = 0; i < nwires; i++)
+    {
+        ends[2 * i] = i % routers;
+        ends[2 * i + 1] = (i < routers) ? (i + 1) % routers : bench_rand() % routers;
+        if (ends[2 * i + 1] == ends[2 * i])
+        { ends[2 * i + 1] = (ends[2 * i] + 1) % routers; }
+    }
+
+    bench_first = (unsigned int*)calloc(routers + 1, sizeof(unsigned int));
+    for (i = 0; i < 2 * nwires; i++)
+    { bench_first[ends[i] + 1]++; }
+    for (r = 0; r < routers; r++)
+    { bench_first[r + 1] += bench_first[r] + BENCH_STUBS; }
+    total = bench_first[routers];
+
+    bench_lsas = (struct bench_lsa*)malloc(total * sizeof(struct bench_lsa));
+    bench_seq = (uint16_t*)calloc(routers, sizeof(uint16_t));
+    fill = (unsigned int*)malloc(routers * sizeof(unsigned int));
+    memcpy(fill, bench_first, routers * sizeof(unsigned int));
+
+    for (i = 0; i < 2 * nwires; i++)
+    {
+        lsa = &bench_lsas[fill[ends[i]]++];
+        lsa->net.s_addr = htonl(0x0a000000 | ((i / 2) << 2));
+        lsa->mask.s_addr = htonl(0xfffffffc);
+        lsa->neighbor = bench_rid(ends[i ^ 1]);
+    }
+    for (r = 0; r < routers; r++)
+    {
+        for (k = 0; k < BENCH_STUBS; k++)
+        {
+            lsa = &bench_lsas[fill[r]++];
+            lsa->net.s_addr = htonl(0x40000000 | ((r * BENCH_STUBS + k) << 8));
+            lsa->mask.s_addr = htonl(0xffffff00);
+            lsa->neighbor.s_addr = 0;
+        }
+    }
+
+    free(fill);
+    free(ends);
+    return total;
+} /* -- bench_lsus -- */
+
+/* -- one LSU of router r into the hashed database, as the receive path takes it -- */
+static unsigned int bench_lsdb_lsu(struct pwospf_lsdb* lsdb, unsigned int r, uint16_t seq)
+{
+    struct in_addr next_hop;
+    uint8_t changes = TOPO_UNCHANGED;
+    unsigned int k, taken = 0;
+
+    if (!check_sequence_number(lsdb, bench_rid(r), seq))
+    { return 0; }
+    next_hop.s_addr = 0;
+    for (k = bench_first[r]; k < bench_first[r + 1]; k++)
+    {
+        taken += refresh_topology_entry(lsdb, bench_rid(r), bench_lsas[k].net, bench_lsas[k].mask,
+                                        bench_lsas[k].neighbor, next_hop, seq, &changes) != NULL;
+    }
+    return taken;
+} /* -- bench_lsdb_lsu -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_list_lsu
+ *
+ * The same LSU into the old list: check_sequence_number walks to the
+ * first entry of the router, refresh_topology_entry to the first entry
+ * of the network, and new entries go on the front. Same debug output
+ * as the database prints. Adds the entries visited to steps.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int bench_list_lsu(struct bench_entry* head, unsigned int r, uint16_t seq,
+                                   unsigned long* steps)
+{
+    struct in_addr rid = bench_rid(r);
+    struct bench_entry* ptr;
+    struct bench_lsa* lsa;
+    unsigned int k, taken = 0;
+
+    for (ptr = head->next; (ptr != NULL) && (ptr->router_id.s_addr != rid.s_addr); ptr = ptr->next)
+    { (*steps)++; }
+    if (ptr != NULL)
+    {
+        Debug("-> PWOSPF: Router Id: %s, Sequence Number: %u, last accepted: %u\n",
+              inet_ntoa(rid), seq, ptr->sequence_num);
+        if (ptr->sequence_num >= seq)
+        { return 0; }
+    }
+
+    for (k = bench_first[r]; k < bench_first[r + 1]; k++)
+    {
+        lsa = &bench_lsas[k];
+        for (ptr = head->next; ptr != NULL; ptr = ptr->next)
+        {
+            (*steps)++;
+            if ((ptr->net_num.s_addr == lsa->net.s_addr) && (ptr->net_mask.s_addr == lsa->mask.s_addr))
+            {
+                if (ptr->router_id.s_addr == rid.s_addr)
+                {
+                    Debug("-> PWOSPF: Refreshing a topology entry in the toplogy table\n");
+                    Debug("        [Network = %s]\n", inet_ntoa(ptr->net_num));
+                    Debug("        [Mask = %s]\n", inet_ntoa(ptr->net_mask));
+                    Debug("        [Neighbor ID = %s]\n", inet_ntoa(ptr->neighbor_id));
+                    ptr->sequence_num = seq;
+                    ptr->neighbor_id = lsa->neighbor;
+                    break;
+                }
+                else if ((ptr->neighbor_id.s_addr != 0) &&
+                         ((ptr->router_id.s_addr != lsa->neighbor.s_addr) || (ptr->neighbor_id.s_addr != rid.s_addr)))
+                { break; }
+            }
+        }
+        if (ptr == NULL)
+        {
+            ptr = (struct bench_entry*)malloc(sizeof(struct bench_entry));
+            ptr->router_id = rid;
+            ptr->net_num = lsa->net;
+            ptr->net_mask = lsa->mask;
+            ptr->neighbor_id = lsa->neighbor;
+            ptr->sequence_num = seq;
+            ptr->next = head->next;
+            head->next = ptr;
+        }
+        taken++;
+    }
+    return taken;
+} /* -- bench_list_lsu -- */
+
+/* -- the old list as the first flood leaves it, each entry put on the front -- */
+static void bench_list_fill(struct bench_entry* head, unsigned int routers)
+{
+    struct bench_entry* entry;
+    unsigned int r, k;
+
+    for (r = 0; r < routers; r++)
+    {
+        bench_seq[r] = 1;
+        for (k = bench_first[r]; k < bench_first[r + 1]; k++)
+        {
+            entry = (struct bench_entry*)malloc(sizeof(struct bench_entry));
+            entry->router_id = bench_rid(r);
+            entry->net_num = bench_lsas[k].net;
+            entry->net_mask = bench_lsas[k].mask;
+            entry->neighbor_id = bench_lsas[k].neighbor;
+            entry->sequence_num = 1;
+            entry->next = head->next;
+            head->next = entry;
+        }
+    }
+} /* -- bench_list_fill -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_replay
+ *
+ * BENCH_REPLAYS newer LSUs from random routers, each sent twice, into
+ * the hashed database, or into the old list until BENCH_LIST_STEPS
+ * entries have been visited. Returns us per LSU; for the database,
+ * flood is set to us per LSU of the first flood.
+ *
+ *---------------------------------------------------------------------*/
+
+static double bench_replay(unsigned int routers, struct bench_entry* head, double* flood)
+{
+    struct pwospf_lsdb* lsdb = create_pwospf_lsdb();
+    unsigned long steps = 0;
+    unsigned int i, r, lsus;
+    uint32_t seed = bench_seed;
+    double t;
+
+    if (head == NULL)
+    {
+        t = bench_now();
+        for (r = 0; r < routers; r++)
+        {
+            bench_seq[r] = 1;
+            bench_lsdb_lsu(lsdb, r, 1);
+        }
+        *flood = (bench_now() - t) * 1e6 / routers;
+    }
+
+    t = bench_now();
+    for (lsus = 0; (lsus < 2 * BENCH_REPLAYS) && (steps < BENCH_LIST_STEPS); lsus += 2)
+    {
+        r = bench_rand() % routers;
+        bench_seq[r]++;
+        for (i = 0; i < 2; i++)
+        {
+            if (head != NULL)
+            { bench_list_lsu(head, r, bench_seq[r], &steps); }
+            else
+            { bench_lsdb_lsu(lsdb, r, bench_seq[r]); }
+        }
+    }
+    t = (bench_now() - t) * 1e6 / lsus;
+
+    /* -- both replays see the same routers -- */
+    bench_seed = seed;
+    while (lsdb->head.next != NULL)
+    { remove_topology_entry(lsdb, lsdb->head.next); }
+    free(lsdb->by_link);
+    free(lsdb->by_net);
+    free(lsdb->by_router);
+    free(lsdb);
+    return t;
+} /* -- bench_replay -- */
+
+int main(void)
+{
+    struct bench_entry head;
+    struct bench_entry* next;
+    unsigned int z, routers, entries;
+    double t_lsdb, t_list, flood;
+
+    bench_out = fdopen(dup(1), "w");
+    if ((bench_out == 0) || (freopen("/dev/null", "w", stdout) == 0))
+    { return 1; }
+
+    fprintf(bench_out, "%-8s  %-8s  %12s  %12s  %12s\n", "routers", "entries",
+            "LSDB flood", "LSDB replay", "list replay");
+    for (z = 0; z < BENCH_NSIZES; z++)
+    {
+        routers = bench_sizes[z];
+        entries = bench_lsus(routers);
+
+        t_lsdb = bench_replay(routers, NULL, &flood);
+        head.next = NULL;
+        bench_list_fill(&head, routers);
+        t_list = bench_replay(routers, &head, &flood);
+        fprintf(bench_out, "%-8u  %-8u  %9.2f us  %9.2f us  %9.2f us\n", routers, entries,
+                flood, t_lsdb, t_list);
+
+        for (; head.next != NULL; head.next = next)
+        {
+            next = head.next->next;
+            free(head.next);
+        }
+        free(bench_seq);
+        free(bench_lsas);
+        free(bench_first);
+    }
+
+    fclose(bench_out);
+    return 0;
+} /* -- main -- */
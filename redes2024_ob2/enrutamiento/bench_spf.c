@@ -0,0 +1,448 @@
+/*-----------------------------------------------------------------------------
+ * file:  bench_spf.c
+ *
+ * Description:
+ *
+ * SPF timings, run with "make bench". Random topologies of 100 to 10k
+ * routers, each with about three links to others and one stub network,
+ * are loaded into a link-state database and run through run_dijkstra:
+ * from scratch, and again after one link goes away or comes back (an
+ * incremental run). Both include the graph snapshot and publishing the
+ * routes, which every run pays. The priority queue is also timed alone
+ * on the same graphs, the indexed heap against the sorted list the old
+ * code kept, which took a malloc and a pass over the list for every
+ * relaxation. Last, SPF time against prefix count: 1k routers with 1 to
+ * 100 stub networks each. The router's debug output goes to /dev/null.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_pwospf.h"
+#include "pwospf_topology.h"
+#include "dijkstra.h"
+
+#define BENCH_LINKS 3           /* links each router adds to others */
+#define BENCH_RUNS 5            /* timed runs of each kind */
+
+static const unsigned int bench_sizes[] = { 100, 1000, 3000, 10000 };
+
+#define BENCH_NSIZES (sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+
+/* -- stub networks per router for the prefix count table -- */
+#define BENCH_PREFIX_ROUTERS 1000
+
+static const unsigned int bench_stubs[] = { 1, 10, 30, 100 };
+
+#define BENCH_NSTUBS (sizeof(bench_stubs) / sizeof(bench_stubs[0]))
+
+static uint32_t bench_seed = 0x2545f491;
+static FILE* bench_out;
+
+static struct sr_instance bench_sr;
+static pthread_mutex_t bench_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* -- the generated graph, directed links by router -- */
+static unsigned int* bench_first;
+static unsigned int* bench_links;
+
+/* -- an item of the old sorted list, one per relaxation -- */
+struct bench_item
+{
+    unsigned int node;
+    unsigned int cost;
+    struct bench_item* next;
+};
+
+/* -- the timer wheel does not run here -- */
+void pwospf_topology_timeout(struct sr_instance* sr, void* arg)
+{
+} /* -- pwospf_topology_timeout -- */
+
+static uint32_t bench_rand(void)
+{
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 17;
+    bench_seed ^= bench_seed << 5;
+    return bench_seed;
+} /* -- bench_rand -- */
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- bench_now -- */
+
+static struct in_addr bench_addr(uint32_t host)
+{
+    struct in_addr addr;
+
+    addr.s_addr = htonl(host);
+    return addr;
+} /* -- bench_addr -- */
+
+static struct in_addr bench_rid(unsigned int router)
+{
+    return bench_addr(0xc0000000 | (router + 1));
+} /* -- bench_rid -- */
+
+static struct pwospf_topology_entry* bench_advertise(struct pwospf_lsdb* lsdb, unsigned int router,
+                                                     struct in_addr net, struct in_addr mask,
+                                                     struct in_addr neighbor)
+{
+    struct pwospf_topology_entry* entry;
+
+    entry = create_ospfv2_topology_entry(bench_rid(router), net, mask, neighbor, bench_addr(0), 0);
+    add_topology_entry(lsdb, entry);
+    return entry;
+} /* -- bench_advertise -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_topology
+ *
+ * A ring through all routers, so every one is reachable, plus random
+ * links up to BENCH_LINKS per router. Each link is a /30 advertised
+ * from both ends, each router has a /24 of its own. Router 0 is this
+ * one, its first two links are interfaces. Fills bench_first and
+ * bench_links with the same graph and returns the database.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct pwospf_lsdb* bench_topology(unsigned int routers, unsigned int stubs)
+{
+    struct pwospf_lsdb* lsdb = create_pwospf_lsdb();
+    unsigned int nlinks = routers * BENCH_LINKS;
+    unsigned int* ends = (unsigned int*)malloc(2 * nlinks * sizeof(unsigned int));
+    unsigned int i, a, b, s;
+    char name[8];
+
+    for (i = 0; i < nlinks; i++)
+    {
+        a = i % routers;
+        b = (i < routers) ? (a + 1) % routers : bench_rand() % routers;
+        if (a == b)
+        { b = (a + 1) % routers; }
+        ends[2 * i] = a;
+        ends[2 * i + 1] = b;
+        bench_advertise(lsdb, a, bench_addr(0x0a000000 | (i << 2)), bench_addr(0xfffffffc), bench_rid(b));
+        bench_advertise(lsdb, b, bench_addr(0x0a000000 | (i << 2)), bench_addr(0xfffffffc), bench_rid(a));
+    }
+    for (i = 0; i < routers * stubs; i++)
+    {
+        bench_advertise(lsdb, i % routers, bench_addr(0x40000000 | (i << 8)), bench_addr(0xffffff00),
+                        bench_addr(0));
+    }
+
+    /* -- our interfaces: the ring links to routers 1 and routers - 1 -- */
+    for (i = 0, s = 0; (i < nlinks) && (s < 2); i++)
+    {
+        if ((ends[2 * i] != 0) && (ends[2 * i + 1] != 0))
+        { continue; }
+        sprintf(name, "eth%u", s++);
+        sr_add_interface(&bench_sr, name);
+        sr_set_ether_ip(&bench_sr, htonl(0x0a000000 | (i << 2) | 1));
+        sr_set_ether_mask(&bench_sr, htonl(0xfffffffc));
+        sr_get_interface(&bench_sr, name)->neighbor_id = bench_rid(ends[2 * i] ^ ends[2 * i + 1]).s_addr;
+        sr_get_interface(&bench_sr, name)->neighbor_ip = htonl(0x0a000000 | (i << 2) | 2);
+    }
+
+    bench_first = (unsigned int*)calloc(routers + 1, sizeof(unsigned int));
+    bench_links = (unsigned int*)malloc(2 * nlinks * sizeof(unsigned int));
+    for (i = 0; i < 2 * nlinks; i++)
+    { bench_first[ends[i] + 1]++; }
+    for (a = 1; a <= routers; a++)
+    { bench_first[a] += bench_first[a - 1]; }
+    for (i = 0; i < nlinks; i++)
+    {
+        bench_links[bench_first[ends[2 * i]]++] = ends[2 * i + 1];
+        bench_links[bench_first[ends[2 * i + 1]]++] = ends[2 * i];
+    }
+    for (a = routers; a > 0; a--)
+    { bench_first[a] = bench_first[a - 1]; }
+    bench_first[0] = 0;
+
+    free(ends);
+    return lsdb;
+} /* -- bench_topology -- */
+
+/* -- the heap from dijkstra.c alone, from router 0 -- */
+static void bench_heap_spf(struct dijkstra_node* nodes, unsigned int routers, unsigned int* items)
+{
+    struct dijkstra_heap heap;
+    unsigned int u, k, v;
+
+    for (u = 0; u < routers; u++)
+    {
+        nodes[u].cost = DIJKSTRA_NONE;
+        nodes[u].heap_pos = DIJKSTRA_NONE;
+        nodes[u].done = 0;
+    }
+    heap.nodes = nodes;
+    heap.items = items;
+    heap.size = 0;
+
+    dijkstra_heap_update(&heap, 0, 0);
+    while ((u = dijkstra_heap_pop(&heap)) != DIJKSTRA_NONE)
+    {
+        nodes[u].done = 1;
+        for (k = bench_first[u]; k < bench_first[u + 1]; k++)
+        {
+            v = bench_links[k];
+            if (!nodes[v].done && (nodes[u].cost + 1 < nodes[v].cost))
+            { dijkstra_heap_update(&heap, v, nodes[u].cost + 1); }
+        }
+    }
+} /* -- bench_heap_spf -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_list_spf
+ *
+ * The old queue: every relaxation mallocs an item, pushes it on the
+ * front and bubbles the list once; routers popped twice are skipped.
+ *
+ *---------------------------------------------------------------------*/
+
+static void bench_list_spf(unsigned int* cost, uint8_t* done, unsigned int routers)
+{
+    struct bench_item head;
+    struct bench_item* item;
+    struct bench_item* ptr;
+    struct bench_item* tmp;
+    unsigned int u, k, v;
+
+    for (u = 0; u < routers; u++)
+    {
+        cost[u] = DIJKSTRA_NONE;
+        done[u] = 0;
+    }
+    head.next = (struct bench_item*)malloc(sizeof(struct bench_item));
+    head.next->node = 0;
+    head.next->cost = 0;
+    head.next->next = 0;
+    cost[0] = 0;
+
+    while ((item = head.next) != 0)
+    {
+        head.next = item->next;
+        u = item->node;
+        free(item);
+        if (done[u])
+        { continue; }
+        done[u] = 1;
+
+        for (k = bench_first[u]; k < bench_first[u + 1]; k++)
+        {
+            v = bench_links[k];
+            if (done[v] || (cost[u] + 1 >= cost[v]))
+            { continue; }
+            cost[v] = cost[u] + 1;
+
+            item = (struct bench_item*)malloc(sizeof(struct bench_item));
+            item->node = v;
+            item->cost = cost[v];
+            item->next = head.next;
+            head.next = item;
+            for (ptr = &head; (ptr->next != 0) && (ptr->next->next != 0); ptr = ptr->next)
+            {
+                if (ptr->next->cost > ptr->next->next->cost)
+                {
+                    tmp = ptr->next->next;
+                    ptr->next->next = tmp->next;
+                    tmp->next = ptr->next;
+                    ptr->next = tmp;
+                }
+            }
+        }
+    }
+} /* -- bench_list_spf -- */
+
+/* -- ms of one run_dijkstra, from scratch if full -- */
+static double bench_run_dijkstra(struct dijkstra_param* param, int full)
+{
+    double start;
+
+    if (full)
+    { dijkstra_drop_tree(); }
+    start = bench_now();
+    run_dijkstra(param);
+    return (bench_now() - start) * 1e3;
+} /* -- bench_run_dijkstra -- */
+
+/* -- a fresh router and database; runs SPF once to publish the routes -- */
+static struct pwospf_lsdb* bench_start(struct dijkstra_param* param, unsigned int routers,
+                                       unsigned int stubs)
+{
+    memset(&bench_sr, 0, sizeof(bench_sr));
+    sr_rt_init(&bench_sr);
+    bench_sr.ospf_subsys = (struct pwospf_subsys*)calloc(1, sizeof(struct pwospf_subsys));
+    pthread_mutex_init(&(bench_sr.ospf_subsys->lock), 0);
+
+    param->sr = &bench_sr;
+    param->topology = bench_topology(routers, stubs);
+    param->rid = bench_rid(0);
+    param->mutex = &bench_mutex;
+
+    bench_run_dijkstra(param, 1);
+    return param->topology;
+} /* -- bench_start -- */
+
+/* -- average ms of a run from scratch; the routes are already in place -- */
+static double bench_full(struct dijkstra_param* param)
+{
+    double t = 0;
+    unsigned int i;
+
+    for (i = 0; i < BENCH_RUNS; i++)
+    { t += bench_run_dijkstra(param, 1) / BENCH_RUNS; }
+    return t;
+} /* -- bench_full -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_routers
+ *
+ * Full and incremental run_dijkstra, and the two queues alone, for each
+ * topology size. Returns 0 if the queues disagree.
+ *
+ *---------------------------------------------------------------------*/
+
+static int bench_routers(void)
+{
+    struct dijkstra_param param;
+    struct pwospf_lsdb* lsdb;
+    struct pwospf_topology_entry* cut;
+    struct dijkstra_node* nodes;
+    unsigned int* items;
+    unsigned int* cost;
+    uint8_t* done;
+    unsigned int z, i, routers;
+    double full, incr, heap, list;
+
+    fprintf(bench_out, "%-8s  %12s  %12s  %12s  %12s\n",
+            "routers", "SPF full", "incremental", "heap queue", "list queue");
+
+    for (z = 0; z < BENCH_NSIZES; z++)
+    {
+        routers = bench_sizes[z];
+        lsdb = bench_start(&param, routers, 1);
+        full = bench_full(&param);
+
+        /* -- one end of a random link goes away and comes back -- */
+        incr = 0;
+        for (i = 0; i < BENCH_RUNS; i++)
+        {
+            unsigned int l = routers + bench_rand() % (routers * (BENCH_LINKS - 1));
+            unsigned int a = l % routers;
+            struct in_addr net = bench_addr(0x0a000000 | (l << 2));
+
+            for (cut = lsdb->head.next; cut != NULL; cut = cut->next)
+            {
+                if ((cut->net_num.s_addr == net.s_addr) && (cut->router_id.s_addr == bench_rid(a).s_addr))
+                { break; }
+            }
+            net = cut->neighbor_id;
+            remove_topology_entry(lsdb, cut);
+            bench_sr.ospf_subsys->links_gen++;
+            incr += bench_run_dijkstra(&param, 0) / (2 * BENCH_RUNS);
+            bench_advertise(lsdb, a, bench_addr(0x0a000000 | (l << 2)), bench_addr(0xfffffffc), net);
+            bench_sr.ospf_subsys->links_gen++;
+            incr += bench_run_dijkstra(&param, 0) / (2 * BENCH_RUNS);
+        }
+
+        nodes = (struct dijkstra_node*)malloc(routers * sizeof(struct dijkstra_node));
+        items = (unsigned int*)malloc(routers * sizeof(unsigned int));
+        cost = (unsigned int*)malloc(routers * sizeof(unsigned int));
+        done = (uint8_t*)malloc(routers);
+
+        heap = bench_now();
+        for (i = 0; i < BENCH_RUNS; i++)
+        { bench_heap_spf(nodes, routers, items); }
+        heap = (bench_now() - heap) * 1e3 / BENCH_RUNS;
+
+        list = bench_now();
+        bench_list_spf(cost, done, routers);
+        list = (bench_now() - list) * 1e3;
+
+        for (i = 0; i < routers; i++)
+        {
+            if (nodes[i].cost != cost[i])
+            {
+                fprintf(stderr, "%u routers: the queues disagree on router %u\n", routers, i);
+                return 0;
+            }
+        }
+
+        fprintf(bench_out, "%-8u  %9.2f ms  %9.2f ms  %9.2f ms  %9.2f ms\n",
+                routers, full, incr, heap, list);
+
+        free(done);
+        free(cost);
+        free(items);
+        free(nodes);
+        free(bench_links);
+        free(bench_first);
+    }
+
+    return 1;
+} /* -- bench_routers -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_prefixes
+ *
+ * SPF time against prefix count: runs from scratch over
+ * BENCH_PREFIX_ROUTERS routers with more and more stub networks each.
+ * One tree serves every prefix, so the time per prefix should stay flat.
+ *
+ *---------------------------------------------------------------------*/
+
+static void bench_prefixes(void)
+{
+    struct dijkstra_param param;
+    unsigned int z, prefixes;
+    double full;
+
+    fprintf(bench_out, "\n%u routers\n%-8s  %12s  %12s\n", BENCH_PREFIX_ROUTERS,
+            "prefixes", "SPF full", "per prefix");
+
+    for (z = 0; z < BENCH_NSTUBS; z++)
+    {
+        bench_start(&param, BENCH_PREFIX_ROUTERS, bench_stubs[z]);
+        full = bench_full(&param);
+
+        /* -- links between routers are prefixes too -- */
+        prefixes = BENCH_PREFIX_ROUTERS * (bench_stubs[z] + BENCH_LINKS);
+        fprintf(bench_out, "%-8u  %9.2f ms  %9.2f us\n", prefixes, full, full * 1e3 / prefixes);
+
+        free(bench_links);
+        free(bench_first);
+    }
+} /* -- bench_prefixes -- */
+
+int main(void)
+{
+    struct dijkstra_stats stats;
+    int ok;
+
+    bench_out = fdopen(dup(1), "w");
+    if ((bench_out == 0) || (freopen("/dev/null", "w", stdout) == 0))
+    { return 1; }
+
+    ok = bench_routers();
+    if (ok)
+    { bench_prefixes(); }
+
+    dijkstra_get_stats(&stats);
+    fprintf(bench_out, "SPF trees: %lu full, %lu incremental, %lu reused\n",
+            stats.full, stats.incremental, stats.reused);
+
+    fclose(bench_out);
+    return !ok;
+} /* -- main -- */
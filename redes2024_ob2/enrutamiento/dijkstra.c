@@ -1,203 +1,751 @@
+#include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include "dijkstra.h"
 #include "pwospf_topology.h"
+#include "sr_pwospf.h"
 #include "sr_rt.h"
 
+/* -- árbol de la corrida anterior, protegido por el mutex de Dijkstra -- */
+static struct dijkstra_tree g_last_tree = { 0, NULL, 0, NULL, 0 };
+
+/* -- los escribe solo quien tiene el mutex de Dijkstra, se leen con __atomic -- */
+static struct dijkstra_stats g_stats = { 0, 0, 0, 0 };
+
+/* -- orden de los enlaces por router_id y después por vecino, para armar
+      los nodos y buscar enlaces con dijkstra_has_link -- */
+static int dijkstra_cmp_rid(const void* a, const void* b, void* arg)
+{
+    struct dijkstra_link* links = (struct dijkstra_link*)arg;
+    struct dijkstra_link* la = &links[*(const unsigned int*)a];
+    struct dijkstra_link* lb = &links[*(const unsigned int*)b];
+    uint32_t ra = la->router_id.s_addr;
+    uint32_t rb = lb->router_id.s_addr;
+
+    if (ra == rb)
+    {
+        ra = la->neighbor_id.s_addr;
+        rb = lb->neighbor_id.s_addr;
+    }
+
+    return (ra > rb) - (ra < rb);
+}
+
+/* -- orden de los enlaces por prefijo, para juntar a quienes lo anuncian -- */
+static int dijkstra_cmp_net(const void* a, const void* b, void* arg)
+{
+    struct dijkstra_link* links = (struct dijkstra_link*)arg;
+    uint32_t na = links[*(const unsigned int*)a].net_num.s_addr;
+    uint32_t nb = links[*(const unsigned int*)b].net_num.s_addr;
+
+    return (na > nb) - (na < nb);
+}
+
+static int dijkstra_cmp_addr(const void* a, const void* b)
+{
+    uint32_t na = *(const uint32_t*)a;
+    uint32_t nb = *(const uint32_t*)b;
+
+    return (na > nb) - (na < nb);
+}
+
+/* -- nodo del router rid, DIJKSTRA_NONE si no anuncia nada -- */
+static unsigned int dijkstra_find_node(struct dijkstra_node* nodes, unsigned int count, uint32_t rid)
+{
+    unsigned int lo = 0, hi = count, mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (nodes[mid].router_id.s_addr < rid)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    if ((lo < count) && (nodes[lo].router_id.s_addr == rid))
+    {
+        return lo;
+    }
+
+    return DIJKSTRA_NONE;
+}
+
+/* -- el nodo u anuncia un enlace hacia el router neighbor -- */
+static uint8_t dijkstra_has_link(struct dijkstra_node* nodes, struct dijkstra_link* links, unsigned int* by_rid,
+    unsigned int u, uint32_t neighbor)
+{
+    unsigned int lo = nodes[u].first_link, hi = lo + nodes[u].link_count, mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (links[by_rid[mid]].neighbor_id.s_addr < neighbor)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return (lo < nodes[u].first_link + nodes[u].link_count) && (links[by_rid[lo]].neighbor_id.s_addr == neighbor);
+}
+
+/* -- primera posición de by_net cuyo enlace es del prefijo net -- */
+static unsigned int dijkstra_first_net(struct dijkstra_link* links, unsigned int* by_net,
+    unsigned int count, uint32_t net)
+{
+    unsigned int lo = 0, hi = count, mid;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (links[by_net[mid]].net_num.s_addr < net)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* -- los vecinos directos cuestan 1, como el enlace que los une -- */
+static void dijkstra_seed_roots(struct dijkstra_node* nodes, unsigned int node_count,
+    struct dijkstra_root* roots, unsigned int root_count, struct dijkstra_heap* heap)
+{
+    unsigned int i;
+
+    for (i = 0; i < root_count; i++)
+    {
+        unsigned int v = dijkstra_find_node(nodes, node_count, roots[i].neighbor_id.s_addr);
+
+        if ((v != DIJKSTRA_NONE) && (nodes[v].done == 0) && (1 < nodes[v].cost))
+        {
+            nodes[v].root = i;
+            nodes[v].parent = DIJKSTRA_NONE;
+            dijkstra_heap_update(heap, v, 1);
+        }
+    }
+}
+
+/* -- encola a los vecinos de u a los que u les ofrece un camino más corto -- */
+static void dijkstra_relax(struct dijkstra_node* nodes, unsigned int node_count, struct dijkstra_link* links,
+    unsigned int* by_rid, unsigned int u, struct dijkstra_heap* heap)
+{
+    unsigned int k;
+
+    for (k = nodes[u].first_link; k < nodes[u].first_link + nodes[u].link_count; k++)
+    {
+        struct dijkstra_link* link = &links[by_rid[k]];
+
+        if (link->neighbor_id.s_addr == 0)
+        {
+            continue;
+        }
+
+        unsigned int v = dijkstra_find_node(nodes, node_count, link->neighbor_id.s_addr);
+        if ((v == DIJKSTRA_NONE) || (nodes[v].done))
+        {
+            continue;
+        }
+
+        if (nodes[u].cost + 1 < nodes[v].cost)
+        {
+            nodes[v].root = nodes[u].root;
+            nodes[v].parent = u;
+            dijkstra_heap_update(heap, v, nodes[u].cost + 1);
+        }
+    }
+}
+
+/* -- vacía el heap fijando los costos, devuelve cuántos nodos fijó -- */
+static unsigned int dijkstra_settle(struct dijkstra_node* nodes, unsigned int node_count, struct dijkstra_link* links,
+    unsigned int* by_rid, struct dijkstra_heap* heap)
+{
+    unsigned int settled = 0;
+    unsigned int u;
+
+    while ((u = dijkstra_heap_pop(heap)) != DIJKSTRA_NONE)
+    {
+        nodes[u].done = 1;
+        dijkstra_relax(nodes, node_count, links, by_rid, u, heap);
+        settled++;
+    }
+
+    return settled;
+}
+
+/* -- árbol de caminos más cortos desde las raíces, de cero -- */
+static unsigned int dijkstra_spf(struct dijkstra_node* nodes, unsigned int node_count, struct dijkstra_link* links,
+    unsigned int* by_rid, struct dijkstra_root* roots, unsigned int root_count, struct dijkstra_heap* heap)
+{
+    dijkstra_seed_roots(nodes, node_count, roots, root_count, heap);
+
+    return dijkstra_settle(nodes, node_count, links, by_rid, heap);
+}
+
+/*---------------------------------------------------------------------
+ * Method: dijkstra_ispf
+ *
+ * SPF incremental a partir del árbol anterior, con las mismas raíces.
+ *
+ * Cada router que sigue en el grafo arranca con el costo, la raíz y el
+ * padre que tenía. Si su padre desapareció o dejó de anunciar el enlace
+ * hacia él, el router y todo su subárbol pierden el camino. Los caminos
+ * del resto del árbol siguen existiendo y solo pueden mejorar, así que
+ * alcanza con encolar a los routers a los que algún enlace les ofrece
+ * menos costo (enlaces nuevos o hacia lo perdido) y dejar que el heap
+ * propague desde ahí. Los routers que no mejoran no pasan por el heap.
+ *
+ * Devuelve cuántos nodos fijó el heap.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int dijkstra_ispf(struct dijkstra_tree* tree, struct dijkstra_node* nodes, unsigned int node_count,
+    struct dijkstra_link* links, unsigned int* by_rid, struct dijkstra_root* roots, unsigned int root_count,
+    struct dijkstra_heap* heap)
+{
+    unsigned int* old_to_new = (unsigned int*)malloc((tree->node_count + 1) * sizeof(unsigned int));
+    unsigned int* child_first = (unsigned int*)malloc((node_count + 1) * sizeof(unsigned int));
+    unsigned int* children = (unsigned int*)malloc((node_count + 1) * sizeof(unsigned int));
+    unsigned int* lost = (unsigned int*)malloc((node_count + 1) * sizeof(unsigned int));
+    unsigned int lost_count = 0;
+    unsigned int i, j, u;
+
+    assert(old_to_new && child_first && children && lost);
+
+    /* Los dos arreglos de nodos están ordenados por router_id; parent queda
+       por ahora con el índice viejo */
+    for (i = 0, j = 0; i < tree->node_count; i++)
+    {
+        uint32_t rid = tree->nodes[i].router_id.s_addr;
+
+        while ((j < node_count) && (nodes[j].router_id.s_addr < rid))
+        {
+            j++;
+        }
+
+        if ((j < node_count) && (nodes[j].router_id.s_addr == rid))
+        {
+            old_to_new[i] = j;
+            nodes[j].cost = tree->nodes[i].cost;
+            nodes[j].root = tree->nodes[i].root;
+            nodes[j].parent = tree->nodes[i].parent;
+        }
+        else
+        {
+            old_to_new[i] = DIJKSTRA_NONE;
+        }
+    }
+
+    /* Pierden el camino los que colgaban de un router o un enlace que ya no está */
+    for (j = 0; j < node_count; j++)
+    {
+        unsigned int p = nodes[j].parent;
+
+        if (p == DIJKSTRA_NONE)
+        {
+            continue;
+        }
+
+        p = old_to_new[p];
+        if ((p == DIJKSTRA_NONE) || !dijkstra_has_link(nodes, links, by_rid, p, nodes[j].router_id.s_addr))
+        {
+            nodes[j].parent = DIJKSTRA_NONE;
+            lost[lost_count++] = j;
+        }
+        else
+        {
+            nodes[j].parent = p;
+        }
+    }
+
+    /* Los hijos de cada nodo quedan contiguos en children, desde child_first */
+    memset(child_first, 0, (node_count + 1) * sizeof(unsigned int));
+    for (j = 0; j < node_count; j++)
+    {
+        if (nodes[j].parent != DIJKSTRA_NONE)
+        {
+            child_first[nodes[j].parent]++;
+        }
+    }
+    for (j = 1; j <= node_count; j++)
+    {
+        child_first[j] += child_first[j - 1];
+    }
+    for (j = 0; j < node_count; j++)
+    {
+        if (nodes[j].parent != DIJKSTRA_NONE)
+        {
+            children[--child_first[nodes[j].parent]] = j;
+        }
+    }
+
+    /* Con cada nodo perdido se pierde su subárbol */
+    for (i = 0; i < lost_count; i++)
+    {
+        u = lost[i];
+        nodes[u].cost = DIJKSTRA_NONE;
+        nodes[u].root = DIJKSTRA_NONE;
+        nodes[u].parent = DIJKSTRA_NONE;
+        for (j = child_first[u]; j < child_first[u + 1]; j++)
+        {
+            lost[lost_count++] = children[j];
+        }
+    }
+
+    /* Lo que quedó es un árbol válido con costos de más o justos: se encola
+       lo que algún enlace o raíz mejora y el heap hace el resto */
+    dijkstra_seed_roots(nodes, node_count, roots, root_count, heap);
+    for (u = 0; u < node_count; u++)
+    {
+        if ((nodes[u].done == 0) && (nodes[u].cost != DIJKSTRA_NONE))
+        {
+            dijkstra_relax(nodes, node_count, links, by_rid, u, heap);
+        }
+    }
+
+    Debug("\n-> PWOSPF: Incremental SPF, %u of %u routers lost their path\n", lost_count, node_count);
+
+    free(lost);
+    free(children);
+    free(child_first);
+    free(old_to_new);
+
+    return dijkstra_settle(nodes, node_count, links, by_rid, heap);
+}
+
+/* -- las raíces son las mismas que las del árbol anterior -- */
+static uint8_t dijkstra_same_roots(struct dijkstra_tree* tree, struct dijkstra_root* roots, unsigned int root_count)
+{
+    unsigned int i;
+
+    if ((tree->nodes == NULL) || (tree->root_count != root_count))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < root_count; i++)
+    {
+        if ((tree->roots[i].neighbor_id.s_addr != roots[i].neighbor_id.s_addr) ||
+            (tree->roots[i].next_hop.s_addr != roots[i].next_hop.s_addr) ||
+            (tree->roots[i].ifindex != roots[i].ifindex))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* -- el árbol anterior sirve tal cual si el grafo y las raíces son los mismos -- */
+static uint8_t dijkstra_tree_valid(struct dijkstra_tree* tree, unsigned long links_gen,
+    struct dijkstra_node* nodes, unsigned int node_count, struct dijkstra_root* roots, unsigned int root_count)
+{
+    unsigned int i;
+
+    if ((tree->links_gen != links_gen) || (tree->node_count != node_count) ||
+        !dijkstra_same_roots(tree, roots, root_count))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < node_count; i++)
+    {
+        if (tree->nodes[i].router_id.s_addr != nodes[i].router_id.s_addr)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 /*---------------------------------------------------------------------
  * Method: run_dijkstra
  *
  * Run Dijkstra algorithm
  *
+ * Arma un grafo de routers a partir de la topología y calcula una sola
+ * vez el árbol de caminos más cortos desde este router. Después cada
+ * prefijo toma el camino del router más cercano que lo anuncia.
+ *
+ * Si desde la corrida anterior solo cambiaron redes stub se reusa el
+ * árbol anterior. Si cambiaron enlaces o routers pero no las raíces se
+ * recalcula solo lo afectado (dijkstra_ispf); si cambiaron las raíces,
+ * o no hay árbol anterior, se calcula de cero. La tabla publicada se
+ * toca solo si cambió alguna ruta.
+ *
  *---------------------------------------------------------------------*/
 
 void* run_dijkstra(void* arg)
 {
     dijkstra_param_t* dij_param = ((dijkstra_param_t*)(arg));
 
-    pthread_mutex_t mutex = dij_param->mutex;
-    struct pwospf_topology_entry* topology = dij_param->topology;
+    pthread_mutex_t* mutex = dij_param->mutex;
+    struct pwospf_lsdb* topology = dij_param->topology;
     struct in_addr router_id = dij_param->rid;
 
-    pthread_mutex_lock(&mutex);
+    pthread_mutex_lock(mutex);
+
+    /* Copio la topología con el lock del subsistema: sus entradas vencen en otro hilo */
+    pthread_mutex_lock(&(dij_param->sr->ospf_subsys->lock));
+
+    unsigned int link_count = topology->count;
+    unsigned int if_count = 0;
+    struct pwospf_topology_entry* topo_entry;
+    struct sr_if* temp_int;
+
+    for (temp_int = dij_param->sr->if_list; temp_int != NULL; temp_int = temp_int->next)
+    {
+        if_count++;
+    }
+
+    struct dijkstra_link* links = (struct dijkstra_link*)malloc((link_count + 1) * sizeof(struct dijkstra_link));
+    struct dijkstra_node* nodes = (struct dijkstra_node*)malloc((link_count + 1) * sizeof(struct dijkstra_node));
+    struct dijkstra_root* roots = (struct dijkstra_root*)malloc((if_count + 1) * sizeof(struct dijkstra_root));
+    unsigned int* by_rid = (unsigned int*)malloc((link_count + 1) * sizeof(unsigned int));
+    unsigned int* by_net = (unsigned int*)malloc((link_count + 1) * sizeof(unsigned int));
+    struct dijkstra_heap heap;
+    heap.nodes = nodes;
+    heap.items = (unsigned int*)malloc((link_count + 1) * sizeof(unsigned int));
+    heap.size = 0;
+    assert(links && nodes && roots && by_rid && by_net && heap.items);
+
+    unsigned int i = 0;
+    for (topo_entry = topology->head.next; topo_entry != NULL; topo_entry = topo_entry->next)
+    {
+        links[i].router_id = topo_entry->router_id;
+        links[i].net_num = topo_entry->net_num;
+        links[i].net_mask = topo_entry->net_mask;
+        links[i].neighbor_id = topo_entry->neighbor_id;
+        links[i].routed = 0;
+        by_rid[i] = i;
+        by_net[i] = i;
+        i++;
+    }
+
+    /* Las raíces: mis interfaces con vecino cuya red está en la topología */
+    unsigned int root_count = 0;
+    for (temp_int = dij_param->sr->if_list; temp_int != NULL; temp_int = temp_int->next)
+    {
+        if ((temp_int->neighbor_id == 0) ||
+            (search_topolgy_table(topology, (temp_int->ip & temp_int->mask)) == 0))
+        {
+            continue;
+        }
+
+        roots[root_count].net_num.s_addr = temp_int->ip & temp_int->mask;
+        roots[root_count].net_mask.s_addr = temp_int->mask;
+        roots[root_count].neighbor_id.s_addr = temp_int->neighbor_id;
+        roots[root_count].next_hop.s_addr = temp_int->neighbor_ip;
+        roots[root_count].ifindex = temp_int->ifindex;
+        root_count++;
+    }
 
-    struct in_addr zero;
-    zero.s_addr = 0;
-    struct dijkstra_item* dijkstra_stack = create_dikjstra_item(create_ospfv2_topology_entry(zero, zero, zero, zero, zero, 0), 0);
-   struct dijkstra_item*  dijkstra_heap = create_dikjstra_item(create_ospfv2_topology_entry(zero, zero, zero, zero, zero, 0), 0);
+    unsigned long links_gen = dij_param->sr->ospf_subsys->links_gen;
 
-    /* Limpio la tabla*/
-    clear_routes(dij_param->sr);
+    pthread_mutex_unlock(&(dij_param->sr->ospf_subsys->lock));
 
-    /* ejecuto Dijkstra*/
-    struct pwospf_topology_entry* topo_entry = topology->next;
-    while(topo_entry != NULL)
+    /* Prefijos con ruta directa o estática: esos no los toca OSPF */
+    unsigned int static_count = 0;
+    unsigned int static_size = 16;
+    uint32_t* statics = (uint32_t*)malloc(static_size * sizeof(uint32_t));
+    assert(statics);
+    unsigned long epoch = sr_rt_read_lock(dij_param->sr);
+    struct sr_rt* rt_entry;
+    for (rt_entry = dij_param->sr->routing_table; rt_entry != NULL; rt_entry = rt_entry->next)
     {
-        if (check_route(dij_param->sr, topo_entry->net_num) == 0)
+        if (rt_entry->admin_dst > 1)
         {
-            struct sr_if* temp_int = dij_param->sr->if_list;
-            while (temp_int != NULL)
-            {
-                if (search_topolgy_table(topology, (temp_int->ip & temp_int->mask)) == 0)
-                {
-                    temp_int = temp_int->next;
-                    continue;
-                }
-
-                if (temp_int->neighbor_id != 0)
-                {
-                    struct in_addr mask;	    mask.s_addr = temp_int->mask;
-                    struct in_addr subnet;	    subnet.s_addr = temp_int->ip & mask.s_addr;
-                    struct in_addr neighbor_id;	    neighbor_id.s_addr = temp_int->neighbor_id;
-                    struct in_addr next_hop;	    next_hop.s_addr = temp_int->neighbor_ip;
-
-                    dijkstra_stack_push(dijkstra_heap, create_dikjstra_item(create_ospfv2_topology_entry(router_id, subnet, mask, neighbor_id,
-                        next_hop, 0), 1));
-                }
-                temp_int = temp_int->next;
-            }
+            continue;
+        }
+        if (static_count == static_size)
+        {
+            static_size *= 2;
+            statics = (uint32_t*)realloc(statics, static_size * sizeof(uint32_t));
+            assert(statics);
+        }
+        statics[static_count++] = rt_entry->dest.s_addr;
+    }
+    sr_rt_read_unlock(dij_param->sr, epoch);
+    qsort(statics, static_count, sizeof(uint32_t), dijkstra_cmp_addr);
+
+    /* Un nodo por router: los enlaces de cada uno quedan contiguos en by_rid */
+    qsort_r(by_rid, link_count, sizeof(unsigned int), dijkstra_cmp_rid, links);
+    qsort_r(by_net, link_count, sizeof(unsigned int), dijkstra_cmp_net, links);
+
+    unsigned int node_count = 0;
+    for (i = 0; i < link_count; i++)
+    {
+        struct dijkstra_link* link = &links[by_rid[i]];
+
+        if ((node_count == 0) || (nodes[node_count - 1].router_id.s_addr != link->router_id.s_addr))
+        {
+            struct dijkstra_node* node = &nodes[node_count++];
+            node->router_id = link->router_id;
+            node->first_link = i;
+            node->link_count = 0;
+            node->cost = DIJKSTRA_NONE;
+            node->root = DIJKSTRA_NONE;
+            node->parent = DIJKSTRA_NONE;
+            node->heap_pos = DIJKSTRA_NONE;
+            /* A mí no se llega por la topología: salgo por las raíces */
+            node->done = (link->router_id.s_addr == router_id.s_addr);
+        }
+        nodes[node_count - 1].link_count++;
+        link->node = node_count - 1;
+    }
+
+    unsigned int settled = 0;
+    if (dijkstra_tree_valid(&g_last_tree, links_gen, nodes, node_count, roots, root_count))
+    {
+        Debug("\n-> PWOSPF: Only stub networks changed, reusing the shortest path tree\n");
+        for (i = 0; i < node_count; i++)
+        {
+            nodes[i].cost = g_last_tree.nodes[i].cost;
+            nodes[i].root = g_last_tree.nodes[i].root;
+            nodes[i].parent = g_last_tree.nodes[i].parent;
+        }
+        __atomic_store_n(&(g_stats.reused), g_stats.reused + 1, __ATOMIC_RELAXED);
+    }
+    else if (dijkstra_same_roots(&g_last_tree, roots, root_count))
+    {
+        settled = dijkstra_ispf(&g_last_tree, nodes, node_count, links, by_rid, roots, root_count, &heap);
+        __atomic_store_n(&(g_stats.incremental), g_stats.incremental + 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        /* ejecuto Dijkstra */
+        settled = dijkstra_spf(nodes, node_count, links, by_rid, roots, root_count, &heap);
+        __atomic_store_n(&(g_stats.full), g_stats.full + 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&(g_stats.settled), g_stats.settled + settled, __ATOMIC_RELAXED);
+
+    /* Armo las rutas dinámicas aparte, la tabla publicada sigue en uso */
+    struct sr_rt* spf_routes = NULL;
+    struct sr_rt** spf_tail = &spf_routes;
 
-            struct dijkstra_item* dijkstra_popped_item;
-            uint8_t stop = 0;
-            while(1)
+    /* Cada prefijo, en el orden de la topología, sale por el router más cercano que lo anuncia */
+    unsigned int dest;
+    for (dest = 0; dest < link_count; dest++)
+    {
+        struct in_addr dest_net = links[dest].net_num;
+        unsigned int first = dijkstra_first_net(links, by_net, link_count, dest_net.s_addr);
+
+        if (links[by_net[first]].routed)
+        {
+            continue;
+        }
+        links[by_net[first]].routed = 1;
+
+        if (bsearch(&dest_net.s_addr, statics, static_count, sizeof(uint32_t), dijkstra_cmp_addr) != NULL)
+        {
+            continue;
+        }
+
+        unsigned int best_cost = DIJKSTRA_NONE;
+        unsigned int best_root = DIJKSTRA_NONE;
+
+        for (i = 0; i < root_count; i++)
+        {
+            if (roots[i].net_num.s_addr == dest_net.s_addr)
             {
-                while(1)
-                {
-                    /* Pop from the heap */
-                    dijkstra_popped_item = dijkstra_stack_pop(dijkstra_heap);
-                    if (dijkstra_popped_item == NULL)
-                    {
-                        stop = 1;
-                        break;
-                    }
-                    if (dijkstra_popped_item->topology_entry->net_num.s_addr == topo_entry->net_num.s_addr)
-                    {
-                        stop = 1;
-                        break;
-                    }
-                    if (dijkstra_popped_item->topology_entry->neighbor_id.s_addr != 0)
-                    {
-                        break;
-                    }
-                }
-
-                /* Push popped item in stack */
-                if (dijkstra_popped_item != NULL)
-                {
-                    dijkstra_stack_push(dijkstra_stack, dijkstra_popped_item);
-                }
-                if (stop == 1)
-                {
-                    break;
-                }
-                struct pwospf_topology_entry* ptr = topology->next;
-                while(ptr != NULL)
-                {
-                    if ((ptr->router_id.s_addr == dijkstra_popped_item->topology_entry->neighbor_id.s_addr) &&
-                        (ptr->net_num.s_addr != dijkstra_popped_item->topology_entry->net_num.s_addr) &&
-                        (ptr->neighbor_id.s_addr != dijkstra_popped_item->topology_entry->neighbor_id.s_addr))
-                    {
-                        struct pwospf_topology_entry* clone = clone_ospfv2_topology_entry(ptr);
-
-                        struct dijkstra_item* to_be_pushed = create_dikjstra_item(clone, dijkstra_popped_item->cost + 1);
-                        to_be_pushed->parent = dijkstra_popped_item;
-                        dijkstra_stack_push(dijkstra_heap, to_be_pushed);
-                        dijkstra_stack_reorder(dijkstra_heap);
-                    }
-
-                    ptr = ptr->next;
-                }
+                best_cost = 1;
+                best_root = i;
+                break;
             }
-            struct dijkstra_item* final_item = dijkstra_stack_pop(dijkstra_stack);
+        }
 
-            if (final_item != NULL)
+        unsigned int k;
+        for (k = first; (k < link_count) && (links[by_net[k]].net_num.s_addr == dest_net.s_addr); k++)
+        {
+            struct dijkstra_node* node = &nodes[links[by_net[k]].node];
+
+            if ((node->cost != DIJKSTRA_NONE) && (node->cost + 1 < best_cost))
             {
-                while (final_item->parent != NULL)
-                {
-                    final_item = final_item->parent; /*dijkstra_stack_pop(dijkstra_stack);*/
-
-                }
-                struct sr_if* next_hop_int = dij_param->sr->if_list;
-                while (next_hop_int != NULL)
-                {
-                    if ((next_hop_int->ip & next_hop_int->mask) == (final_item->topology_entry->next_hop.s_addr & final_item->topology_entry->net_mask.s_addr))
-                    {
-                        break;
-                    }
-                    next_hop_int = next_hop_int->next;
-                }
-
-                sr_add_rt_entry(dij_param->sr, topo_entry->net_num, final_item->topology_entry->next_hop, topo_entry->net_mask, next_hop_int->name, 110);
+                best_cost = node->cost + 1;
+                best_root = node->root;
             }
         }
-        topo_entry = topo_entry->next;
+
+        if (best_root == DIJKSTRA_NONE)
+        {
+            continue;
+        }
+
+        sr_rt_list_append(spf_tail, dest_net, roots[best_root].next_hop, links[dest].net_mask,
+                          roots[best_root].ifindex, 110);
+        spf_tail = &((*spf_tail)->next);
     }
-    Debug("\n-> PWOSPF: Dijkstra algorithm completed\n\n");
-    Debug("\n-> PWOSPF: Printing the forwarding table\n");
-    sr_print_routing_table(dij_param->sr);
 
-    pthread_mutex_unlock(&mutex);
+    /* Me quedo con el árbol para la próxima corrida */
+    free(g_last_tree.nodes);
+    free(g_last_tree.roots);
+    g_last_tree.links_gen = links_gen;
+    g_last_tree.nodes = nodes;
+    g_last_tree.node_count = node_count;
+    g_last_tree.roots = roots;
+    g_last_tree.root_count = root_count;
+
+    free(statics);
+    free(heap.items);
+    free(by_net);
+    free(by_rid);
+    free(links);
+
+    /* Publico solo si cambió alguna ruta */
+    unsigned int rt_changes = sr_rt_update_dynamic(dij_param->sr, spf_routes);
+
+    Debug("\n-> PWOSPF: Dijkstra algorithm completed, %u routes changed\n\n", rt_changes);
+    if (rt_changes != 0)
+    {
+        Debug("\n-> PWOSPF: Printing the forwarding table\n");
+        sr_print_routing_table(dij_param->sr);
+    }
+
+    pthread_mutex_unlock(mutex);
 
     return NULL;
 } /* -- run_dijkstra -- */
 
-void dijkstra_stack_push(struct dijkstra_item* dijkstra_first_item, struct dijkstra_item* dijkstra_new_item)
+/*---------------------------------------------------------------------
+ * Method: dijkstra_drop_tree
+ *
+ * Descarta el árbol retenido: la próxima corrida calcula de cero. Se
+ * llama sin corridas en curso.
+ *
+ *---------------------------------------------------------------------*/
+
+void dijkstra_drop_tree(void)
 {
-    if (dijkstra_first_item->next != NULL)
-    {
-        dijkstra_new_item->next = dijkstra_first_item->next;
-        dijkstra_first_item->next = dijkstra_new_item;
-    }
+    free(g_last_tree.nodes);
+    free(g_last_tree.roots);
+    memset(&g_last_tree, 0, sizeof(g_last_tree));
+} /* -- dijkstra_drop_tree -- */
+
+/*---------------------------------------------------------------------
+ * Method: dijkstra_get_stats
+ *
+ * Copia los contadores de corridas.
+ *
+ *---------------------------------------------------------------------*/
 
-    dijkstra_first_item->next = dijkstra_new_item;
+void dijkstra_get_stats(struct dijkstra_stats* stats)
+{
+    stats->full = __atomic_load_n(&(g_stats.full), __ATOMIC_RELAXED);
+    stats->incremental = __atomic_load_n(&(g_stats.incremental), __ATOMIC_RELAXED);
+    stats->reused = __atomic_load_n(&(g_stats.reused), __ATOMIC_RELAXED);
+    stats->settled = __atomic_load_n(&(g_stats.settled), __ATOMIC_RELAXED);
+} /* -- dijkstra_get_stats -- */
+
+static void dijkstra_heap_swap(struct dijkstra_heap* heap, unsigned int a, unsigned int b)
+{
+    unsigned int temp = heap->items[a];
+
+    heap->items[a] = heap->items[b];
+    heap->items[b] = temp;
+    heap->nodes[heap->items[a]].heap_pos = a;
+    heap->nodes[heap->items[b]].heap_pos = b;
 }
 
-void dijkstra_stack_reorder(struct dijkstra_item* dijkstra_first_item)
+static void dijkstra_heap_up(struct dijkstra_heap* heap, unsigned int pos)
 {
-    struct dijkstra_item* ptr = dijkstra_first_item;
-    while (ptr->next != NULL)
+    while (pos > 0)
     {
-        if (ptr->next->next == NULL)
+        unsigned int up = (pos - 1) / 2;
+        if (heap->nodes[heap->items[up]].cost <= heap->nodes[heap->items[pos]].cost)
         {
             break;
         }
+        dijkstra_heap_swap(heap, up, pos);
+        pos = up;
+    }
+}
+
+static void dijkstra_heap_down(struct dijkstra_heap* heap, unsigned int pos)
+{
+    while (1)
+    {
+        unsigned int least = pos;
+        unsigned int left = 2 * pos + 1;
+        unsigned int right = left + 1;
 
-        if (ptr->next->cost > ptr->next->next->cost)
+        if ((left < heap->size) && (heap->nodes[heap->items[left]].cost < heap->nodes[heap->items[least]].cost))
         {
-            struct dijkstra_item* temp_1 = ptr->next->next->next;
-            struct dijkstra_item* temp_2 = ptr->next->next;
-            ptr->next->next->next = ptr->next;
-            ptr->next->next = temp_1;
-            ptr->next = temp_2;
+            least = left;
         }
-
-        ptr = ptr->next;
+        if ((right < heap->size) && (heap->nodes[heap->items[right]].cost < heap->nodes[heap->items[least]].cost))
+        {
+            least = right;
+        }
+        if (least == pos)
+        {
+            break;
+        }
+        dijkstra_heap_swap(heap, pos, least);
+        pos = least;
     }
 }
 
-struct dijkstra_item* dijkstra_stack_pop(struct dijkstra_item* dijkstra_first_item)
+/*---------------------------------------------------------------------
+ * Method: dijkstra_heap_update
+ *
+ * Le asigna costo cost al nodo: lo agrega al heap o, si ya está, le
+ * baja el costo (decrease-key). cost no puede ser mayor al actual.
+ *
+ *---------------------------------------------------------------------*/
+
+void dijkstra_heap_update(struct dijkstra_heap* heap, unsigned int node, unsigned int cost)
 {
-    if (dijkstra_first_item->next == NULL)
+    heap->nodes[node].cost = cost;
+
+    if (heap->nodes[node].heap_pos == DIJKSTRA_NONE)
     {
-        return NULL;
+        heap->items[heap->size] = node;
+        heap->nodes[node].heap_pos = heap->size;
+        heap->size++;
     }
-    else
+
+    dijkstra_heap_up(heap, heap->nodes[node].heap_pos);
+} /* -- dijkstra_heap_update -- */
+
+/*---------------------------------------------------------------------
+ * Method: dijkstra_heap_pop
+ *
+ * Saca el nodo de menor costo, DIJKSTRA_NONE si el heap está vacío.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int dijkstra_heap_pop(struct dijkstra_heap* heap)
+{
+    if (heap->size == 0)
     {
-        struct dijkstra_item* pResult = dijkstra_first_item->next;
+        return DIJKSTRA_NONE;
+    }
 
-        dijkstra_first_item->next = dijkstra_first_item->next->next;
+    unsigned int node = heap->items[0];
 
-        return pResult;
+    heap->size--;
+    if (heap->size > 0)
+    {
+        heap->items[0] = heap->items[heap->size];
+        heap->nodes[heap->items[0]].heap_pos = 0;
+        dijkstra_heap_down(heap, 0);
     }
-}
+    heap->nodes[node].heap_pos = DIJKSTRA_NONE;
 
-struct dijkstra_item* create_dikjstra_item(struct pwospf_topology_entry* new_topology_entry, uint8_t cost)
-{
-    struct dijkstra_item* dijkstra_new_item = ((struct dijkstra_item*)(malloc(sizeof(struct dijkstra_item))));
-    dijkstra_new_item->topology_entry = new_topology_entry;
-    dijkstra_new_item->cost = cost;
-    dijkstra_new_item->parent = NULL;
-    dijkstra_new_item->next = NULL;
-    return dijkstra_new_item;
-}
+    return node;
+} /* -- dijkstra_heap_pop -- */
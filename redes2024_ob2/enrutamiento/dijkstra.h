@@ -8,26 +8,88 @@
 
 #include "sr_protocol.h"
 
-struct dijkstra_item
+#define DIJKSTRA_NONE 0xffffffffU   /* índice nulo: sin nodo, fuera del heap */
+
+/* Una entrada de la topología: un enlace (o red stub) anunciado por un router */
+struct dijkstra_link
+{
+    struct in_addr router_id;   /* -- router que anuncia el enlace -- */
+    struct in_addr net_num;     /* -- prefijo del enlace -- */
+    struct in_addr net_mask;
+    struct in_addr neighbor_id; /* -- router del otro lado, 0 si es una red stub -- */
+    unsigned int node;          /* -- nodo del router que lo anuncia -- */
+    uint8_t routed;             /* -- el prefijo ya se resolvió en esta corrida -- */
+};
+
+/* Un nodo por router del grafo. Sus enlaces son by_rid[first_link ..
+   first_link + link_count - 1]. */
+struct dijkstra_node
+{
+    struct in_addr router_id;
+    unsigned int first_link;
+    unsigned int link_count;
+    unsigned int cost;
+    unsigned int root;          /* -- interfaz propia por la que se llega -- */
+    unsigned int parent;        /* -- nodo anterior en el árbol, DIJKSTRA_NONE
+                                      si cuelga de una raíz o no se llega -- */
+    unsigned int heap_pos;      /* -- posición en el heap -- */
+    uint8_t done;
+};
+
+/* Una interfaz propia con vecino: el primer salto de todos los caminos */
+struct dijkstra_root
+{
+    struct in_addr net_num;
+    struct in_addr net_mask;
+    struct in_addr neighbor_id;
+    struct in_addr next_hop;
+    unsigned int ifindex;
+};
+
+/* El árbol de la última corrida. Si desde entonces solo cambiaron redes
+   stub (mismos enlaces, mismos routers, mismas raíces) se reusa tal cual
+   y solo se vuelven a resolver los prefijos. Si cambiaron enlaces o
+   routers pero no las raíces, se recalculan solo los subárboles que
+   perdieron el camino y los nodos a los que un enlace nuevo acerca. */
+struct dijkstra_tree
+{
+    unsigned long links_gen;    /* -- links_gen del subsistema al calcularlo -- */
+    struct dijkstra_node* nodes;
+    unsigned int node_count;
+    struct dijkstra_root* roots;
+    unsigned int root_count;
+};
+
+/* Corridas de cada tipo y nodos que salieron del heap en total */
+struct dijkstra_stats
+{
+    unsigned long full;
+    unsigned long incremental;
+    unsigned long reused;
+    unsigned long settled;
+};
+
+/* Min-heap binario de índices de nodos, ordenado por costo. heap_pos en
+   cada nodo permite bajarle el costo a uno que ya está en el heap. */
+struct dijkstra_heap
 {
-    struct pwospf_topology_entry* topology_entry;
-    uint8_t cost;
-    struct dijkstra_item* parent;
-    struct dijkstra_item* next;
-} __attribute__ ((packed)) ;
+    struct dijkstra_node* nodes;
+    unsigned int* items;
+    unsigned int size;
+};
 
 struct dijkstra_param
 {
     struct sr_instance* sr;
-    struct pwospf_topology_entry* topology;
+    struct pwospf_lsdb* topology;
     struct in_addr rid;
-    pthread_mutex_t mutex;
+    pthread_mutex_t* mutex;
 }__attribute__ ((packed));
 typedef struct dijkstra_param dijkstra_param_t;
 
 void* run_dijkstra(void*);
-void dijkstra_stack_push(struct dijkstra_item*, struct dijkstra_item*);
-void dijkstra_stack_reorder(struct dijkstra_item*);
-struct dijkstra_item* dijkstra_stack_pop(struct dijkstra_item*);
-struct dijkstra_item* create_dikjstra_item(struct pwospf_topology_entry*, uint8_t);
+void dijkstra_drop_tree(void);
+void dijkstra_get_stats(struct dijkstra_stats*);
+void dijkstra_heap_update(struct dijkstra_heap*, unsigned int, unsigned int);
+unsigned int dijkstra_heap_pop(struct dijkstra_heap*);
 #endif	/*DIJKSTRA_H*/
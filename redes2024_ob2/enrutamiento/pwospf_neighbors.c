@@ -1,5 +1,6 @@
 #include "pwospf_neighbors.h"
 #include "pwospf_protocol.h"
+#include "sr_pwospf.h"
 
 void add_neighbor(struct ospfv2_neighbor* first_neighbor, struct ospfv2_neighbor* new_neighbor)
 {
@@ -30,53 +31,43 @@ void delete_neighbor(struct ospfv2_neighbor* previous_neighbor)
     free(temp);
 }
 
-struct ospfv2_neighbor* check_neighbors_alive(struct ospfv2_neighbor* first_neighbor)
+uint8_t remove_neighbor(struct ospfv2_neighbor* first_neighbor, struct ospfv2_neighbor* neighbor)
 {
     struct ospfv2_neighbor* ptr = first_neighbor;
-    struct ospfv2_neighbor* result = NULL;
 
-    while(ptr != NULL)
+    while (ptr->next != NULL)
     {
-        if (ptr->next == NULL)
-        {
-            break;
-        }
-
-        if (ptr->next->alive == 0)
+        if (ptr->next == neighbor)
         {
-            Debug("\n\n**** PWOSPF: Removing the neighbor, [ID = %s] from the alive neighbors table\n\n", inet_ntoa(ptr->next->neighbor_id));
-            struct ospfv2_neighbor* temp = result;
-            result = create_ospfv2_neighbor(ptr->next->neighbor_id);
-            result->next = temp;
+            Debug("\n\n**** PWOSPF: Removing the neighbor, [ID = %s] from the alive neighbors table\n\n", inet_ntoa(neighbor->neighbor_id));
             delete_neighbor(ptr);
-        }
-        else
-        {
-            ptr->next->alive--;
+            return 1;
         }
 
         ptr = ptr->next;
     }
-    return result;
+
+    return 0;
 }
 
-void refresh_neighbors_alive(struct ospfv2_neighbor* first_neighbor, struct in_addr neighbor_id)
+struct ospfv2_neighbor* refresh_neighbors_alive(struct ospfv2_neighbor* first_neighbor, struct in_addr neighbor_id)
 {
-    struct ospfv2_neighbor* ptr = first_neighbor;
+    struct ospfv2_neighbor* ptr = first_neighbor->next;
     while(ptr != NULL)
     {
         if (ptr->neighbor_id.s_addr == neighbor_id.s_addr)
         {
             Debug("-> PWOSPF: Refreshing the neighbor, [ID = %s] in the alive neighbors table\n", inet_ntoa(neighbor_id));
-            ptr->alive = OSPF_NEIGHBOR_TIMEOUT;
-            return;
+            return ptr;
         }
 
         ptr = ptr->next;
     }
 
     Debug("-> PWOSPF: Adding the neighbor, [ID = %s] to the alive neighbors table\n", inet_ntoa(neighbor_id));
-    add_neighbor(first_neighbor, create_ospfv2_neighbor(neighbor_id));
+    ptr = create_ospfv2_neighbor(neighbor_id);
+    add_neighbor(first_neighbor, ptr);
+    return ptr;
 }
 
 struct ospfv2_neighbor* create_ospfv2_neighbor(struct in_addr neighbor_id)
@@ -84,7 +75,7 @@ struct ospfv2_neighbor* create_ospfv2_neighbor(struct in_addr neighbor_id)
     struct ospfv2_neighbor* new_neighbor = ((struct ospfv2_neighbor*)(malloc(sizeof(struct ospfv2_neighbor))));
 
     new_neighbor->neighbor_id = neighbor_id;
-    new_neighbor->alive = OSPF_NEIGHBOR_TIMEOUT;
+    sr_timer_init(&(new_neighbor->timeout), pwospf_neighbor_timeout, new_neighbor);
     new_neighbor->next = NULL;
 
     return new_neighbor;
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 
 #include "sr_router.h"
+#include "sr_timer.h"
 
 
 /* ----------------------------------------------------------------------------
@@ -21,15 +22,15 @@
 struct ospfv2_neighbor
 {
     struct in_addr neighbor_id; /* -- the neighbor id -- */
-    uint8_t alive;        /* -- alive since [in seconds] -- */
+    struct sr_timer timeout;    /* -- dies OSPF_NEIGHBOR_TIMEOUT s after its last HELLO -- */
     struct ospfv2_neighbor* next;
-}__attribute__ ((packed));
+};
 
 
 void add_neighbor(struct ospfv2_neighbor*, struct ospfv2_neighbor*);
 void delete_neighbor(struct ospfv2_neighbor*);
-struct ospfv2_neighbor* check_neighbors_alive(struct ospfv2_neighbor*);
-void refresh_neighbors_alive(struct ospfv2_neighbor*, struct in_addr);
+uint8_t remove_neighbor(struct ospfv2_neighbor*, struct ospfv2_neighbor*);
+struct ospfv2_neighbor* refresh_neighbors_alive(struct ospfv2_neighbor*, struct in_addr);
 struct ospfv2_neighbor* create_ospfv2_neighbor(struct in_addr);
 
 
@@ -1,98 +1,229 @@
 #include "pwospf_topology.h"
 #include "pwospf_protocol.h"
+#include "sr_pwospf.h"
 
-void add_topology_entry(struct pwospf_topology_entry* first_entry, struct pwospf_topology_entry* new_entry)
+#include <string.h>
+
+/* -- bucket de key en los índices -- */
+static unsigned int topo_hash(struct pwospf_lsdb* lsdb, uint32_t key)
+{
+    return (unsigned int)((key * 2654435769U) >> lsdb->shift);
+}
+
+static unsigned int topo_link_hash(struct pwospf_lsdb* lsdb, struct in_addr router_id, struct in_addr net_num)
+{
+    return topo_hash(lsdb, router_id.s_addr ^ (net_num.s_addr * 2246822519U));
+}
+
+static struct pwospf_topology_router* find_topology_router(struct pwospf_lsdb* lsdb, struct in_addr router_id)
 {
-    if (first_entry->next != NULL)
+    struct pwospf_topology_router* router = lsdb->by_router[topo_hash(lsdb, router_id.s_addr)];
+
+    while ((router != NULL) && (router->router_id.s_addr != router_id.s_addr))
     {
-        new_entry->next = first_entry->next;
-        first_entry->next = new_entry;
+        router = router->next;
     }
-    else
+
+    return router;
+}
+
+/* -- duplica los buckets de los tres índices y redistribuye todo -- */
+static void grow_topology_indexes(struct pwospf_lsdb* lsdb)
+{
+    struct pwospf_topology_router** old_by_router = lsdb->by_router;
+    unsigned int old_size = lsdb->size;
+    unsigned int i;
+
+    free(lsdb->by_link);
+    free(lsdb->by_net);
+    lsdb->size *= 2;
+    lsdb->shift--;
+    lsdb->by_link = (struct pwospf_topology_entry**)calloc(lsdb->size, sizeof(struct pwospf_topology_entry*));
+    lsdb->by_net = (struct pwospf_topology_entry**)calloc(lsdb->size, sizeof(struct pwospf_topology_entry*));
+    lsdb->by_router = (struct pwospf_topology_router**)calloc(lsdb->size, sizeof(struct pwospf_topology_router*));
+
+    struct pwospf_topology_entry* entry;
+    for (entry = lsdb->head.next; entry != NULL; entry = entry->next)
     {
-        first_entry->next = new_entry;
+        unsigned int h = topo_link_hash(lsdb, entry->router_id, entry->net_num);
+        entry->link_next = lsdb->by_link[h];
+        lsdb->by_link[h] = entry;
+
+        h = topo_hash(lsdb, entry->net_num.s_addr);
+        entry->net_next = lsdb->by_net[h];
+        lsdb->by_net[h] = entry;
     }
+
+    for (i = 0; i < old_size; i++)
+    {
+        struct pwospf_topology_router* router = old_by_router[i];
+        while (router != NULL)
+        {
+            struct pwospf_topology_router* next = router->next;
+            unsigned int h = topo_hash(lsdb, router->router_id.s_addr);
+            router->next = lsdb->by_router[h];
+            lsdb->by_router[h] = router;
+            router = next;
+        }
+    }
+
+    free(old_by_router);
 }
 
-void delete_topology_entry(struct pwospf_topology_entry* previous_entry)
+struct pwospf_lsdb* create_pwospf_lsdb(void)
 {
-    struct pwospf_topology_entry* temp = previous_entry->next;
+    struct pwospf_lsdb* lsdb = ((struct pwospf_lsdb*)(malloc(sizeof(struct pwospf_lsdb))));
+
+    memset(&(lsdb->head), 0, sizeof(struct pwospf_topology_entry));
+    lsdb->count = 0;
+    lsdb->routers = 0;
+    lsdb->size = TOPO_HASH_MIN;
+    lsdb->shift = 32 - 6;      /* log2(TOPO_HASH_MIN) = 6 */
+    lsdb->by_link = (struct pwospf_topology_entry**)calloc(lsdb->size, sizeof(struct pwospf_topology_entry*));
+    lsdb->by_net = (struct pwospf_topology_entry**)calloc(lsdb->size, sizeof(struct pwospf_topology_entry*));
+    lsdb->by_router = (struct pwospf_topology_router**)calloc(lsdb->size, sizeof(struct pwospf_topology_router*));
+
+    return lsdb;
+}
 
-    if (previous_entry->next->next != NULL)
+void add_topology_entry(struct pwospf_lsdb* lsdb, struct pwospf_topology_entry* new_entry)
+{
+    if (lsdb->count >= lsdb->size)
     {
-        previous_entry->next = previous_entry->next->next;
+        grow_topology_indexes(lsdb);
     }
-    else
+
+    /* Las entradas nuevas van al principio de la lista */
+    new_entry->next = lsdb->head.next;
+    if (new_entry->next != NULL)
     {
-        previous_entry->next = NULL;
+        new_entry->next->prev = new_entry;
     }
+    new_entry->prev = &(lsdb->head);
+    lsdb->head.next = new_entry;
+
+    unsigned int h = topo_link_hash(lsdb, new_entry->router_id, new_entry->net_num);
+    new_entry->link_next = lsdb->by_link[h];
+    lsdb->by_link[h] = new_entry;
+
+    h = topo_hash(lsdb, new_entry->net_num.s_addr);
+    new_entry->net_next = lsdb->by_net[h];
+    lsdb->by_net[h] = new_entry;
 
-    free(temp);
+    struct pwospf_topology_router* router = find_topology_router(lsdb, new_entry->router_id);
+    if (router == NULL)
+    {
+        router = ((struct pwospf_topology_router*)(malloc(sizeof(struct pwospf_topology_router))));
+        router->router_id = new_entry->router_id;
+        router->sequence_num = new_entry->sequence_num;
+        router->links = NULL;
+        router->link_count = 0;
+
+        h = topo_hash(lsdb, router->router_id.s_addr);
+        router->next = lsdb->by_router[h];
+        lsdb->by_router[h] = router;
+        lsdb->routers++;
+    }
+    new_entry->router_next = router->links;
+    router->links = new_entry;
+    router->link_count++;
+    new_entry->router = router;
+
+    lsdb->count++;
 }
 
-uint8_t check_topology_age(struct pwospf_topology_entry* first_entry)
+uint8_t remove_topology_entry(struct pwospf_lsdb* lsdb, struct pwospf_topology_entry* entry)
 {
-    struct pwospf_topology_entry* ptr = first_entry;
+    struct pwospf_topology_entry** link;
 
-    uint8_t deleted = 0;
-    while(ptr != NULL)
+    if (entry->prev == NULL)
     {
-        if (ptr->next == NULL)
-        {
-            break;
-        }
+        return 0;
+    }
 
-        if (ptr->next->age == OSPF_TOPO_ENTRY_TIMEOUT)
-        {
-            Debug("\n\n**** PWOSPF: Removing a topology entry from the topology table *****\n");
-            Debug("        [Network = %s]\n", inet_ntoa(ptr->next->net_num));
-            Debug("        [Mask = %s]\n", inet_ntoa(ptr->next->net_mask));
-            Debug("        [Neighbor ID = %s]\n", inet_ntoa(ptr->next->neighbor_id));
-            Debug("        [Age = %d]\n\n", ptr->next->age);
+    Debug("\n\n**** PWOSPF: Removing a topology entry from the topology table *****\n");
+    Debug("        [Network = %s]\n", inet_ntoa(entry->net_num));
+    Debug("        [Mask = %s]\n", inet_ntoa(entry->net_mask));
+    Debug("        [Neighbor ID = %s]\n", inet_ntoa(entry->neighbor_id));
+    Debug("        [Age = %d]\n\n", (int)difftime(time(NULL), entry->refreshed));
 
-            delete_topology_entry(ptr);
+    entry->prev->next = entry->next;
+    if (entry->next != NULL)
+    {
+        entry->next->prev = entry->prev;
+    }
 
-            deleted = 1;
-        }
-        else
-        {
-            ptr->next->age++;
-        }
+    for (link = &(lsdb->by_link[topo_link_hash(lsdb, entry->router_id, entry->net_num)]); *link != entry; link = &((*link)->link_next));
+    *link = entry->link_next;
 
-        ptr = ptr->next;
+    for (link = &(lsdb->by_net[topo_hash(lsdb, entry->net_num.s_addr)]); *link != entry; link = &((*link)->net_next));
+    *link = entry->net_next;
+
+    struct pwospf_topology_router* router = entry->router;
+    for (link = &(router->links); *link != entry; link = &((*link)->router_next));
+    *link = entry->router_next;
+
+    /* El router que ya no anuncia nada sale del índice */
+    router->link_count--;
+    if (router->link_count == 0)
+    {
+        struct pwospf_topology_router** r;
+        for (r = &(lsdb->by_router[topo_hash(lsdb, router->router_id.s_addr)]); *r != router; r = &((*r)->next));
+        *r = router->next;
+        free(router);
+        lsdb->routers--;
     }
 
-    return deleted;
+    lsdb->count--;
+    free(entry);
+    return 1;
 }
 
-void refresh_topology_entry(struct pwospf_topology_entry* first_entry, struct in_addr router_id, struct in_addr net_num, struct in_addr net_mask,
-    struct in_addr neighbor_id, struct in_addr next_hop, uint16_t sequence_num)
+struct pwospf_topology_entry* refresh_topology_entry(struct pwospf_lsdb* lsdb, struct in_addr router_id, struct in_addr net_num, struct in_addr net_mask,
+    struct in_addr neighbor_id, struct in_addr next_hop, uint16_t sequence_num, uint8_t* changes)
 {
-    struct pwospf_topology_entry* ptr = first_entry->next;
+    /* La entrada del propio router se busca por (router_id, net_num) */
+    struct pwospf_topology_entry* ptr = lsdb->by_link[topo_link_hash(lsdb, router_id, net_num)];
     while(ptr != NULL)
     {
-        if ((ptr->net_num.s_addr == net_num.s_addr) && (ptr->net_mask.s_addr == net_mask.s_addr))
+        if ((ptr->router_id.s_addr == router_id.s_addr) &&
+            (ptr->net_num.s_addr == net_num.s_addr) && (ptr->net_mask.s_addr == net_mask.s_addr))
         {
-            if (ptr->router_id.s_addr == router_id.s_addr)
+            Debug("-> PWOSPF: Refreshing a topology entry in the toplogy table\n");
+            Debug("        [Network = %s]\n", inet_ntoa(ptr->net_num));
+            Debug("        [Mask = %s]\n", inet_ntoa(ptr->net_mask));
+            Debug("        [Neighbor ID = %s]\n", inet_ntoa(ptr->neighbor_id));
+
+            /* Un refresco con el mismo vecino no cambia la topología */
+            if (ptr->neighbor_id.s_addr != neighbor_id.s_addr)
             {
-                Debug("-> PWOSPF: Refreshing a topology entry in the toplogy table\n");
-                Debug("        [Network = %s]\n", inet_ntoa(ptr->net_num));
-                Debug("        [Mask = %s]\n", inet_ntoa(ptr->net_mask));
-                Debug("        [Neighbor ID = %s]\n", inet_ntoa(ptr->neighbor_id));
-
-                ptr->age = 0; /*OSPF_TOPO_ENTRY_TIMEOUT*/
-                ptr->sequence_num = sequence_num;
-                ptr->neighbor_id.s_addr = neighbor_id.s_addr;
-                return;
+                *changes |= TOPO_LINK_CHANGED;
             }
+
+            ptr->refreshed = time(NULL);
+            ptr->sequence_num = sequence_num;
+            ptr->neighbor_id.s_addr = neighbor_id.s_addr;
+            ptr->router->sequence_num = sequence_num;
+            return ptr;
+        }
+
+        ptr = ptr->link_next;
+    }
+
+    /* Las entradas de otros routers para la misma red tienen que ser consistentes */
+    ptr = lsdb->by_net[topo_hash(lsdb, net_num.s_addr)];
+    while(ptr != NULL)
+    {
+        if ((ptr->net_num.s_addr == net_num.s_addr) && (ptr->net_mask.s_addr == net_mask.s_addr))
+        {
             /* first condition */
-            else if ((ptr->neighbor_id.s_addr != 0) && ((ptr->router_id.s_addr != neighbor_id.s_addr) || (ptr->neighbor_id.s_addr != router_id.s_addr)))
+            if ((ptr->neighbor_id.s_addr != 0) && ((ptr->router_id.s_addr != neighbor_id.s_addr) || (ptr->neighbor_id.s_addr != router_id.s_addr)))
             {
                 Debug("-> PWOSPF: Droping a topology entry: Invalid entry neighbor\n");
                 Debug("        [Network = %s]\n", inet_ntoa(net_num));
                 Debug("        [Mask = %s]\n", inet_ntoa(net_mask));
                 Debug("        [Neighbor ID = %s]\n", inet_ntoa(neighbor_id));
-                return;
+                return NULL;
             }
             /* second condition */
             else if ((ptr->neighbor_id.s_addr == router_id.s_addr) && (ptr->net_mask.s_addr != net_mask.s_addr))
@@ -101,18 +232,22 @@ void refresh_topology_entry(struct pwospf_topology_entry* first_entry, struct in
                 Debug("        [Network = %s]\n", inet_ntoa(net_num));
                 Debug("        [Mask = %s]\n", inet_ntoa(net_mask));
                 Debug("        [Neighbor ID = %s]\n", inet_ntoa(neighbor_id));
-                return;
+                return NULL;
             }
         }
 
-        ptr = ptr->next;
+        ptr = ptr->net_next;
     }
 
     Debug("-> PWOSPF: Adding a topology entry in the toplogy table\n");
     Debug("        [Network = %s]\n", inet_ntoa(net_num));
     Debug("        [Mask = %s]\n", inet_ntoa(net_mask));
     Debug("        [Neighbor ID = %s]\n", inet_ntoa(neighbor_id));
-    add_topology_entry(first_entry, create_ospfv2_topology_entry(router_id, net_num, net_mask, neighbor_id, next_hop, sequence_num));
+    ptr = create_ospfv2_topology_entry(router_id, net_num, net_mask, neighbor_id, next_hop, sequence_num);
+    add_topology_entry(lsdb, ptr);
+    ptr->router->sequence_num = sequence_num;
+    *changes |= (neighbor_id.s_addr != 0) ? TOPO_LINK_CHANGED : TOPO_PREFIX_CHANGED;
+    return ptr;
 }
 
 struct pwospf_topology_entry* create_ospfv2_topology_entry(struct in_addr router_id, struct in_addr net_num, struct in_addr net_mask,
@@ -126,36 +261,26 @@ struct pwospf_topology_entry* create_ospfv2_topology_entry(struct in_addr router
     new_entry->neighbor_id = neighbor_id;
     new_entry->next_hop = next_hop;
     new_entry->sequence_num = sequence_num;
-    new_entry->age = 0;
+    new_entry->refreshed = time(NULL);
+    sr_timer_init(&(new_entry->timeout), pwospf_topology_timeout, new_entry);
     new_entry->next = NULL;
+    new_entry->prev = NULL;
+    new_entry->link_next = NULL;
+    new_entry->net_next = NULL;
+    new_entry->router_next = NULL;
+    new_entry->router = NULL;
 
     return new_entry;
 }
 
-struct pwospf_topology_entry* clone_ospfv2_topology_entry(struct pwospf_topology_entry* entry)
-{
-    struct pwospf_topology_entry* copy_entry = ((struct pwospf_topology_entry*)(malloc(sizeof(struct pwospf_topology_entry))));
-
-    copy_entry->router_id = entry->router_id;
-    copy_entry->net_num = entry->net_num;
-    copy_entry->net_mask = entry->net_mask;
-    copy_entry->neighbor_id = entry->neighbor_id;
-    copy_entry->next_hop = entry->next_hop;
-    copy_entry->sequence_num = entry->sequence_num;
-    copy_entry->age = entry->age;
-    copy_entry->next = entry->next;
-
-    return copy_entry;
-}
-
-void print_topolgy_table(struct pwospf_topology_entry* first_entry)
+void print_topolgy_table(struct pwospf_lsdb* lsdb)
 {
     /*Debug("--------------------------------------------------------------------------------------------------------\n");*/
     Debug("========================================================================================================\n");
     Debug("%-18s%-18s%-18s%-18s%-18s%-11sAge\n", "Router ID", "Subnet", "Subnet Mask", "Neighbor ID", "Next Hop", "Sequence");
     Debug("%-18s%-18s%-18s%-18s%-18s%-11s---\n", "---------", "------", "-----------", "-----------", "--------", "--------");
 
-    struct pwospf_topology_entry* entry = first_entry->next;
+    struct pwospf_topology_entry* entry = lsdb->head.next;
     if (entry == NULL)
     {
         Debug("The topology table is empty");
@@ -170,7 +295,7 @@ void print_topolgy_table(struct pwospf_topology_entry* first_entry)
             Debug("%-18s",inet_ntoa(entry->neighbor_id));
             Debug("%-18s",inet_ntoa(entry->next_hop));
             Debug("%-11d",entry->sequence_num);
-            Debug("%d\n",entry->age);
+            Debug("%d\n",(int)difftime(time(NULL), entry->refreshed));
 
             entry = entry->next; 
         }
@@ -178,9 +303,9 @@ void print_topolgy_table(struct pwospf_topology_entry* first_entry)
     Debug("========================================================================================================\n");
 }
 
-uint8_t search_topolgy_table(struct pwospf_topology_entry* first_entry, uint32_t subnet)
+uint8_t search_topolgy_table(struct pwospf_lsdb* lsdb, uint32_t subnet)
 {
-    struct pwospf_topology_entry* entry = first_entry->next;
+    struct pwospf_topology_entry* entry = lsdb->by_net[topo_hash(lsdb, subnet)];
     while(entry != NULL)
     {
         if (entry->net_num.s_addr == subnet)
@@ -188,34 +313,29 @@ uint8_t search_topolgy_table(struct pwospf_topology_entry* first_entry, uint32_t
             return 1;
         }
 
-        entry = entry->next;
+        entry = entry->net_next;
     }
 
     return 0;
 }
 
-uint8_t check_sequence_number(struct pwospf_topology_entry* first_entry, struct in_addr router_id, uint16_t sequence_num)
+uint8_t check_sequence_number(struct pwospf_lsdb* lsdb, struct in_addr router_id, uint16_t sequence_num)
 {
-    struct pwospf_topology_entry* entry = first_entry->next;
-    while(entry != NULL)
-    {
-        if (entry->router_id.s_addr == router_id.s_addr)
-        {
-            print_topolgy_table(first_entry);
-            fprintf(stdout,"Router Id: %u, Sequence Number: %u\n",router_id.s_addr,sequence_num);
-            fprintf(stdout,"Entry Router Id: %u, Sequence Number: %u\n",entry->router_id.s_addr,entry->sequence_num);
-            if (entry->sequence_num < sequence_num)
-            {
-                return 1;
-            }
-            else
-            {
-                return 0;
-            }
-        }
+    struct pwospf_topology_router* router = find_topology_router(lsdb, router_id);
 
-        entry = entry->next;
+    if (router == NULL)
+    {
+        return 1;
     }
 
-    return 1;
+    Debug("-> PWOSPF: Router Id: %s, Sequence Number: %u, last accepted: %u\n",
+          inet_ntoa(router_id), sequence_num, router->sequence_num);
+    if (router->sequence_num < sequence_num)
+    {
+        return 1;
+    }
+    else
+    {
+        return 0;
+    }
 }
@@ -9,7 +9,16 @@
 #include <stdlib.h>
 
 #include "sr_router.h"
+#include "sr_timer.h"
 
+/* -- qué cambió en la topología al procesar un LSA -- */
+#define TOPO_UNCHANGED       0x0  /* refresco periódico, mismo contenido */
+#define TOPO_PREFIX_CHANGED  0x1  /* apareció una red stub */
+#define TOPO_LINK_CHANGED    0x2  /* apareció o cambió un enlace entre routers */
+
+#define TOPO_HASH_MIN        64   /* buckets iniciales de cada índice */
+
+struct pwospf_topology_router;
 
 /* ----------------------------------------------------------------------------
  * struct pwospf_topology_entry
@@ -25,20 +34,62 @@ struct pwospf_topology_entry
     struct in_addr neighbor_id;   /* -- id del vecino -- */
     struct in_addr next_hop;      /* -- próximo salto -- */
     uint16_t sequence_num;        /* -- número de secuencia del último LSU -- */
-    int age;                      /* -- edad de la entrada -- */
+    time_t refreshed;             /* -- último LSU que la anunció -- */
+    struct sr_timer timeout;      /* -- vence OSPF_TOPO_ENTRY_TIMEOUT s después -- */
     struct pwospf_topology_entry* next;
-}__attribute__ ((packed));
+    struct pwospf_topology_entry* prev;        /* -- NULL si no está en la base -- */
+    struct pwospf_topology_entry* link_next;   /* -- cadena del índice (router_id, net_num) -- */
+    struct pwospf_topology_entry* net_next;    /* -- cadena del índice por net_num -- */
+    struct pwospf_topology_entry* router_next; /* -- siguiente enlace del mismo router -- */
+    struct pwospf_topology_router* router;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct pwospf_topology_router
+ *
+ * Lo que anuncia un router: su último número de secuencia y sus enlaces
+ *
+ * -------------------------------------------------------------------------- */
+
+struct pwospf_topology_router
+{
+    struct in_addr router_id;
+    uint16_t sequence_num;        /* -- del último LSU aceptado -- */
+    struct pwospf_topology_entry* links;
+    unsigned int link_count;
+    struct pwospf_topology_router* next; /* -- cadena del índice por router_id -- */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct pwospf_lsdb
+ *
+ * La base de la topología. head.next es la lista de todas las entradas,
+ * en el orden en que se recorre; los índices son tablas de hash de
+ * size buckets que crecen al doble cuando hay más entradas que buckets.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct pwospf_lsdb
+{
+    struct pwospf_topology_entry head;         /* -- centinela -- */
+    unsigned int count;                        /* -- entradas -- */
+    unsigned int routers;                      /* -- routers con alguna entrada -- */
+    unsigned int size;                         /* -- buckets, potencia de 2 -- */
+    unsigned int shift;                        /* -- 32 - log2(size) -- */
+    struct pwospf_topology_entry** by_link;    /* -- (router_id, net_num) -- */
+    struct pwospf_topology_entry** by_net;     /* -- net_num -- */
+    struct pwospf_topology_router** by_router; /* -- router_id -- */
+};
 
 
-void add_topology_entry(struct pwospf_topology_entry*, struct pwospf_topology_entry*);
-void delete_topology_entry(struct pwospf_topology_entry*);
-uint8_t check_topology_age(struct pwospf_topology_entry*);
-void refresh_topology_entry(struct pwospf_topology_entry*, struct in_addr, struct in_addr, struct in_addr, struct in_addr, struct in_addr, uint16_t);
+struct pwospf_lsdb* create_pwospf_lsdb(void);
+void add_topology_entry(struct pwospf_lsdb*, struct pwospf_topology_entry*);
+uint8_t remove_topology_entry(struct pwospf_lsdb*, struct pwospf_topology_entry*);
+struct pwospf_topology_entry* refresh_topology_entry(struct pwospf_lsdb*, struct in_addr, struct in_addr, struct in_addr, struct in_addr, struct in_addr, uint16_t, uint8_t*);
 struct pwospf_topology_entry* create_ospfv2_topology_entry(struct in_addr, struct in_addr, struct in_addr, struct in_addr, struct in_addr, uint16_t);
-struct pwospf_topology_entry* clone_ospfv2_topology_entry(struct pwospf_topology_entry*);
-void print_topolgy_table(struct pwospf_topology_entry*);
-uint8_t search_topolgy_table(struct pwospf_topology_entry*, uint32_t);
-uint8_t check_sequence_number(struct pwospf_topology_entry* first_entry, struct in_addr router_id, uint16_t sequence_num);
+void print_topolgy_table(struct pwospf_lsdb*);
+uint8_t search_topolgy_table(struct pwospf_lsdb*, uint32_t);
+uint8_t check_sequence_number(struct pwospf_lsdb* lsdb, struct in_addr router_id, uint16_t sequence_num);
 
 
 #endif  /* --  PWOSPF_TOPOLOGY -- */
@@ -0,0 +1,191 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_adj.c
+ *
+ * Description:
+ *
+ * Adjacency cache, see sr_adj.h. Slots are read without locks: a reader
+ * copies the slot and keeps the copy only if the slot sequence did not
+ * move meanwhile. A writer that finds the slot busy just skips caching.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <assert.h>
+
+#include "sr_adj.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_router.h"
+#include "sr_arpcache.h"
+
+static unsigned int sr_adj_slot(uint32_t next_hop)
+{
+    return ((next_hop * 2654435769U) >> 16) & (SR_ADJ_SZ - 1);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_init
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_init(struct sr_adj_table* table)
+{
+    assert(table);
+
+    memset(table, 0, sizeof(struct sr_adj_table));
+} /* -- sr_adj_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_read
+ *
+ * Copy slot into adj. Returns 0 if a writer was in the way.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_adj_read(struct sr_adj* slot, struct sr_adj* adj)
+{
+    unsigned int seq = __atomic_load_n(&(slot->seq), __ATOMIC_ACQUIRE);
+
+    if (seq & 1)
+    { return 0; }
+
+    memcpy(adj, slot, sizeof(struct sr_adj));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&(slot->seq), __ATOMIC_RELAXED) == seq;
+} /* -- sr_adj_read -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_write
+ *
+ * Store adj into slot unless another writer holds it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_adj_write(struct sr_adj* slot, const struct sr_adj* adj)
+{
+    unsigned int seq = __atomic_load_n(&(slot->seq), __ATOMIC_RELAXED);
+
+    if ((seq & 1) ||
+        !__atomic_compare_exchange_n(&(slot->seq), &seq, seq + 1, 0,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    { return; }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->next_hop = adj->next_hop;
+    slot->rt_gen = adj->rt_gen;
+    slot->arp_gen = adj->arp_gen;
+    slot->ifindex = adj->ifindex;
+    slot->iface = adj->iface;
+    memcpy(slot->hdr, adj->hdr, sizeof(slot->hdr));
+
+    __atomic_store_n(&(slot->seq), seq + 2, __ATOMIC_RELEASE);
+} /* -- sr_adj_write -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_resolve
+ *
+ * Find the route to ip_dst (network byte order) and the rewrite for its
+ * next hop. adj->next_hop and adj->ifindex are always set unless
+ * SR_ADJ_NO_ROUTE is returned; adj->iface and adj->hdr are only valid
+ * on SR_ADJ_OK.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_adj_resolve(struct sr_instance* sr, uint32_t ip_dst, struct sr_adj* adj)
+{
+    struct sr_adj* slot;
+    struct sr_rt* route;
+    struct sr_arpentry arp_entry;
+    sr_ethernet_hdr_t* eth;
+    unsigned int ifindex = 0;
+    unsigned long rt_gen, arp_gen, epoch;
+    uint32_t next_hop = 0;
+
+    assert(sr);
+    assert(adj);
+
+    /* -- anything changing after this point leaves what we build stale -- */
+    rt_gen = __atomic_load_n(&(sr->rt_gen), __ATOMIC_SEQ_CST);
+    arp_gen = __atomic_load_n(&(sr->cache.gen), __ATOMIC_SEQ_CST);
+
+    epoch = sr_rt_read_lock(sr);
+    route = sr_fib_lookup(__atomic_load_n(&(sr->fib), __ATOMIC_SEQ_CST), ip_dst);
+    if (route != 0)
+    {
+        next_hop = route->gw.s_addr ? route->gw.s_addr : ip_dst;
+        ifindex = route->ifindex;
+    }
+    sr_rt_read_unlock(sr, epoch);
+
+    if (route == 0)
+    { return SR_ADJ_NO_ROUTE; }
+
+    slot = &(sr->adj.slots[sr_adj_slot(next_hop)]);
+    if (sr_adj_read(slot, adj) && (adj->iface != 0) &&
+        (adj->next_hop == next_hop) && (adj->ifindex == ifindex) &&
+        (adj->rt_gen == rt_gen) && (adj->arp_gen == arp_gen))
+    {
+        /* -- only the first hit dirties the line again -- */
+        if (!__atomic_load_n(&(slot->used), __ATOMIC_RELAXED))
+        { __atomic_store_n(&(slot->used), 1, __ATOMIC_RELAXED); }
+        return SR_ADJ_OK;
+    }
+
+    /* -- miss, build the rewrite from scratch -- */
+    adj->next_hop = next_hop;
+    adj->ifindex = ifindex;
+    adj->rt_gen = rt_gen;
+    adj->arp_gen = arp_gen;
+
+    if (!sr_arpcache_lookup(&(sr->cache), next_hop, &arp_entry))
+    { return SR_ADJ_NO_ARP; }
+
+    /* -- routes are checked against the interfaces when loaded -- */
+    adj->iface = sr_get_interface_by_index(sr, ifindex);
+    if (adj->iface == 0)
+    { return SR_ADJ_NO_ROUTE; }
+
+    eth = (sr_ethernet_hdr_t*)adj->hdr;
+    memcpy(eth->ether_dhost, arp_entry.mac, ETHER_ADDR_LEN);
+    memcpy(eth->ether_shost, adj->iface->addr, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ethertype_ip);
+
+    sr_adj_write(slot, adj);
+
+    return SR_ADJ_OK;
+} /* -- sr_adj_resolve -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_apply
+ *
+ * Rewrite the Ethernet header of an IP packet for adj.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_apply(const struct sr_adj* adj, uint8_t* packet)
+{
+    memcpy(packet, adj->hdr, sizeof(adj->hdr));
+} /* -- sr_adj_apply -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_used
+ *
+ * Whether packets went out to next_hop through its cached rewrite since
+ * the last call. Used by the ARP cache to refresh only the mappings that
+ * carry traffic; a hint, a colliding next hop may hide or steal a hit.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_adj_used(struct sr_instance* sr, uint32_t next_hop)
+{
+    struct sr_adj* slot;
+
+    assert(sr);
+
+    slot = &(sr->adj.slots[sr_adj_slot(next_hop)]);
+    if (__atomic_load_n(&(slot->next_hop), __ATOMIC_RELAXED) != next_hop)
+    { return 0; }
+
+    return __atomic_exchange_n(&(slot->used), 0, __ATOMIC_RELAXED);
+} /* -- sr_adj_used -- */
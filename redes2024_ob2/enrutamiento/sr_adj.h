@@ -0,0 +1,67 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_adj.h
+ *
+ * Description:
+ *
+ * Adjacency cache. Maps a next hop to the Ethernet header every packet
+ * sent to it carries and to its output interface, so that forwarding a
+ * packet takes one FIB lookup and one header copy instead of a route
+ * lookup, an ARP lookup and an interface lookup by name.
+ *
+ * Entries are tagged with the routing table and ARP cache generations
+ * they were built from; any route or ARP mapping change makes them stale.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ADJ_H
+#define SR_ADJ_H
+
+#ifdef _DARWIN_
+#include <sys/types.h>
+#endif
+
+#include <netinet/in.h>
+
+#include "sr_protocol.h"
+
+#define SR_ADJ_SZ 256   /* slots, a power of two */
+
+struct sr_instance;
+struct sr_if;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_adj
+ *
+ * Ready-made rewrite for one next hop. Slots are direct-mapped by next hop,
+ * a colliding next hop simply replaces the previous one.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_adj
+{
+    unsigned int seq;                   /* odd while the slot is rewritten */
+    uint32_t next_hop;                  /* network byte order */
+    unsigned long rt_gen;               /* sr->rt_gen when built */
+    unsigned long arp_gen;              /* sr->cache.gen when built */
+    unsigned int ifindex;               /* output interface index */
+    struct sr_if* iface;                /* output interface */
+    uint8_t hdr[sizeof(sr_ethernet_hdr_t)]; /* dst mac, src mac, type */
+    unsigned int used;                  /* set by hits, see sr_adj_used */
+};
+
+struct sr_adj_table
+{
+    struct sr_adj slots[SR_ADJ_SZ];
+};
+
+/* sr_adj_resolve results */
+#define SR_ADJ_NO_ROUTE  -1   /* no route to the destination */
+#define SR_ADJ_NO_ARP     0   /* route found, next hop MAC unknown */
+#define SR_ADJ_OK         1   /* adj is ready to be applied */
+
+void sr_adj_init(struct sr_adj_table*);
+int  sr_adj_resolve(struct sr_instance*, uint32_t, struct sr_adj*);
+void sr_adj_apply(const struct sr_adj*, uint8_t*);
+int  sr_adj_used(struct sr_instance*, uint32_t);
+
+#endif /* -- SR_ADJ_H -- */
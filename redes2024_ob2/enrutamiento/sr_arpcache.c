@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <netinet/in.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -7,95 +8,87 @@
 #include <sched.h>
 #include <string.h>
 #include "sr_arpcache.h"
+#include "sr_pool.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
 #include "sr_utils.h"
+#include "sr_adj.h"
 
-/* Envía una solicitud ARP */
-void sr_arp_request_send(struct sr_instance *sr, uint32_t ip) {
+/* Arma una solicitud ARP por ip y la envía por iface a dst: broadcast al
+   resolver, la MAC conocida al refrescar una entrada */
+static void sr_arp_request_send_to(struct sr_instance *sr, uint32_t ip,
+                                   struct sr_if *iface, const uint8_t *dst) {
 
-  /* printf("$$$ -> Send ARP request.\n"); */
-
-  /* Obtengo memoria para el paquete */
   int arpPacketLen = sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t);
-  uint8_t *arpPacket = malloc(arpPacketLen);
 
-  /* Construyo el cabezal Ethernet y agrego dirección de destino (broadcast)*/
+  /* El paquete se arma directamente en el frame que se envía */
+  uint8_t *arpPacket = sr_frame_alloc(arpPacketLen);
+
+  /* Construyo el cabezal Ethernet */
   sr_ethernet_hdr_t *ethHdr = (struct sr_ethernet_hdr *) arpPacket;
-  memcpy(ethHdr->ether_dhost, generate_ethernet_addr(255), ETHER_ADDR_LEN);
-
-  /* Envío la solicitud ARP desde cada interfaz */
-  struct sr_if *currIf = sr->if_list;
-  uint8_t *copyPacket;
-  while (currIf != NULL) {
-      /* printf("$$$$ -> Send ARP request from interface %s.\n", currIf->name); */
-
-      /* Agrero la dirección de origen y el tipo de paquete */
-      memcpy(ethHdr->ether_shost, (uint8_t *) currIf->addr, sizeof(uint8_t) * ETHER_ADDR_LEN);
-      ethHdr->ether_type = htons(ethertype_arp);
-
-      /* Construyo el cabezal ARP */
-      sr_arp_hdr_t *arpHdr = (sr_arp_hdr_t *) (arpPacket + sizeof(sr_ethernet_hdr_t));
-      arpHdr->ar_hrd = htons(1);
-      arpHdr->ar_pro = htons(2048);
-      arpHdr->ar_hln = 6;
-      arpHdr->ar_pln = 4;
-      arpHdr->ar_op = htons(arp_op_request);
-      memcpy(arpHdr->ar_sha, currIf->addr, ETHER_ADDR_LEN);
-      memcpy(arpHdr->ar_tha, (char *) generate_ethernet_addr(0), ETHER_ADDR_LEN);
-      arpHdr->ar_sip = currIf->ip;
-      arpHdr->ar_tip = ip;
-
-      copyPacket = malloc(arpPacketLen);
-      memcpy(copyPacket, ethHdr, arpPacketLen);
-
-     /*  print_hdrs(copyPacket, arpPacketLen); */
-      sr_send_packet(sr, copyPacket, arpPacketLen, currIf->name);
-
-      currIf = currIf->next;
-  }
-  /* printf("$$$ -> Send ARP request processing complete.\n"); */
+  memcpy(ethHdr->ether_dhost, dst, ETHER_ADDR_LEN);
+  memcpy(ethHdr->ether_shost, (uint8_t *) iface->addr, sizeof(uint8_t) * ETHER_ADDR_LEN);
+  ethHdr->ether_type = htons(ethertype_arp);
+
+  /* Construyo el cabezal ARP */
+  sr_arp_hdr_t *arpHdr = (sr_arp_hdr_t *) (arpPacket + sizeof(sr_ethernet_hdr_t));
+  arpHdr->ar_hrd = htons(1);
+  arpHdr->ar_pro = htons(2048);
+  arpHdr->ar_hln = 6;
+  arpHdr->ar_pln = 4;
+  arpHdr->ar_op = htons(arp_op_request);
+  memcpy(arpHdr->ar_sha, iface->addr, ETHER_ADDR_LEN);
+  memset(arpHdr->ar_tha, 0, ETHER_ADDR_LEN);
+  arpHdr->ar_sip = iface->ip;
+  arpHdr->ar_tip = ip;
+
+  /*  print_hdrs(arpPacket, arpPacketLen); */
+  __atomic_fetch_add(&(iface->arp_tx_requests), 1, __ATOMIC_RELAXED);
+  sr_send_frame(sr, arpPacket, arpPacketLen, iface);
 }
 
-/* 
-  This function gets called every second. For each request sent out, we keep
-  checking whether we should resend an request or destroy the arp request.
-  See the comments in the header file for an idea of what it should look like.
-*/
-void sr_arpcache_sweepreqs(struct sr_instance *sr) { 
-   struct sr_arpreq *currReq = sr->cache.requests;
-   struct sr_arpreq *nextReq;
-
-   while (currReq != NULL)
-   {
-       nextReq = currReq->next;
-       handle_arpreq(sr, currReq);
-       currReq = nextReq;
-   }
+/* Envía una solicitud ARP por la interfaz de salida del pedido; sólo un
+   vecino de esa red puede contestarla */
+void sr_arp_request_send(struct sr_instance *sr, uint32_t ip, unsigned int ifindex) {
+
+  static const uint8_t broadcast[ETHER_ADDR_LEN] = { 255, 255, 255, 255, 255, 255 };
+  struct sr_if *iface = sr_get_interface_by_index(sr, ifindex);
+
+  if (iface != NULL)
+      sr_arp_request_send_to(sr, ip, iface, broadcast);
+}
+
+/* Pregunta de nuevo por una entrada a punto de vencer, directo a su MAC y
+   por la interfaz conectada a su red */
+static void sr_arp_refresh_send(struct sr_instance *sr, struct sr_arpentry *entry) {
+
+  struct sr_if *iface;
+
+  for (iface = sr->if_list; iface != NULL; iface = iface->next) {
+      if (((entry->ip ^ iface->ip) & iface->mask) == 0) {
+          sr_arp_request_send_to(sr, entry->ip, iface, entry->mac);
+          return;
+      }
+  }
 }
 
 /*
-  Handle ARP request if necessary.
+  Sends the first ARP request for req. The request's own timer takes care
+  of the retries; see sr_arpreq_retry.
 */
 void handle_arpreq(struct sr_instance *sr, struct sr_arpreq *req)
 {
-    time_t now = time(NULL);
+    pthread_mutex_lock(&(sr->cache.lock));
 
-    if (difftime(time(0), req->sent) > 1.0)
+    if (req->times_sent == 0)
     {
-        if (req->times_sent >= 5)
-        {
-            host_unreachable(sr, req);
-            sr_arpreq_destroy(&(sr->cache), req);
-        }
-        else
-        {
-            sr_arp_request_send(sr, req->ip);
-            req->sent = now;
-            req->times_sent++;
-        }
+        sr_arp_request_send(sr, req->ip, req->ifindex);
+        req->sent = time(NULL);
+        req->times_sent = 1;
     }
+
+    pthread_mutex_unlock(&(sr->cache.lock));
 }
 
 void host_unreachable(struct sr_instance *sr, struct sr_arpreq *req) {
@@ -113,35 +106,273 @@ void host_unreachable(struct sr_instance *sr, struct sr_arpreq *req) {
 
 /* You should not need to touch the rest of this code. */
 
-/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
+/* Timer of one ARP entry or request. Entries are found again by ip since
+   deletions move them around the table; requests by their retry field,
+   which points at timer and so at the whole record. */
+struct sr_arptimer {
+    struct sr_timer timer;
+    uint32_t ip;
+};
+
+static struct sr_arptimer *sr_arptimer_new(sr_timer_fn fn, uint32_t ip) {
+    struct sr_arptimer *w = (struct sr_arptimer *) sr_pool_alloc(&sr_small_pool);
+
+    sr_timer_init(&(w->timer), fn, w);
+    w->ip = ip;
+
+    return w;
+}
+
+/* Home slot of ip (Fibonacci hashing). */
+static unsigned int sr_arpcache_slot(struct sr_arpcache *cache, uint32_t ip) {
+    return (unsigned int) ((ip * 2654435769U) >> cache->shift);
+}
+
+/* Writers hold the lock and bracket every change to entries with these,
+   leaving seq odd while the table is inconsistent. */
+static void sr_arpcache_write_begin(struct sr_arpcache *cache) {
+    __atomic_store_n(&(cache->seq), cache->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void sr_arpcache_write_end(struct sr_arpcache *cache) {
+    __atomic_store_n(&(cache->seq), cache->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Readers take a snapshot of seq, read the table without the lock and
+   start over if a writer got in meanwhile. */
+static unsigned int sr_arpcache_read_begin(struct sr_arpcache *cache) {
+    unsigned int seq;
+
+    while ((seq = __atomic_load_n(&(cache->seq), __ATOMIC_ACQUIRE)) & 1)
+        sched_yield();
+
+    return seq;
+}
+
+static int sr_arpcache_read_retry(struct sr_arpcache *cache, unsigned int seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&(cache->seq), __ATOMIC_RELAXED) != seq;
+}
+
+/* Slot holding ip, or the empty slot where it would go. Caller holds
+   the lock. */
+static unsigned int sr_arpcache_find(struct sr_arpcache *cache, uint32_t ip) {
+    unsigned int mask = cache->size - 1;
+    unsigned int i = sr_arpcache_slot(cache, ip);
+
+    while (cache->entries[i].valid && (cache->entries[i].ip != ip)) {
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+/* Empties slot i and shifts back the entries of its probe run so that no
+   lookup ever stops early. Caller holds the lock inside a write section. */
+static void sr_arpcache_remove_slot(struct sr_arpcache *cache, unsigned int i) {
+    unsigned int mask = cache->size - 1;
+    unsigned int j = i, home;
+
+    cache->entries[i].valid = 0;
+    cache->count--;
+
+    while (1) {
+        j = (j + 1) & mask;
+        if (!cache->entries[j].valid)
+            break;
+
+        /* Entry j may fill the hole only if its home slot is not in (i, j] */
+        home = sr_arpcache_slot(cache, cache->entries[j].ip);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            memcpy(&(cache->entries[i]), &(cache->entries[j]), sizeof(struct sr_arpentry));
+            cache->entries[j].valid = 0;
+            i = j;
+        }
+    }
+}
+
+/* Timer callback of an entry. It first fires SR_ARPCACHE_REFRESH seconds
+   before the entry is SR_ARPCACHE_TO old; if the entry was used by then it
+   is polled every SR_ARPREQ_INTERVAL until a reply renews it or it grows
+   old enough to be removed. An entry renewed meanwhile just gets its timer
+   pushed back. */
+static void sr_arpentry_expire(struct sr_instance *sr, void *arg) {
+    struct sr_arptimer *w = (struct sr_arptimer *) arg;
+    struct sr_arpcache *cache = &(sr->cache);
+    struct sr_arpentry *entry;
+    unsigned long delay;
+    double age;
+
     pthread_mutex_lock(&(cache->lock));
-    
-    struct sr_arpentry *entry = NULL, *copy = NULL;
-    
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if ((cache->entries[i].valid) && (cache->entries[i].ip == ip)) {
-            entry = &(cache->entries[i]);
+
+    unsigned int i = sr_arpcache_find(cache, w->ip);
+    entry = &(cache->entries[i]);
+    if (entry->valid) {
+        age = difftime(time(NULL), entry->added);
+        if (age < SR_ARPCACHE_TO - SR_ARPCACHE_REFRESH) {
+            sr_timer_mod(cache->timers, &(w->timer),
+                         (unsigned long) ((SR_ARPCACHE_TO - SR_ARPCACHE_REFRESH - age) * 1000));
+            pthread_mutex_unlock(&(cache->lock));
+            return;
+        }
+
+        if (age < SR_ARPCACHE_TO) {
+            /* Both calls run, so the adjacency hint is cleared too */
+            int used = __atomic_exchange_n(&(entry->used), 0, __ATOMIC_RELAXED);
+            if (sr_adj_used(sr, w->ip) || used) {
+                sr_arp_refresh_send(sr, entry);
+                cache->refreshes++;
+            }
+
+            delay = (unsigned long) ((SR_ARPCACHE_TO - age) * 1000);
+            if (delay > SR_ARPREQ_INTERVAL)
+                delay = SR_ARPREQ_INTERVAL;
+            sr_timer_mod(cache->timers, &(w->timer), delay);
+            pthread_mutex_unlock(&(cache->lock));
+            return;
         }
+
+        sr_arpcache_write_begin(cache);
+        sr_arpcache_remove_slot(cache, i);
+        sr_arpcache_write_end(cache);
+        cache->expired++;
+        __atomic_add_fetch(&(cache->gen), 1, __ATOMIC_SEQ_CST);
     }
-    
-    /* Must return a copy b/c another thread could jump in and modify
-       table after we return. */
-    if (entry) {
-        copy = (struct sr_arpentry *) malloc(sizeof(struct sr_arpentry));
-        memcpy(copy, entry, sizeof(struct sr_arpentry));
+
+    pthread_mutex_unlock(&(cache->lock));
+    sr_pool_free(&sr_small_pool, w);
+}
+
+/* Timer callback of a request, due every SR_ARPREQ_INTERVAL ms. Resends
+   the request, or gives up on it after SR_ARPREQ_TRIES sends. Once the
+   request is gone (answered or given up) the timer is freed. */
+static void sr_arpreq_retry(struct sr_instance *sr, void *arg) {
+    struct sr_arptimer *w = (struct sr_arptimer *) arg;
+    struct sr_arpcache *cache = &(sr->cache);
+    struct sr_arpreq *req;
+
+    pthread_mutex_lock(&(cache->lock));
+
+    for (req = cache->requests; req != NULL; req = req->next) {
+        if (req->retry == &(w->timer))
+            break;
     }
-        
+
+    if (req && (req->times_sent < SR_ARPREQ_TRIES)) {
+        sr_arp_request_send(sr, req->ip, req->ifindex);
+        req->sent = time(NULL);
+        req->times_sent++;
+        sr_timer_mod(cache->timers, &(w->timer), SR_ARPREQ_INTERVAL);
+        pthread_mutex_unlock(&(cache->lock));
+        return;
+    }
+
+    if (req) {
+        host_unreachable(sr, req);
+        sr_arpreq_destroy(cache, req);
+    }
+
     pthread_mutex_unlock(&(cache->lock));
-    
-    return copy;
+    sr_pool_free(&sr_small_pool, w);
+}
+
+/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
+   On a hit the mapping is copied into *entry and 1 is returned.
+
+   Lookups never take the lock: they probe the table optimistically and
+   retry if an insert or an expiry ran concurrently. The probe is bounded
+   by the table size since a torn read may show a run with no empty slot. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip,
+                       struct sr_arpentry *entry) {
+    struct sr_arpentry copy;
+    unsigned int mask = cache->size - 1;
+    unsigned int seq, i, n;
+    int found;
+
+    do {
+        seq = sr_arpcache_read_begin(cache);
+        found = 0;
+
+        i = sr_arpcache_slot(cache, ip);
+        for (n = 0; n < cache->size; n++) {
+            if (!cache->entries[i].valid)
+                break;
+            if (cache->entries[i].ip == ip) {
+                memcpy(&copy, &(cache->entries[i]), sizeof(struct sr_arpentry));
+                found = 1;
+                break;
+            }
+            i = (i + 1) & mask;
+        }
+    } while (sr_arpcache_read_retry(cache, seq));
+
+    /* Copy out b/c another thread could jump in and modify the table
+       after we return. */
+    if (found) {
+        memcpy(entry, &copy, sizeof(struct sr_arpentry));
+        __atomic_fetch_add(&(cache->hits), 1, __ATOMIC_RELAXED);
+
+        /* A hint for the refresh: a writer may have moved the entry
+           away from slot i since, at worst marking another one */
+        if (!copy.used)
+            __atomic_store_n(&(cache->entries[i].used), 1, __ATOMIC_RELAXED);
+    }
+
+    return found;
+}
+
+/* Takes pkt off the list of every waiting packet. Lock held. */
+static void sr_arpq_unlink(struct sr_arpcache *cache, struct sr_packet *pkt) {
+    if (pkt->older)
+        pkt->older->newer = pkt->newer;
+    else
+        cache->oldest = pkt->newer;
+    if (pkt->newer)
+        pkt->newer->older = pkt->older;
+    else
+        cache->newest = pkt->older;
+    pkt->older = pkt->newer = NULL;
+    cache->queued_bytes -= pkt->len;
+}
+
+/* Drops the oldest packet waiting on req. Lock held. */
+static void sr_arpq_drop_head(struct sr_arpcache *cache, struct sr_arpreq *req) {
+    struct sr_packet *pkt = req->packets;
+
+    req->packets = pkt->next;
+    if (req->tail == pkt)
+        req->tail = NULL;
+    req->npackets--;
+    req->nbytes -= pkt->len;
+    sr_arpq_unlink(cache, pkt);
+    cache->dropped++;
+
+    sr_frame_free(pkt->buf);
+    sr_pool_free(&sr_small_pool, pkt);
+}
+
+/* Takes the packets of a request leaving the queue off the global list,
+   so the budget never drops from a request being answered. Lock held. */
+static void sr_arpq_release(struct sr_arpcache *cache, struct sr_arpreq *req) {
+    struct sr_packet *pkt;
+
+    for (pkt = req->packets; pkt != NULL; pkt = pkt->next)
+        sr_arpq_unlink(cache, pkt);
+}
+
+/* Whether len more bytes fit on req and on the global budget. */
+static int sr_arpq_fits(struct sr_arpcache *cache, struct sr_arpreq *req,
+                        unsigned int len) {
+    return (req->npackets < SR_ARPQ_REQ_PKTS) &&
+           (req->nbytes + len <= SR_ARPQ_REQ_BYTES) &&
+           (cache->queued_bytes + len <= SR_ARPQ_BUDGET);
 }
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
-   the queue, adds the packet to the linked list of packets for this sr_arpreq
-   that corresponds to this ARP request. You should free the passed *packet.
+   the queue, appends the packet to the linked list of packets for this
+   sr_arpreq that corresponds to this ARP request. The passed *packet is
+   copied and stays with the caller.
    
    A pointer to the ARP request is returned; it should not be freed. The caller
    can remove the ARP request from the queue by calling sr_arpreq_destroy. */
@@ -149,7 +380,7 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                                        uint32_t ip,
                                        uint8_t *packet,           /* borrowed */
                                        unsigned int packet_len,
-                                       char *iface)
+                                       unsigned int ifindex)
 {
     pthread_mutex_lock(&(cache->lock));
     
@@ -162,23 +393,60 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
     
     /* If the IP wasn't found, add it */
     if (!req) {
-        req = (struct sr_arpreq *) calloc(1, sizeof(struct sr_arpreq));
+        req = (struct sr_arpreq *) sr_pool_alloc(&sr_small_pool);
+        memset(req, 0, sizeof(struct sr_arpreq));
         req->ip = ip;
+        req->ifindex = ifindex;
         req->next = cache->requests;
         cache->requests = req;
+
+        struct sr_arptimer *w = sr_arptimer_new(sr_arpreq_retry, ip);
+        req->retry = &(w->timer);
+        sr_timer_mod(cache->timers, req->retry, SR_ARPREQ_INTERVAL);
     }
     
-    /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
-        struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
-        
-        new_pkt->buf = (uint8_t *)malloc(packet_len);
-        memcpy(new_pkt->buf, packet, packet_len);
-        new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
-        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
-        new_pkt->next = req->packets;
-        req->packets = new_pkt;
+    /* Make room by the queue policy, then append the packet to the list of
+       packets for this request */
+    if (packet && packet_len) {
+        if (cache->queue_policy == SR_ARPQ_DROP_OLDEST) {
+            while (req->packets && ((req->npackets >= SR_ARPQ_REQ_PKTS) ||
+                                    (req->nbytes + packet_len > SR_ARPQ_REQ_BYTES)))
+                sr_arpq_drop_head(cache, req);
+            while (cache->oldest && (cache->queued_bytes + packet_len > SR_ARPQ_BUDGET))
+                sr_arpq_drop_head(cache, cache->oldest->req);
+        }
+
+        if (sr_arpq_fits(cache, req, packet_len)) {
+            struct sr_packet *new_pkt = (struct sr_packet *) sr_pool_alloc(&sr_small_pool);
+
+            new_pkt->buf = sr_frame_alloc(packet_len);
+            memcpy(new_pkt->buf, packet, packet_len);
+            new_pkt->len = packet_len;
+            new_pkt->ifindex = ifindex;
+            new_pkt->next = NULL;
+            new_pkt->req = req;
+
+            if (req->tail)
+                req->tail->next = new_pkt;
+            else
+                req->packets = new_pkt;
+            req->tail = new_pkt;
+            req->npackets++;
+            req->nbytes += packet_len;
+
+            new_pkt->older = cache->newest;
+            new_pkt->newer = NULL;
+            if (cache->newest)
+                cache->newest->newer = new_pkt;
+            else
+                cache->oldest = new_pkt;
+            cache->newest = new_pkt;
+            cache->queued_bytes += packet_len;
+            cache->queued++;
+        }
+        else {
+            cache->dropped++;
+        }
     }
     
     pthread_mutex_unlock(&(cache->lock));
@@ -207,23 +475,41 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                 next = req->next;
                 cache->requests = next;
             }
+            sr_arpq_release(cache, req);
             
             break;
         }
         prev = req;
     }
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if (!(cache->entries[i].valid))
-            break;
-    }
-    
-    if (i != SR_ARPCACHE_SZ) {
+    unsigned int i = sr_arpcache_find(cache, ip);
+
+    if (cache->entries[i].valid || (cache->count < cache->capacity)) {
+        int changed = !cache->entries[i].valid ||
+                      memcmp(cache->entries[i].mac, mac, 6);
+
+        int added = !cache->entries[i].valid;
+
+        sr_arpcache_write_begin(cache);
+        if (added)
+            cache->count++;
         memcpy(cache->entries[i].mac, mac, 6);
         cache->entries[i].ip = ip;
         cache->entries[i].added = time(NULL);
         cache->entries[i].valid = 1;
+        cache->entries[i].used = 0;
+        sr_arpcache_write_end(cache);
+
+        /* A new entry arms its expiry; a refreshed one keeps its timer */
+        if (added) {
+            struct sr_arptimer *w = sr_arptimer_new(sr_arpentry_expire, ip);
+            sr_timer_mod(cache->timers, &(w->timer),
+                         (unsigned long) ((SR_ARPCACHE_TO - SR_ARPCACHE_REFRESH) * 1000));
+        }
+
+        /* Cached adjacencies built on the old mapping are now stale */
+        if (changed)
+            __atomic_add_fetch(&(cache->gen), 1, __ATOMIC_SEQ_CST);
     }
     
     pthread_mutex_unlock(&(cache->lock));
@@ -231,6 +517,30 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
     return req;
 }
 
+/* Updates a known mapping or answers a pending request, never learning
+   a new IP otherwise. The lock is recursive, so insert can take it again
+   and the check and the insert are one step. */
+struct sr_arpreq *sr_arpcache_glean(struct sr_arpcache *cache,
+                                    unsigned char *mac,
+                                    uint32_t ip)
+{
+    struct sr_arpreq *req = NULL;
+
+    pthread_mutex_lock(&(cache->lock));
+
+    for (req = cache->requests; req != NULL; req = req->next) {
+        if (req->ip == ip)
+            break;
+    }
+
+    if (req || cache->entries[sr_arpcache_find(cache, ip)].valid)
+        req = sr_arpcache_insert(cache, mac, ip);
+
+    pthread_mutex_unlock(&(cache->lock));
+
+    return req;
+}
+
 /* Frees all memory associated with this arp request entry. If this arp request
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
@@ -248,24 +558,27 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
                     next = req->next;
                     cache->requests = next;
                 }
+                sr_arpq_release(cache, req);
                 
                 break;
             }
             prev = req;
         }
+
+        /* A timer still armed can go now; one already due frees itself */
+        if (entry->retry && sr_timer_del(cache->timers, entry->retry))
+            sr_pool_free(&sr_small_pool, entry->retry);
         
         struct sr_packet *pkt, *nxt;
         
         for (pkt = entry->packets; pkt; pkt = nxt) {
             nxt = pkt->next;
             if (pkt->buf)
-                free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
-            free(pkt);
+                sr_frame_free(pkt->buf);
+            sr_pool_free(&sr_small_pool, pkt);
         }
         
-        free(entry);
+        sr_pool_free(&sr_small_pool, entry);
     }
     
     pthread_mutex_unlock(&(cache->lock));
@@ -276,24 +589,70 @@ void sr_arpcache_dump(struct sr_arpcache *cache) {
     fprintf(stderr, "\nMAC            IP         ADDED                      VALID\n");
     fprintf(stderr, "-----------------------------------------------------------\n");
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+    unsigned int i;
+    for (i = 0; i < cache->size; i++) {
         struct sr_arpentry *cur = &(cache->entries[i]);
         unsigned char *mac = cur->mac;
+        if (!cur->valid)
+            continue;
         fprintf(stderr, "%.1x%.1x%.1x%.1x%.1x%.1x   %.8x   %.24s   %d\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], ntohl(cur->ip), ctime(&(cur->added)), cur->valid);
     }
     
     fprintf(stderr, "\n");
 }
 
+/* Prints the counters of the packets waiting on requests and of the
+   entries. */
+void sr_arpcache_print_stats(struct sr_arpcache *cache) {
+    pthread_mutex_lock(&(cache->lock));
+    fprintf(stderr, "ARP queue: %lu packets queued, %lu dropped, %lu bytes waiting now\n",
+            cache->queued, cache->dropped, cache->queued_bytes);
+    fprintf(stderr, "ARP cache: %lu hits, %lu refreshes, %lu expired\n",
+            __atomic_load_n(&(cache->hits), __ATOMIC_RELAXED),
+            cache->refreshes, cache->expired);
+    pthread_mutex_unlock(&(cache->lock));
+}
+
 /* Initialize table + table lock. Returns 0 on success. */
-int sr_arpcache_init(struct sr_arpcache *cache) {  
+int sr_arpcache_init(struct sr_arpcache *cache, unsigned int capacity,
+                     int queue_policy, struct sr_timer_wheel *timers) {
+    assert(sizeof(struct sr_arpreq) <= SR_POOL_SMALL_SZ);
+    assert(sizeof(struct sr_packet) <= SR_POOL_SMALL_SZ);
+
     /* Seed RNG to kick out a random entry if all entries full. */
     srand(time(NULL));
-    
+
+    /* Smallest power of two keeping the table at most 3/4 full */
+    if (capacity == 0)
+        capacity = SR_ARPCACHE_SZ;
+    if (capacity > SR_ARPCACHE_MAX)
+        capacity = SR_ARPCACHE_MAX;
+    cache->capacity = capacity;
+    cache->size = 4;
+    cache->shift = 30;
+    while (cache->size - cache->size / 4 < capacity) {
+        cache->size <<= 1;
+        cache->shift--;
+    }
+
     /* Invalidate all entries */
-    memset(cache->entries, 0, sizeof(cache->entries));
+    cache->entries = (struct sr_arpentry *) calloc(cache->size, sizeof(struct sr_arpentry));
+    if (!cache->entries)
+        return -1;
+    cache->count = 0;
+    cache->seq = 0;
+    cache->gen = 0;
     cache->requests = NULL;
+    cache->timers = timers;
+    cache->oldest = NULL;
+    cache->newest = NULL;
+    cache->queued_bytes = 0;
+    cache->queue_policy = queue_policy;
+    cache->queued = 0;
+    cache->dropped = 0;
+    cache->hits = 0;
+    cache->refreshes = 0;
+    cache->expired = 0;
     
     /* Acquire mutex lock */
     pthread_mutexattr_init(&(cache->attr));
@@ -305,34 +664,7 @@ int sr_arpcache_init(struct sr_arpcache *cache) {
 
 /* Destroys table + table lock. Returns 0 on success. */
 int sr_arpcache_destroy(struct sr_arpcache *cache) {
+    free(cache->entries);
+    cache->entries = NULL;
     return pthread_mutex_destroy(&(cache->lock)) && pthread_mutexattr_destroy(&(cache->attr));
 }
-
-/* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
-void *sr_arpcache_timeout(void *sr_ptr) {
-    struct sr_instance *sr = sr_ptr;
-    struct sr_arpcache *cache = &(sr->cache);
-    
-    while (1) {
-        sleep(1.0);
-        
-        pthread_mutex_lock(&(cache->lock));
-    
-        time_t curtime = time(NULL);
-        
-        int i;    
-        for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
-                cache->entries[i].valid = 0;
-            }
-        }
-        
-        sr_arpcache_sweepreqs(sr);
-
-        pthread_mutex_unlock(&(cache->lock));
-    }
-    
-    return NULL;
-}
-
@@ -9,11 +9,10 @@
    --
 
    # When sending packet to next_hop_ip
-   entry = arpcache_lookup(next_hop_ip)
+   found = arpcache_lookup(next_hop_ip, &entry)
 
-   if entry:
+   if found:
        use next_hop_ip->mac mapping in entry to send the packet
-       free entry
    else:
        req = arpcache_queuereq(next_hop_ip, packet, len)
        handle_arpreq(req)
@@ -21,6 +20,11 @@
    --
 
 
+   Retries are timer driven: each request arms its own timer on the router's
+   timer wheel and resends every SR_ARPREQ_INTERVAL ms until it gets an
+   answer or has been sent SR_ARPREQ_TRIES times. Each entry likewise arms
+   its own expiry for SR_ARPCACHE_TO seconds after it was added.
+
    The ARP reply processing code should move entries from the ARP request
    queue to the ARP cache:
 
@@ -40,15 +44,41 @@
 #include <time.h>
 #include <pthread.h>
 #include "sr_if.h"
+#include "sr_timer.h"
 
-#define SR_ARPCACHE_SZ    100  
+#define SR_ARPCACHE_SZ    100   /* default number of entries */
+#define SR_ARPCACHE_MAX   (1 << 20) /* most entries -a may ask for */
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPCACHE_REFRESH 3.0 /* s before expiry an entry in use is polled */
+#define SR_ARPREQ_INTERVAL 1000 /* ms between two sends of a request */
+#define SR_ARPREQ_TRIES   5     /* sends before giving up */
+
+/* Packets waiting on requests are bounded per request and as a whole.
+   When a new packet does not fit, the policy picks who goes: the oldest
+   waiting packets (of the request, or of any request for the global
+   budget) or the new packet itself. */
+#define SR_ARPQ_REQ_PKTS  32            /* packets waiting on one request */
+#define SR_ARPQ_REQ_BYTES (64 * 1024)   /* bytes waiting on one request */
+#define SR_ARPQ_BUDGET    (1024 * 1024) /* bytes waiting on all requests */
+#define SR_ARPQ_DROP_OLDEST 0
+#define SR_ARPQ_DROP_NEWEST 1
+
+/* What ARP packets not addressed to the router may teach the cache. The
+   sender must be on the subnet of the interface they came in on. */
+#define SR_ARP_GLEAN_OFF    0   /* nothing */
+#define SR_ARP_GLEAN_UPDATE 1   /* known or awaited mappings only */
+#define SR_ARP_GLEAN_ALL    2   /* any mapping */
+
+struct sr_arpreq;
 
 struct sr_packet {
     uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
     unsigned int len;           /* Length of raw Ethernet frame */
-    char *iface;                /* The outgoing interface */
-    struct sr_packet *next;
+    unsigned int ifindex;       /* The outgoing interface */
+    struct sr_packet *next;     /* Next packet of the same request, in arrival order */
+    struct sr_arpreq *req;      /* Request it waits on */
+    struct sr_packet *older;    /* Neighbours in the queue of every waiting packet */
+    struct sr_packet *newer;
 };
 
 struct sr_arpentry {
@@ -56,38 +86,83 @@ struct sr_arpentry {
     uint32_t ip;                /* IP addr in network byte order */
     time_t added;         
     int valid;
+    int used;                   /* Looked up since added or last polled */
 };
 
 struct sr_arpreq {
     uint32_t ip;
+    unsigned int ifindex;       /* Egress interface, the only one the request
+                                   goes out of */
+    uint32_t times_sent;        /* Number of times this request was sent. You 
+                                   should update this. */
     time_t sent;                /* Last time this ARP request was sent. You 
                                    should update this. If the ARP request was 
                                    never sent, will be 0. */
-    uint32_t times_sent;        /* Number of times this request was sent. You 
-                                   should update this. */
-    struct sr_packet *packets;  /* List of pkts waiting on this req to finish */
+    struct sr_packet *packets;  /* List of pkts waiting on this req to finish,
+                                   oldest first */
+    struct sr_packet *tail;     /* Newest packet, where the next one goes */
+    unsigned int npackets;      /* Packets on the list */
+    unsigned int nbytes;        /* Bytes on the list */
+    struct sr_timer *retry;     /* Timer resending this request */
     struct sr_arpreq *next;
 };
 
+/* Entries live in an open-addressed table indexed by a hash of the IP,
+   with linear probing and backward-shift deletion (no tombstones). The
+   table is kept at most 3/4 full.
+
+   The lock serializes writers and guards the request queue. Lookups do
+   not take it; they are validated against seq instead, which is odd
+   while a writer is changing entries.
+
+   An entry still in use when it gets within SR_ARPCACHE_REFRESH of
+   SR_ARPCACHE_TO is polled with unicast requests and keeps serving its
+   MAC meanwhile; a reply renews it in place without invalidating the
+   adjacencies built on it. Only an entry left unanswered expires.
+
+   Every packet waiting on a queued request is also on one list from
+   oldest to newest, so the global budget can drop the oldest packet of
+   all in O(1): it is always the head of its own request's list. A
+   request leaves that accounting as soon as it leaves the queue. */
 struct sr_arpcache {
-    struct sr_arpentry entries[SR_ARPCACHE_SZ];
+    struct sr_arpentry *entries;
+    unsigned int capacity;      /* Maximum number of valid entries */
+    unsigned int size;          /* Number of slots, a power of two */
+    unsigned int shift;         /* 32 - log2(size), for the hash */
+    unsigned int count;         /* Number of valid entries */
+    unsigned int seq;           /* Bumped before and after each write */
+    unsigned long gen;          /* Bumped whenever a mapping changes or goes */
     struct sr_arpreq *requests;
+    struct sr_timer_wheel *timers; /* Where entries and requests time out */
+    struct sr_packet *oldest;   /* Packets waiting on queued requests */
+    struct sr_packet *newest;
+    unsigned long queued_bytes; /* Bytes of those packets */
+    int queue_policy;           /* SR_ARPQ_DROP_OLDEST or SR_ARPQ_DROP_NEWEST */
+    unsigned long queued;       /* Packets ever queued */
+    unsigned long dropped;      /* Packets dropped by the bounds */
+    unsigned long hits;         /* Lookups that found an entry */
+    unsigned long refreshes;    /* Unicast polls of entries about to expire */
+    unsigned long expired;      /* Entries that timed out */
     pthread_mutex_t lock;
     pthread_mutexattr_t attr;
 };
 
-void sr_arpcache_sweepreqs(struct sr_instance *sr);
 void handle_arpreq(struct sr_instance *sr, struct sr_arpreq *req);
 void host_unreachable(struct sr_instance *sr, struct sr_arpreq *req);
 
-/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order. 
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip);
+/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
+   On a hit the mapping is copied into *entry and 1 is returned, otherwise
+   0 is returned and *entry is left untouched. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip,
+                       struct sr_arpentry *entry);
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
-   the queue, adds the packet to the linked list of packets for this sr_arpreq
-   that corresponds to this ARP request. The packet argument should not be
-   freed by the caller.
+   the queue, appends the packet to the linked list of packets for this
+   sr_arpreq that corresponds to this ARP request, keeping arrival order. A
+   packet that does not fit the SR_ARPQ_* bounds makes the cache's queue
+   policy drop either older packets or this one. The packet argument is
+   copied and stays with the caller. A new request is resolved on ifindex
+   only.
 
    A pointer to the ARP request is returned; it should be freed. The caller
    can remove the ARP request from the queue by calling sr_arpreq_destroy. */
@@ -95,7 +170,7 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                          uint32_t ip,
                          uint8_t *packet,               /* borrowed */
                          unsigned int packet_len,
-                         char *iface);
+                         unsigned int ifindex);
 
 /* This method performs two functions:
    1) Looks up this IP in the request queue. If it is found, returns a pointer
@@ -105,6 +180,12 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
                                      uint32_t ip);
 
+/* Like sr_arpcache_insert, but only for an IP already in the cache or
+   awaited by a request; otherwise nothing changes and NULL is returned. */
+struct sr_arpreq *sr_arpcache_glean(struct sr_arpcache *cache,
+                                    unsigned char *mac,
+                                    uint32_t ip);
+
 /* Frees all memory associated with this arp request entry. If this arp request
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
@@ -112,13 +193,17 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache);
 
+/* Prints the counters of the packets waiting on requests. */
+void sr_arpcache_print_stats(struct sr_arpcache *cache);
+
 /* You shouldn't have to call these methods--they're already called in the
-   starter code for you. The init call is a constructor, the destroy call is
-   a destructor, and a cleanup thread times out cache entries every 15
-   seconds. */
+   starter code for you. The init call is a constructor and the destroy call
+   is a destructor. capacity is the maximum number of entries the cache
+   holds; queue_policy is what gives when a waiting packet does not fit;
+   timers is the wheel entries and requests time out on. */
 
-int   sr_arpcache_init(struct sr_arpcache *cache);
+int   sr_arpcache_init(struct sr_arpcache *cache, unsigned int capacity,
+                       int queue_policy, struct sr_timer_wheel *timers);
 int   sr_arpcache_destroy(struct sr_arpcache *cache);
-void *sr_arpcache_timeout(void *cache_ptr);
 
 #endif
@@ -0,0 +1,254 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.c
+ *
+ * Description:
+ *
+ * Capture ring, see sr_capture.h. Packets are sent from several threads,
+ * so the ring takes many producers: every slot carries a sequence number
+ * telling whether it is free for position pos (seq == pos) or holds the
+ * packet of position pos (seq == pos + 1). A producer claims a position
+ * with one compare-and-swap and publishes the slot with a release store;
+ * nothing on the packet path takes a lock or touches the file.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include "sr_capture.h"
+#include "sr_dumper.h"
+
+#define SR_CAPTURE_IDLE 1      /* ms to sleep on an empty ring */
+
+struct sr_capture_slot
+{
+    unsigned long seq;
+    struct pcap_pkthdr hdr;
+    /* -- snaplen bytes of packet follow -- */
+};
+
+static struct sr_capture_slot* sr_capture_slot_at(struct sr_capture* cap,
+                                                  unsigned long pos)
+{
+    return (struct sr_capture_slot*)
+        (cap->slots + (pos & (SR_CAPTURE_SLOTS - 1)) * cap->stride);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_next_file
+ *
+ * Close the current file, if any, and start the next one.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_capture_next_file(struct sr_capture* cap)
+{
+    char name[sizeof(cap->fname) + 16];
+
+    if ((cap->fp != 0) && (cap->fp != stdout))
+    { sr_dump_close(cap->fp); }
+
+    if (cap->file_count == 0)
+    { snprintf(name, sizeof(name), "%s", cap->fname); }
+    else
+    { snprintf(name, sizeof(name), "%s.%u", cap->fname, cap->file_count); }
+
+    cap->fp = sr_dump_open(name, 0, cap->snaplen);
+    cap->file_bytes = sizeof(struct pcap_file_header);
+    cap->file_opened = (unsigned long)time(0);
+    cap->file_count++;
+} /* -- sr_capture_next_file -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_write
+ *
+ * Write one packet, rotating the file first if it is due.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_capture_write(struct sr_capture* cap,
+                             struct sr_capture_slot* slot)
+{
+    unsigned long size = sizeof(struct pcap_sf_pkthdr) + slot->hdr.caplen;
+
+    if ((cap->fp != stdout) &&
+        (((cap->rotate_bytes != 0) &&
+          (cap->file_bytes + size > cap->rotate_bytes)) ||
+         ((cap->rotate_secs != 0) &&
+          ((unsigned long)time(0) - cap->file_opened >= cap->rotate_secs))))
+    { sr_capture_next_file(cap); }
+
+    if (cap->fp == 0)
+    { return; }
+
+    sr_dump(cap->fp, &(slot->hdr), (const unsigned char*)(slot + 1));
+    cap->file_bytes += size;
+    cap->written++;
+} /* -- sr_capture_write -- */
+
+static void* sr_capture_thread(void* arg)
+{
+    struct sr_capture* cap = (struct sr_capture*)arg;
+    struct sr_capture_slot* slot;
+    struct timespec idle;
+    unsigned long pos;
+    int stop;
+
+    idle.tv_sec = 0;
+    idle.tv_nsec = SR_CAPTURE_IDLE * 1000000L;
+
+    for (;;)
+    {
+        /* -- read stop first so nothing queued before it is left over -- */
+        stop = __atomic_load_n(&(cap->stop), __ATOMIC_ACQUIRE);
+
+        pos = cap->dequeue_pos;
+        slot = sr_capture_slot_at(cap, pos);
+        if (__atomic_load_n(&(slot->seq), __ATOMIC_ACQUIRE) == pos + 1)
+        {
+            sr_capture_write(cap, slot);
+            __atomic_store_n(&(slot->seq), pos + SR_CAPTURE_SLOTS,
+                             __ATOMIC_RELEASE);
+            cap->dequeue_pos = pos + 1;
+            continue;
+        }
+
+        if ((cap->fp != 0) && (fflush(cap->fp) != 0))
+        { perror("sr_capture: fflush"); }
+
+        if (stop)
+        { break; }
+
+        nanosleep(&idle, 0);
+    }
+
+    return 0;
+} /* -- sr_capture_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_open
+ *
+ * Open fname ("-" for stdout) and start the capture thread. Returns 0
+ * if the file cannot be opened.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_capture* sr_capture_open(const char* fname, unsigned int snaplen,
+                                   unsigned long rotate_bytes,
+                                   unsigned long rotate_secs)
+{
+    struct sr_capture* cap;
+    unsigned long i;
+
+    assert(fname);
+
+    cap = (struct sr_capture*)calloc(1, sizeof(struct sr_capture));
+    assert(cap);
+
+    strncpy(cap->fname, fname, sizeof(cap->fname) - 1);
+    cap->snaplen = snaplen;
+    cap->rotate_bytes = rotate_bytes;
+    cap->rotate_secs = rotate_secs;
+
+    sr_capture_next_file(cap);
+    if (cap->fp == 0)
+    {
+        free(cap);
+        return 0;
+    }
+
+    /* -- keep every slot aligned for its header -- */
+    cap->stride = (sizeof(struct sr_capture_slot) + snaplen + 15) & ~(size_t)15;
+    cap->slots = (uint8_t*)malloc(cap->stride * SR_CAPTURE_SLOTS);
+    assert(cap->slots);
+    for (i = 0; i < SR_CAPTURE_SLOTS; i++)
+    { sr_capture_slot_at(cap, i)->seq = i; }
+
+    if (pthread_create(&(cap->thread), 0, sr_capture_thread, cap) != 0)
+    {
+        fprintf(stderr, "Error: could not start the capture thread\n");
+        if (cap->fp != stdout)
+        { sr_dump_close(cap->fp); }
+        free(cap->slots);
+        free(cap);
+        return 0;
+    }
+
+    return cap;
+} /* -- sr_capture_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_packet
+ *
+ * Queue a copy of the first snaplen bytes of buf. Safe from any thread.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* buf,
+                       unsigned int len)
+{
+    struct sr_capture_slot* slot;
+    unsigned long pos, seq;
+    unsigned int caplen = (len < cap->snaplen) ? len : cap->snaplen;
+
+    pos = __atomic_load_n(&(cap->enqueue_pos), __ATOMIC_RELAXED);
+    for (;;)
+    {
+        slot = sr_capture_slot_at(cap, pos);
+        seq = __atomic_load_n(&(slot->seq), __ATOMIC_ACQUIRE);
+
+        if (seq == pos)
+        {
+            if (__atomic_compare_exchange_n(&(cap->enqueue_pos), &pos, pos + 1,
+                                            0, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+            { break; }
+        }
+        else if ((long)(seq - pos) < 0)
+        {
+            /* -- the slot still holds a packet from the previous lap -- */
+            __atomic_fetch_add(&(cap->dropped), 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        { pos = __atomic_load_n(&(cap->enqueue_pos), __ATOMIC_RELAXED); }
+    }
+
+    gettimeofday(&(slot->hdr.ts), 0);
+    slot->hdr.caplen = caplen;
+    slot->hdr.len = len;
+    memcpy(slot + 1, buf, caplen);
+
+    __atomic_store_n(&(slot->seq), pos + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&(cap->captured), 1, __ATOMIC_RELAXED);
+} /* -- sr_capture_packet -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_close
+ *
+ * Write out what is queued, close the file and print the counters. The
+ * ring itself is left allocated since other threads may still hold cap.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_close(struct sr_capture* cap)
+{
+    if (cap == 0)
+    { return; }
+
+    __atomic_store_n(&(cap->stop), 1, __ATOMIC_RELEASE);
+    pthread_join(cap->thread, 0);
+
+    if ((cap->fp != 0) && (cap->fp != stdout))
+    { sr_dump_close(cap->fp); }
+    cap->fp = 0;
+
+    fprintf(stderr, "Capture: %lu packets queued, %lu written to %u file(s), "
+            "%lu dropped\n",
+            __atomic_load_n(&(cap->captured), __ATOMIC_RELAXED), cap->written,
+            cap->file_count, __atomic_load_n(&(cap->dropped), __ATOMIC_RELAXED));
+} /* -- sr_capture_close -- */
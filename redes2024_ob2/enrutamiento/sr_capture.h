@@ -0,0 +1,57 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.h
+ *
+ * Description:
+ *
+ * Packet capture for the -l option. Threads that see a packet copy up to
+ * snaplen bytes of it into a bounded ring and move on; a capture thread
+ * writes the ring out in pcap format. When the ring is full the packet is
+ * counted as dropped instead of waiting for the disk.
+ *
+ * The capture file can be rotated once it reaches a size or an age; the
+ * first file is the name given, later ones get .1, .2, ... appended.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CAPTURE_H
+#define SR_CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define SR_CAPTURE_SLOTS 1024   /* ring capacity in packets, a power of two */
+
+struct sr_capture_slot;
+
+struct sr_capture
+{
+    char fname[256];
+    FILE* fp;                   /* current file, capture thread only */
+    unsigned int snaplen;
+    unsigned long rotate_bytes; /* 0 to never rotate on size */
+    unsigned long rotate_secs;  /* 0 to never rotate on age */
+    unsigned long file_bytes;   /* written to fp so far */
+    unsigned long file_opened;  /* time() fp was opened */
+    unsigned int file_count;    /* files opened so far */
+
+    uint8_t* slots;             /* SR_CAPTURE_SLOTS slots of stride bytes */
+    size_t stride;
+    unsigned long enqueue_pos;  /* shared by the producers */
+    unsigned long dequeue_pos;  /* capture thread only */
+
+    unsigned long captured;     /* packets put in the ring */
+    unsigned long dropped;      /* packets lost to a full ring */
+    unsigned long written;      /* packets written out */
+
+    int stop;
+    pthread_t thread;
+};
+
+struct sr_capture* sr_capture_open(const char* fname, unsigned int snaplen,
+                                   unsigned long rotate_bytes,
+                                   unsigned long rotate_secs);
+void sr_capture_packet(struct sr_capture*, const uint8_t*, unsigned int);
+void sr_capture_close(struct sr_capture*);
+
+#endif /* -- SR_CAPTURE_H -- */
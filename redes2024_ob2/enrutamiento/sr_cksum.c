@@ -0,0 +1,214 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.c
+ *
+ * Description:
+ *
+ * Checksum kernels, see sr_cksum.h. One's complement addition does not
+ * depend on byte order, so every kernel sums the buffer as native-order
+ * words and leaves the byte swap to the final inversion. The vector
+ * kernels split each 32-bit lane into its two 16-bit halves and add them
+ * into 32-bit accumulators, spilling to 64 bits before a lane can carry.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SR_CKSUM_X86
+#include <immintrin.h>
+#endif
+
+#include "sr_cksum.h"
+
+/* vector iterations before the 32-bit lanes are spilled; each adds at
+ * most 2 * 0xffff to a lane */
+#define SR_CKSUM_BLOCK 16384
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_scalar
+ *
+ *---------------------------------------------------------------------*/
+
+uint64_t sr_cksum_sum_scalar(const void* buf, int len)
+{
+    const uint8_t* data = (const uint8_t*)buf;
+    uint64_t sum = 0, word;
+    uint32_t word32;
+    uint16_t word16;
+    uint8_t tail[2];
+
+    for (; len >= 8; data += 8, len -= 8)
+    {
+        memcpy(&word, data, 8);
+        sum += word;
+        sum += (sum < word);
+    }
+
+    /* -- fold to 33 bits so the tail words cannot carry out -- */
+    sum = (sum >> 32) + (sum & 0xffffffff);
+
+    if (len >= 4)
+    {
+        memcpy(&word32, data, 4);
+        sum += word32;
+        data += 4;
+        len -= 4;
+    }
+    if (len >= 2)
+    {
+        memcpy(&word16, data, 2);
+        sum += word16;
+        data += 2;
+        len -= 2;
+    }
+    if (len > 0)
+    {
+        tail[0] = data[0];
+        tail[1] = 0;
+        memcpy(&word16, tail, 2);
+        sum += word16;
+    }
+
+    return sum;
+} /* -- sr_cksum_sum_scalar -- */
+
+#ifdef SR_CKSUM_X86
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_sse2
+ *
+ *---------------------------------------------------------------------*/
+
+__attribute__((target("sse2")))
+uint64_t sr_cksum_sum_sse2(const void* buf, int len)
+{
+    const uint8_t* data = (const uint8_t*)buf;
+    const __m128i mask = _mm_set1_epi32(0xffff);
+    __m128i acc, v;
+    uint32_t lanes[4];
+    uint64_t sum = 0;
+    int n;
+
+    while (len >= 16)
+    {
+        acc = _mm_setzero_si128();
+        for (n = 0; (n < SR_CKSUM_BLOCK) && (len >= 16); n++)
+        {
+            v = _mm_loadu_si128((const __m128i*)data);
+            acc = _mm_add_epi32(acc, _mm_and_si128(v, mask));
+            acc = _mm_add_epi32(acc, _mm_srli_epi32(v, 16));
+            data += 16;
+            len -= 16;
+        }
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    return sum + sr_cksum_sum_scalar(data, len);
+} /* -- sr_cksum_sum_sse2 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_avx2
+ *
+ *---------------------------------------------------------------------*/
+
+__attribute__((target("avx2")))
+uint64_t sr_cksum_sum_avx2(const void* buf, int len)
+{
+    const uint8_t* data = (const uint8_t*)buf;
+    const __m256i mask = _mm256_set1_epi32(0xffff);
+    __m256i acc, v;
+    uint32_t lanes[8];
+    uint64_t sum = 0;
+    int n, i;
+
+    while (len >= 32)
+    {
+        acc = _mm256_setzero_si256();
+        for (n = 0; (n < SR_CKSUM_BLOCK) && (len >= 32); n++)
+        {
+            v = _mm256_loadu_si256((const __m256i*)data);
+            acc = _mm256_add_epi32(acc, _mm256_and_si256(v, mask));
+            acc = _mm256_add_epi32(acc, _mm256_srli_epi32(v, 16));
+            data += 32;
+            len -= 32;
+        }
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        for (i = 0; i < 8; i++)
+        { sum += lanes[i]; }
+    }
+
+    return sum + sr_cksum_sum_scalar(data, len);
+} /* -- sr_cksum_sum_avx2 -- */
+
+#else
+
+uint64_t sr_cksum_sum_sse2(const void* buf, int len)
+{
+    return sr_cksum_sum_scalar(buf, len);
+}
+
+uint64_t sr_cksum_sum_avx2(const void* buf, int len)
+{
+    return sr_cksum_sum_scalar(buf, len);
+}
+
+#endif /* SR_CKSUM_X86 */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum
+ *
+ * The kernel is picked by the first caller. Racing first callers pick
+ * the same kernel, so the store needs no lock.
+ *
+ *---------------------------------------------------------------------*/
+
+typedef uint64_t (*sr_cksum_fn)(const void*, int);
+
+static uint64_t sr_cksum_sum_resolve(const void*, int);
+
+static sr_cksum_fn sr_cksum_kernel = sr_cksum_sum_resolve;
+
+static uint64_t sr_cksum_sum_resolve(const void* buf, int len)
+{
+    sr_cksum_fn kernel = sr_cksum_sum_scalar;
+
+#ifdef SR_CKSUM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    { kernel = sr_cksum_sum_avx2; }
+    else if (__builtin_cpu_supports("sse2"))
+    { kernel = sr_cksum_sum_sse2; }
+#endif
+
+    __atomic_store_n(&sr_cksum_kernel, kernel, __ATOMIC_RELEASE);
+
+    return kernel(buf, len);
+} /* -- sr_cksum_sum_resolve -- */
+
+uint64_t sr_cksum_sum(const void* buf, int len)
+{
+    return __atomic_load_n(&sr_cksum_kernel, __ATOMIC_ACQUIRE)(buf, len);
+} /* -- sr_cksum_sum -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_impl
+ *
+ *---------------------------------------------------------------------*/
+
+const char* sr_cksum_impl(void)
+{
+    sr_cksum_fn kernel;
+
+    sr_cksum_sum(0, 0);
+    kernel = __atomic_load_n(&sr_cksum_kernel, __ATOMIC_ACQUIRE);
+
+#ifdef SR_CKSUM_X86
+    if (kernel == sr_cksum_sum_avx2)
+    { return "avx2"; }
+    if (kernel == sr_cksum_sum_sse2)
+    { return "sse2"; }
+#endif
+
+    return "scalar";
+} /* -- sr_cksum_impl -- */
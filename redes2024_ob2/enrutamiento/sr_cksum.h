@@ -0,0 +1,28 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.h
+ *
+ * Description:
+ *
+ * Internet checksum kernels behind cksum(). On x86 the sum is taken with
+ * SSE2 or AVX2 when the CPU has them, chosen on the first call; other
+ * targets use the 64-bit scalar loop.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CKSUM_H
+#define SR_CKSUM_H
+
+#include <stdint.h>
+
+/* one's complement sum of len bytes as native-order 16-bit words, not
+ * folded; fold and invert it to get the checksum in network order */
+uint64_t sr_cksum_sum(const void*, int);
+
+uint64_t sr_cksum_sum_scalar(const void*, int);
+uint64_t sr_cksum_sum_sse2(const void*, int);
+uint64_t sr_cksum_sum_avx2(const void*, int);
+
+/* name of the kernel sr_cksum_sum dispatches to */
+const char* sr_cksum_impl(void);
+
+#endif /* -- SR_CKSUM_H -- */
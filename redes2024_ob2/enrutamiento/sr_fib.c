@@ -0,0 +1,345 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ *
+ * Description:
+ *
+ * Path-compressed binary trie used for longest prefix match. Prefixes are
+ * stored in host byte order; the public interface takes the same network
+ * byte order values found in struct sr_rt and in IP headers.
+ *
+ * A trie derived from a published one shares all of its nodes. Inserts
+ * and removes copy the nodes on the path they change, so readers of the
+ * published trie never see a node change under them; the replaced nodes
+ * are kept on the derived trie until sr_fib_reclaim.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "sr_fib.h"
+#include "sr_rt.h"
+
+#define FIB_MASK(len) ((len) == 0 ? 0 : (0xffffffffU << (32 - (len))))
+#define FIB_BIT(key, pos) (((key) >> (31 - (pos))) & 1)
+
+static struct sr_fib_node* sr_fib_new_node(struct sr_fib* fib, uint32_t prefix,
+                                           uint8_t len, struct sr_rt* route)
+{
+    struct sr_fib_node* node =
+        (struct sr_fib_node*)malloc(sizeof(struct sr_fib_node));
+    assert(node);
+
+    node->prefix = prefix & FIB_MASK(len);
+    node->len = len;
+    node->route = route;
+    node->child[0] = 0;
+    node->child[1] = 0;
+    node->version = fib->version;
+
+    return node;
+}
+
+/* Queue a node that published tries may still reach. */
+static void sr_fib_retire(struct sr_fib* fib, struct sr_fib_node* node)
+{
+    if (fib->nretired == fib->retired_max)
+    {
+        fib->retired_max = fib->retired_max ? 2 * fib->retired_max : 16;
+        fib->retired = (struct sr_fib_node**)realloc(fib->retired,
+                           fib->retired_max * sizeof(struct sr_fib_node*));
+        assert(fib->retired);
+    }
+    fib->retired[fib->nretired++] = node;
+}
+
+/* Make the node *link points at private to fib, copying it if it may be
+ * shared. link itself must already be private. */
+static struct sr_fib_node* sr_fib_own(struct sr_fib* fib,
+                                      struct sr_fib_node** link)
+{
+    struct sr_fib_node* node = *link;
+    struct sr_fib_node* copy;
+
+    if (node->version == fib->version)
+    { return node; }
+
+    copy = sr_fib_new_node(fib, node->prefix, node->len, node->route);
+    copy->child[0] = node->child[0];
+    copy->child[1] = node->child[1];
+    sr_fib_retire(fib, node);
+    *link = copy;
+
+    return copy;
+}
+
+static void sr_fib_free_subtree(struct sr_fib_node* node)
+{
+    if (node == 0)
+    { return; }
+
+    sr_fib_free_subtree(node->child[0]);
+    sr_fib_free_subtree(node->child[1]);
+    free(node);
+}
+
+/* Number of leading bits shared by a/alen and b/blen. */
+static uint8_t sr_fib_common_len(uint32_t a, uint8_t alen,
+                                 uint32_t b, uint8_t blen)
+{
+    uint32_t diff = a ^ b;
+    uint8_t common = diff ? (uint8_t)__builtin_clz(diff) : 32;
+    uint8_t limit = alen < blen ? alen : blen;
+
+    return common < limit ? common : limit;
+}
+
+static void sr_fib_route_key(struct sr_rt* route, uint32_t* key, uint8_t* len)
+{
+    uint32_t mask = ntohl(route->mask.s_addr);
+
+    *len = (uint8_t)__builtin_popcount(mask);
+    *key = ntohl(route->dest.s_addr) & FIB_MASK(*len);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_init
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_init(struct sr_fib* fib)
+{
+    assert(fib);
+
+    fib->root = 0;
+    fib->routes = 0;
+    fib->version = 0;
+    fib->retired = 0;
+    fib->nretired = 0;
+    fib->retired_max = 0;
+} /* -- sr_fib_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_derive
+ *
+ * Start fib as a new version of the published trie from, sharing its
+ * nodes. from must not be changed while fib is in use.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_derive(struct sr_fib* fib, const struct sr_fib* from)
+{
+    assert(fib);
+    assert(from);
+
+    sr_fib_init(fib);
+    fib->root = from->root;
+    fib->routes = from->routes;
+    fib->version = from->version + 1;
+} /* -- sr_fib_derive -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_reclaim
+ *
+ * Free the nodes fib replaced, once no reader can reach the trie it
+ * was derived from.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_reclaim(struct sr_fib* fib)
+{
+    unsigned int i;
+
+    assert(fib);
+
+    for (i = 0; i < fib->nretired; i++)
+    { free(fib->retired[i]); }
+    free(fib->retired);
+    fib->retired = 0;
+    fib->nretired = 0;
+    fib->retired_max = 0;
+} /* -- sr_fib_reclaim -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_clear
+ *
+ * Drop every node, retired ones included. The routes themselves belong
+ * to the sr_rt list.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_clear(struct sr_fib* fib)
+{
+    assert(fib);
+
+    sr_fib_free_subtree(fib->root);
+    sr_fib_reclaim(fib);
+    fib->root = 0;
+    fib->routes = 0;
+} /* -- sr_fib_clear -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_insert
+ *
+ * Index route by its destination prefix. If the prefix already holds a
+ * route the older one is kept, matching the first-entry-wins behaviour
+ * of the list walk. Returns 1 if route was installed, 0 otherwise.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_insert(struct sr_fib* fib, struct sr_rt* route)
+{
+    struct sr_fib_node** link;
+    struct sr_fib_node* node;
+    uint32_t key;
+    uint8_t len, common;
+
+    assert(fib);
+    assert(route);
+
+    sr_fib_route_key(route, &key, &len);
+
+    link = &fib->root;
+    while ((node = *link) != 0)
+    {
+        common = sr_fib_common_len(key, len, node->prefix, node->len);
+
+        if (common < node->len)
+        {
+            /* -- the new prefix diverges inside this node's skipped bits -- */
+            struct sr_fib_node* leaf = sr_fib_new_node(fib, key, len, route);
+
+            if (common == len)
+            {
+                leaf->child[FIB_BIT(node->prefix, len)] = node;
+                *link = leaf;
+            }
+            else
+            {
+                struct sr_fib_node* split = sr_fib_new_node(fib, key, common, 0);
+                split->child[FIB_BIT(key, common)] = leaf;
+                split->child[FIB_BIT(node->prefix, common)] = node;
+                *link = split;
+            }
+
+            fib->routes++;
+            return 1;
+        }
+
+        if (node->len == len)
+        {
+            if (node->route != 0)
+            { return 0; }
+
+            node = sr_fib_own(fib, link);
+            node->route = route;
+            fib->routes++;
+            return 1;
+        }
+
+        node = sr_fib_own(fib, link);
+        link = &node->child[FIB_BIT(key, node->len)];
+    }
+
+    *link = sr_fib_new_node(fib, key, len, route);
+    fib->routes++;
+
+    return 1;
+} /* -- sr_fib_insert -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_remove
+ *
+ * Unindex route and collapse any node left without a route and with
+ * fewer than two children.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_remove(struct sr_fib* fib, struct sr_rt* route)
+{
+    struct sr_fib_node** path[33];
+    struct sr_fib_node** link;
+    struct sr_fib_node* node;
+    int depth = 0, i;
+    uint32_t key;
+    uint8_t len;
+
+    assert(fib);
+    assert(route);
+
+    sr_fib_route_key(route, &key, &len);
+
+    link = &fib->root;
+    while ((node = *link) != 0)
+    {
+        if ((node->len > len) || ((key ^ node->prefix) & FIB_MASK(node->len)))
+        { return; }
+
+        path[depth++] = link;
+        if (node->len == len)
+        { break; }
+
+        link = &node->child[FIB_BIT(key, node->len)];
+    }
+
+    if ((node == 0) || (node->route != route))
+    { return; }
+
+    /* -- copy the path down to the route, top first -- */
+    link = &fib->root;
+    for (i = 0; i < depth; i++)
+    {
+        if (i > 0)
+        { link = &node->child[FIB_BIT(key, node->len)]; }
+        path[i] = link;
+        node = sr_fib_own(fib, link);
+    }
+
+    node->route = 0;
+    fib->routes--;
+
+    while (depth > 0)
+    {
+        link = path[--depth];
+        node = *link;
+
+        if ((node->route != 0) || (node->child[0] && node->child[1]))
+        { break; }
+
+        *link = node->child[0] ? node->child[0] : node->child[1];
+        free(node);
+    }
+} /* -- sr_fib_remove -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup
+ *
+ * Longest prefix match for ip (network byte order).
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_fib_lookup(const struct sr_fib* fib, uint32_t ip)
+{
+    const struct sr_fib_node* node;
+    struct sr_rt* best = 0;
+    uint32_t key = ntohl(ip);
+
+    assert(fib);
+
+    node = fib->root;
+    while (node != 0)
+    {
+        if ((key ^ node->prefix) & FIB_MASK(node->len))
+        { break; }
+
+        if (node->route != 0)
+        { best = node->route; }
+
+        if (node->len == 32)
+        { break; }
+
+        node = node->child[FIB_BIT(key, node->len)];
+    }
+
+    return best;
+} /* -- sr_fib_lookup -- */
@@ -0,0 +1,62 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ *
+ * Description:
+ *
+ * Forwarding information base. A path-compressed binary trie indexed by
+ * destination prefix, kept in sync with the sr_rt list so that the longest
+ * prefix match visits at most 33 nodes no matter how many routes exist.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#ifdef _DARWIN_
+#include <sys/types.h>
+#endif
+
+#include <netinet/in.h>
+
+#include "sr_if.h"
+
+struct sr_rt;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib_node
+ *
+ * Node in the trie. Nodes only exist where a route lives or where two
+ * subtrees branch, every other bit of the path is skipped. A node whose
+ * version is older than its trie's may be shared with a published trie
+ * and is copied before being changed.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib_node
+{
+    uint32_t prefix;                /* host byte order, bits past len are 0 */
+    uint8_t  len;                   /* prefix length in bits */
+    struct sr_rt* route;            /* route for exactly prefix/len, if any */
+    struct sr_fib_node* child[2];   /* indexed by the bit at position len */
+    unsigned long version;          /* version of the trie that made it */
+};
+
+struct sr_fib
+{
+    struct sr_fib_node* root;
+    unsigned int routes;            /* number of nodes holding a route */
+    unsigned long version;
+    struct sr_fib_node** retired;   /* replaced nodes still seen by readers */
+    unsigned int nretired;
+    unsigned int retired_max;
+};
+
+void sr_fib_init(struct sr_fib*);
+void sr_fib_clear(struct sr_fib*);
+void sr_fib_derive(struct sr_fib*, const struct sr_fib*);
+void sr_fib_reclaim(struct sr_fib*);
+int  sr_fib_insert(struct sr_fib*, struct sr_rt*);
+void sr_fib_remove(struct sr_fib*, struct sr_rt*);
+struct sr_rt* sr_fib_lookup(const struct sr_fib*, uint32_t);
+
+#endif /* -- SR_FIB_H -- */
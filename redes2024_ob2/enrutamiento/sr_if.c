@@ -54,6 +54,81 @@ struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
     return 0;
 } /* -- sr_get_interface -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_get_interface_by_index
+ * Scope: Global
+ *
+ * Given an ifindex return the interface record or 0 if the index was
+ * only reserved by the routing table and no such interface exists.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr, unsigned int ifindex)
+{
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(ifindex >= SR_IF_MAX)
+    { return 0; }
+
+    return sr->if_index[ifindex];
+} /* -- sr_get_interface_by_index -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_if_index
+ * Scope: Global
+ *
+ * Return the ifindex for an interface name, handing out the next free
+ * one if the name is new. Routes may name an interface before the server
+ * reports it, so the index is shared by both. Only called while loading
+ * the routing table and the hardware info, before packets flow. Returns
+ * SR_IF_MAX when the name is new and every ifindex is taken.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_if_index(struct sr_instance* sr, const char* name)
+{
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(name);
+    assert(sr);
+
+    for(i = 0; i < sr->if_count; i++)
+    {
+        if(!strncmp(sr->if_names[i],name,sr_IFACE_NAMELEN))
+        { return i; }
+    }
+
+    if(sr->if_count >= SR_IF_MAX)
+    { return SR_IF_MAX; }
+
+    strncpy(sr->if_names[i],name,sr_IFACE_NAMELEN);
+    sr->if_names[i][sr_IFACE_NAMELEN - 1] = 0;
+    sr->if_count++;
+
+    return i;
+} /* -- sr_if_index -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_if_name
+ * Scope: Global
+ *
+ * Name registered for ifindex.
+ *
+ *---------------------------------------------------------------------*/
+
+const char* sr_if_name(struct sr_instance* sr, unsigned int ifindex)
+{
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(ifindex >= sr->if_count)
+    { return "?"; }
+
+    return sr->if_names[ifindex];
+} /* -- sr_if_name -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_get_interface_given_ip
  * Scope: Global
@@ -83,6 +158,27 @@ struct sr_if* sr_get_interface_given_ip(struct sr_instance* sr, uint32_t ip)
     return 0;
 } /* -- sr_get_interface_given_ip -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_if_register(..)
+ * Scope: Local
+ *
+ * Make iface reachable through its ifindex. An interface left without
+ * one stays in the list but cannot be routed through.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_if_register(struct sr_instance* sr, struct sr_if* iface)
+{
+    if(iface->ifindex >= SR_IF_MAX)
+    {
+        fprintf(stderr,"Error: no ifindex left for interface %s\n",
+                iface->name);
+        return;
+    }
+
+    sr->if_index[iface->ifindex] = iface;
+} /* -- sr_if_register -- */
+
 /*---------------------------------------------------------------------
  * Method: sr_add_interface(..)
  * Scope: Global
@@ -108,7 +204,13 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
         sr->if_list->neighbor_id = 0;
         sr->if_list->neighbor_ip = 0;
         sr->if_list->helloint = 0;
+        sr->if_list->arp_tx_requests = 0;
+        sr->if_list->arp_tx_replies = 0;
+        sr->if_list->arp_rx_requests = 0;
+        sr->if_list->arp_rx_replies = 0;
         strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
+        sr->if_list->ifindex = sr_if_index(sr,name);
+        sr_if_register(sr, sr->if_list);
         return;
     }
 
@@ -123,8 +225,14 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     if_walker->neighbor_id = 0;
     if_walker->neighbor_ip = 0;
     strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
+    if_walker->ifindex = sr_if_index(sr,name);
+    sr_if_register(sr, if_walker);
     if_walker->next = 0;
     if_walker->helloint = 0;
+    if_walker->arp_tx_requests = 0;
+    if_walker->arp_tx_replies = 0;
+    if_walker->arp_rx_requests = 0;
+    if_walker->arp_rx_replies = 0;
 } /* -- sr_add_interface -- */ 
 
 /*--------------------------------------------------------------------- 
@@ -251,3 +359,29 @@ void sr_print_if(struct sr_if* iface)
     Debug("\n");
     Debug("\tinet addr %s\n",inet_ntoa(ip_addr));
 } /* -- sr_print_if -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_if_print_arp_stats(..)
+ * Scope: Global
+ *
+ * print the ARP requests and replies sent and received on each interface
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_if_print_arp_stats(struct sr_instance* sr)
+{
+    struct sr_if* if_walker = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    for(if_walker = sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        fprintf(stderr, "ARP %s: tx %lu requests %lu replies, rx %lu requests %lu replies\n",
+                if_walker->name,
+                __atomic_load_n(&(if_walker->arp_tx_requests), __ATOMIC_RELAXED),
+                __atomic_load_n(&(if_walker->arp_tx_replies), __ATOMIC_RELAXED),
+                __atomic_load_n(&(if_walker->arp_rx_requests), __ATOMIC_RELAXED),
+                __atomic_load_n(&(if_walker->arp_rx_replies), __ATOMIC_RELAXED));
+    }
+} /* -- sr_if_print_arp_stats -- */
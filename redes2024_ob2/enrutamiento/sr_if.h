@@ -25,6 +25,9 @@
 #endif
 
 #include "sr_protocol.h"
+#include "sr_timer.h"
+
+#define SR_IF_MAX 32    /* ifindexes available, interfaces and names alike */
 
 struct sr_instance;
 
@@ -38,6 +41,7 @@ struct sr_instance;
 struct sr_if
 {
   char name[sr_IFACE_NAMELEN];
+  unsigned int ifindex;
   unsigned char addr[ETHER_ADDR_LEN];
   uint32_t ip;
   uint32_t speed;
@@ -46,12 +50,21 @@ struct sr_if
   /**** New Fields ****/
   volatile uint32_t mask;
   uint8_t helloint;
+  struct sr_timer hello_timer;
   uint32_t neighbor_id;
   uint32_t neighbor_ip;
   /********************/  
+
+  unsigned long arp_tx_requests; /* ARP counters, updated atomically */
+  unsigned long arp_tx_replies;
+  unsigned long arp_rx_requests;
+  unsigned long arp_rx_replies;
 };
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr, unsigned int ifindex);
+unsigned int sr_if_index(struct sr_instance* sr, const char* name);
+const char* sr_if_name(struct sr_instance* sr, unsigned int ifindex);
 struct sr_if* sr_get_interface_given_ip(struct sr_instance* sr, uint32_t ip);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
@@ -59,5 +72,6 @@ void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
 void sr_set_ether_mask(struct sr_instance*, uint32_t mask_nbo);
 void sr_print_if_list(struct sr_instance*);
 void sr_print_if(struct sr_if*);
+void sr_if_print_arp_stats(struct sr_instance*);
 
 #endif /* --  sr_INTERFACE_H -- */
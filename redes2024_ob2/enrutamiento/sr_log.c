@@ -0,0 +1,308 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.c
+ *
+ * Description:
+ *
+ * Logging rings, see sr_log.h. Each ring has a single producer, the thread
+ * that owns it, and a single consumer, the drain thread, so head and tail
+ * only need acquire/release ordering. Rings of threads that have exited
+ * are drained and then handed to the next thread that logs, the list of
+ * rings never shrinks.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "sr_log.h"
+
+#define SR_LOG_RING_SZ 256     /* records per ring, a power of two */
+#define SR_LOG_MSG_SZ  240     /* longest message, longer ones are cut */
+#define SR_LOG_PERIOD  10      /* ms between drains */
+
+/* sr_log_ring states */
+#define SR_LOG_RING_FREE  0    /* drained, no owner */
+#define SR_LOG_RING_OWNED 1    /* a live thread writes to it */
+#define SR_LOG_RING_DEAD  2    /* owner exited, still to be drained */
+
+struct sr_log_rec
+{
+    unsigned int len;
+    char msg[SR_LOG_MSG_SZ];
+};
+
+struct sr_log_ring
+{
+    unsigned int state;
+    unsigned long head;         /* written by the owner */
+    unsigned long tail;         /* written by the drain thread */
+    unsigned long dropped;      /* messages lost to a full ring */
+    unsigned long reported;     /* dropped as last reported, drain only */
+    struct sr_log_ring* next;
+    struct sr_log_rec recs[SR_LOG_RING_SZ];
+};
+
+int sr_log_level = SR_LOG_DEFAULT;
+
+static struct sr_log_ring* sr_log_rings;    /* pushed at the head only */
+static pthread_mutex_t sr_log_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sr_log_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t sr_log_key;
+static pthread_once_t sr_log_once = PTHREAD_ONCE_INIT;
+static __thread struct sr_log_ring* sr_log_tring;
+
+static void sr_log_thread_exit(void* arg)
+{
+    struct sr_log_ring* ring = (struct sr_log_ring*)arg;
+
+    __atomic_store_n(&(ring->state), SR_LOG_RING_DEAD, __ATOMIC_RELEASE);
+} /* -- sr_log_thread_exit -- */
+
+static void sr_log_make_key(void)
+{
+    pthread_key_create(&sr_log_key, sr_log_thread_exit);
+} /* -- sr_log_make_key -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_ring_get
+ *
+ * Ring of the calling thread, recycling a free one when possible.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_log_ring* sr_log_ring_get(void)
+{
+    struct sr_log_ring* ring;
+    unsigned int state;
+
+    if (sr_log_tring != 0)
+    { return sr_log_tring; }
+
+    pthread_once(&sr_log_once, sr_log_make_key);
+
+    for (ring = __atomic_load_n(&sr_log_rings, __ATOMIC_ACQUIRE); ring != 0;
+         ring = ring->next)
+    {
+        state = SR_LOG_RING_FREE;
+        if (__atomic_compare_exchange_n(&(ring->state), &state,
+                                        SR_LOG_RING_OWNED, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        { break; }
+    }
+
+    if (ring == 0)
+    {
+        ring = (struct sr_log_ring*)calloc(1, sizeof(struct sr_log_ring));
+        assert(ring);
+        ring->state = SR_LOG_RING_OWNED;
+
+        pthread_mutex_lock(&sr_log_rings_lock);
+        ring->next = sr_log_rings;
+        __atomic_store_n(&sr_log_rings, ring, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&sr_log_rings_lock);
+    }
+
+    sr_log_tring = ring;
+    pthread_setspecific(sr_log_key, ring);
+
+    return ring;
+} /* -- sr_log_ring_get -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_allow
+ *
+ * Rate limit one call site. Threads racing on a site may let a few
+ * extra messages through, which is fine for a log.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_log_allow(struct sr_log_site* site, unsigned long* suppressed)
+{
+    unsigned long now = (unsigned long)time(0);
+
+    if (__atomic_load_n(&(site->second), __ATOMIC_RELAXED) != now)
+    {
+        __atomic_store_n(&(site->second), now, __ATOMIC_RELAXED);
+        __atomic_store_n(&(site->count), 0, __ATOMIC_RELAXED);
+    }
+
+    if (__atomic_fetch_add(&(site->count), 1, __ATOMIC_RELAXED) >= SR_LOG_BURST)
+    {
+        __atomic_fetch_add(&(site->suppressed), 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    *suppressed = __atomic_exchange_n(&(site->suppressed), 0, __ATOMIC_RELAXED);
+    return 1;
+} /* -- sr_log_allow -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_write
+ *
+ * Back end of the SR_LOG macros, the level is already checked.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_write(struct sr_log_site* site, const char* fmt, ...)
+{
+    struct sr_log_ring* ring;
+    struct sr_log_rec* rec;
+    unsigned long head, suppressed = 0;
+    va_list args;
+    int len = 0;
+
+    if (!sr_log_allow(site, &suppressed))
+    { return; }
+
+    ring = sr_log_ring_get();
+    head = ring->head;
+    if (head - __atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE) >= SR_LOG_RING_SZ)
+    {
+        __atomic_fetch_add(&(ring->dropped), 1 + suppressed, __ATOMIC_RELAXED);
+        return;
+    }
+
+    rec = &(ring->recs[head & (SR_LOG_RING_SZ - 1)]);
+    if (suppressed != 0)
+    {
+        len = snprintf(rec->msg, SR_LOG_MSG_SZ,
+                       "(%lu similar messages suppressed)\n", suppressed);
+    }
+
+    va_start(args, fmt);
+    len += vsnprintf(rec->msg + len, SR_LOG_MSG_SZ - len, fmt, args);
+    va_end(args);
+
+    rec->len = (len < SR_LOG_MSG_SZ) ? (unsigned int)len : SR_LOG_MSG_SZ - 1;
+
+    __atomic_store_n(&(ring->head), head + 1, __ATOMIC_RELEASE);
+} /* -- sr_log_write -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_drain
+ *
+ * Write out everything queued so far. Caller holds sr_log_drain_lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_log_drain(void)
+{
+    struct sr_log_ring* ring;
+    struct sr_log_rec* rec;
+    unsigned long head, tail, dropped;
+    unsigned int state;
+    int wrote = 0;
+
+    for (ring = __atomic_load_n(&sr_log_rings, __ATOMIC_ACQUIRE); ring != 0;
+         ring = ring->next)
+    {
+        /* -- read the state first, a dead ring's head is final after it -- */
+        state = __atomic_load_n(&(ring->state), __ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE);
+
+        for (tail = ring->tail; tail != head; tail++)
+        {
+            rec = &(ring->recs[tail & (SR_LOG_RING_SZ - 1)]);
+            fwrite(rec->msg, 1, rec->len, stdout);
+            wrote = 1;
+        }
+        __atomic_store_n(&(ring->tail), tail, __ATOMIC_RELEASE);
+
+        dropped = __atomic_load_n(&(ring->dropped), __ATOMIC_RELAXED);
+        if (dropped != ring->reported)
+        {
+            fprintf(stdout, "(%lu log messages dropped, ring full)\n",
+                    dropped - ring->reported);
+            ring->reported = dropped;
+            wrote = 1;
+        }
+
+        if (state == SR_LOG_RING_DEAD)
+        { __atomic_store_n(&(ring->state), SR_LOG_RING_FREE, __ATOMIC_RELEASE); }
+    }
+
+    if (wrote)
+    { fflush(stdout); }
+} /* -- sr_log_drain -- */
+
+static void* sr_log_drainer(void* arg)
+{
+    struct timespec period;
+
+    period.tv_sec = 0;
+    period.tv_nsec = SR_LOG_PERIOD * 1000000L;
+
+    for (;;)
+    {
+        nanosleep(&period, 0);
+
+        pthread_mutex_lock(&sr_log_drain_lock);
+        sr_log_drain();
+        pthread_mutex_unlock(&sr_log_drain_lock);
+    }
+
+    return 0;
+} /* -- sr_log_drainer -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_flush
+ *
+ * Drain synchronously, used at exit so nothing queued is lost.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_flush(void)
+{
+    pthread_mutex_lock(&sr_log_drain_lock);
+    sr_log_drain();
+    pthread_mutex_unlock(&sr_log_drain_lock);
+} /* -- sr_log_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_set_level
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_set_level(int level)
+{
+    if (level < SR_LOG_ERROR)
+    { level = SR_LOG_ERROR; }
+    if (level > SR_LOG_TRACE)
+    { level = SR_LOG_TRACE; }
+
+    if (level > SR_LOG_MAX)
+    {
+        fprintf(stderr, "Log level %d not compiled in, using %d\n",
+                level, SR_LOG_MAX);
+        level = SR_LOG_MAX;
+    }
+
+    sr_log_level = level;
+} /* -- sr_log_set_level -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_init
+ *
+ * Start the drain thread. Messages logged before this are kept and
+ * written on the first drain.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_init(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, sr_log_drainer, 0) != 0)
+    { fprintf(stderr, "Error: could not start the log drain thread\n"); }
+    pthread_attr_destroy(&attr);
+
+    atexit(sr_log_flush);
+} /* -- sr_log_init -- */
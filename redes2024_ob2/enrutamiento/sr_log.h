@@ -0,0 +1,92 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.h
+ *
+ * Description:
+ *
+ * Leveled logging for the packet path. A log call formats its message into
+ * a ring owned by the calling thread and returns; a background thread
+ * drains the rings to stdout. A full ring drops the message instead of
+ * waiting, so no caller ever blocks on terminal or file I/O.
+ *
+ * Levels above SR_LOG_MAX are compiled out, arguments included. The rest
+ * are filtered at run time against sr_log_level (see sr_log_set_level),
+ * and every call site is limited to SR_LOG_BURST messages per second.
+ *
+ * Messages from one thread come out in order; messages from different
+ * threads may be reordered with respect to each other.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LOG_H
+#define SR_LOG_H
+
+#define SR_LOG_ERROR 0
+#define SR_LOG_WARN  1
+#define SR_LOG_INFO  2
+#define SR_LOG_DEBUG 3
+#define SR_LOG_TRACE 4
+
+/* highest level compiled in, override with -DSR_LOG_MAX=n */
+#ifndef SR_LOG_MAX
+#ifdef _DEBUG_
+#define SR_LOG_MAX SR_LOG_TRACE
+#else
+#define SR_LOG_MAX SR_LOG_INFO
+#endif
+#endif
+
+#define SR_LOG_DEFAULT SR_LOG_INFO  /* run time level until set */
+#define SR_LOG_BURST   100          /* messages per second per call site */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_log_site
+ *
+ * Rate limit state of one log call site, a static inside the SR_LOG macro.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_log_site
+{
+    unsigned long second;       /* time() of the current window */
+    unsigned int count;         /* messages let through in the window */
+    unsigned long suppressed;   /* messages dropped since the last one out */
+};
+
+extern int sr_log_level;
+
+#define sr_log_enabled(level) \
+    (((level) <= SR_LOG_MAX) && ((level) <= sr_log_level))
+
+#define SR_LOG(level, fmt, args...) \
+  do { static struct sr_log_site sr_log_site_; \
+       if (sr_log_enabled(level)) \
+         sr_log_write(&sr_log_site_, fmt, ## args); } while (0)
+
+#define sr_log_error(fmt, args...) SR_LOG(SR_LOG_ERROR, fmt, ## args)
+#define sr_log_warn(fmt, args...)  SR_LOG(SR_LOG_WARN, fmt, ## args)
+
+#if SR_LOG_MAX >= SR_LOG_INFO
+#define sr_log_info(fmt, args...)  SR_LOG(SR_LOG_INFO, fmt, ## args)
+#else
+#define sr_log_info(fmt, args...)  do{}while(0)
+#endif
+
+#if SR_LOG_MAX >= SR_LOG_DEBUG
+#define sr_log_debug(fmt, args...) SR_LOG(SR_LOG_DEBUG, fmt, ## args)
+#else
+#define sr_log_debug(fmt, args...) do{}while(0)
+#endif
+
+#if SR_LOG_MAX >= SR_LOG_TRACE
+#define sr_log_trace(fmt, args...) SR_LOG(SR_LOG_TRACE, fmt, ## args)
+#else
+#define sr_log_trace(fmt, args...) do{}while(0)
+#endif
+
+void sr_log_init(void);
+void sr_log_set_level(int);
+void sr_log_flush(void);
+void sr_log_write(struct sr_log_site*, const char*, ...)
+    __attribute__ ((format (printf, 2, 3)));
+
+#endif /* -- SR_LOG_H -- */
@@ -32,6 +32,8 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_log.h"
+#include "sr_capture.h"
 
 extern char* optarg;
 
@@ -65,11 +67,19 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    unsigned int snaplen = PACKET_DUMP_SIZE;
+    unsigned long rotate_mb = 0;
+    unsigned long rotate_secs = 0;
+    unsigned int arp_cache_size = SR_ARPCACHE_SZ;
+    long arp_size;
+    char* end;
+    int arp_queue_policy = SR_ARPQ_DROP_OLDEST;
+    int arp_glean = SR_ARP_GLEAN_UPDATE;
     struct sr_instance sr;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:a:Q:g:d:n:C:G:")) != EOF)
     {
         switch (c)
         {
@@ -101,9 +111,59 @@ int main(int argc, char **argv)
             case 'T':
                 template = optarg;
                 break;
+            case 'a':
+                arp_size = strtol(optarg, &end, 10);
+                if ((*optarg == '\0') || (*end != '\0') ||
+                    (arp_size <= 0) || (arp_size > SR_ARPCACHE_MAX))
+                {
+                    fprintf(stderr,"Error: -a takes 1 to %d entries\n",
+                            SR_ARPCACHE_MAX);
+                    exit(1);
+                }
+                arp_cache_size = (unsigned int) arp_size;
+                break;
+            case 'Q':
+                if (strcmp(optarg, "newest") == 0)
+                    arp_queue_policy = SR_ARPQ_DROP_NEWEST;
+                else if (strcmp(optarg, "oldest") == 0)
+                    arp_queue_policy = SR_ARPQ_DROP_OLDEST;
+                else
+                {
+                    fprintf(stderr,"Error: -Q takes oldest or newest\n");
+                    exit(1);
+                }
+                break;
+            case 'g':
+                if (strcmp(optarg, "off") == 0)
+                    arp_glean = SR_ARP_GLEAN_OFF;
+                else if (strcmp(optarg, "update") == 0)
+                    arp_glean = SR_ARP_GLEAN_UPDATE;
+                else if (strcmp(optarg, "all") == 0)
+                    arp_glean = SR_ARP_GLEAN_ALL;
+                else
+                {
+                    fprintf(stderr,"Error: -g takes off, update or all\n");
+                    exit(1);
+                }
+                break;
+            case 'd':
+                sr_log_set_level(atoi((char *) optarg));
+                break;
+            case 'n':
+                snaplen = atoi((char *) optarg);
+                break;
+            case 'C':
+                rotate_mb = atol((char *) optarg);
+                break;
+            case 'G':
+                rotate_secs = atol((char *) optarg);
+                break;
         } /* switch */
     } /* -- while -- */
 
+    /* -- start draining the packet path log -- */
+    sr_log_init();
+
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
 
@@ -116,6 +176,9 @@ int main(int argc, char **argv)
         strncpy(sr.template, template, 30);
 
     sr.topo_id = topo;
+    sr.arp_cache_size = arp_cache_size;
+    sr.arp_queue_policy = arp_queue_policy;
+    sr.arp_glean = arp_glean;
     strncpy(sr.host,host,32);
 
     if(! user )
@@ -126,8 +189,14 @@ int main(int argc, char **argv)
     /* -- set up file pointer for logging of raw packets -- */
     if(logfile != 0)
     {
-        sr.logfile = sr_dump_open(logfile,0,PACKET_DUMP_SIZE);
-        if(!sr.logfile)
+        if((snaplen == 0) || (snaplen > 65535))
+        {
+            fprintf(stderr,"Error: snaplen must be between 1 and 65535\n");
+            exit(1);
+        }
+        sr.capture = sr_capture_open(logfile, snaplen,
+                                     rotate_mb * 1000000, rotate_secs);
+        if(!sr.capture)
         {
             fprintf(stderr,"Error opening up dump file %s\n",
                     logfile);
@@ -178,7 +247,12 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-a arp cache entries] \n");
+    printf("           [-Q oldest|newest packet dropped on full arp queue] \n");
+    printf("           [-g off|update|all arp mappings learned from others] \n");
+    printf("           [-d log level 0=error .. 4=trace] \n");
+    printf("           [-n capture snaplen] [-C rotate capture every n MB] \n");
+    printf("           [-G rotate capture every n seconds] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
 } /* -- usage -- */
@@ -220,9 +294,9 @@ static void sr_destroy_instance(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
-    if(sr->logfile)
+    if(sr->capture)
     {
-        sr_dump_close(sr->logfile);
+        sr_capture_close(sr->capture);
     }
 
     /*
@@ -243,12 +317,19 @@ static void sr_init_instance(struct sr_instance* sr)
     assert(sr);
 
     sr->sockfd = -1;
+    sr->vns_io = 0;
     sr->user[0] = 0;
     sr->host[0] = 0;
     sr->topo_id = 0;
     sr->if_list = 0;
-    sr->routing_table = 0;
-    sr->logfile = 0;
+    memset(sr->if_index, 0, sizeof(sr->if_index));
+    sr->if_count = 0;
+    sr_rt_init(sr);
+    sr->capture = 0;
+    sr->ospf_subsys = 0;
+    sr->arp_cache_size = SR_ARPCACHE_SZ;
+    sr->arp_queue_policy = SR_ARPQ_DROP_OLDEST;
+    sr->arp_glean = SR_ARP_GLEAN_UPDATE;
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
@@ -269,14 +350,17 @@ static void sr_init_instance(struct sr_instance* sr)
 int sr_verify_routing_table(struct sr_instance* sr)
 {
     struct sr_rt* rt_walker = 0;
-    struct sr_if* if_walker = 0;
     int ret = 0;
+    unsigned long epoch;
 
     /* -- REQUIRES --*/
     assert(sr);
 
+    epoch = sr_rt_read_lock(sr);
+
     if( (sr->if_list == 0) || (sr->routing_table == 0))
     {
+        sr_rt_read_unlock(sr, epoch);
         return 999; /* doh! */
     }
 
@@ -285,20 +369,14 @@ int sr_verify_routing_table(struct sr_instance* sr)
     while(rt_walker)
     {
         /* -- check to see if interface exists -- */
-        if_walker = sr->if_list;
-        while(if_walker)
-        {
-            if( strncmp(if_walker->name,rt_walker->interface,sr_IFACE_NAMELEN)
-                    == 0)
-            { break; }
-            if_walker = if_walker->next;
-        }
-        if(if_walker == 0)
+        if(sr_get_interface_by_index(sr, rt_walker->ifindex) == 0)
         { ret++; } /* -- interface not found! -- */
 
         rt_walker = rt_walker->next;
     } /* -- while -- */
 
+    sr_rt_read_unlock(sr, epoch);
+
     return ret;
 } /* -- sr_verify_routing_table -- */
 
@@ -0,0 +1,212 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pool.c
+ *
+ * Description:
+ *
+ * Per-thread slab pools, see sr_pool.h. A thread cache is created on the
+ * first allocation of a thread and handed back to the depots when the
+ * thread exits, which matters for the short-lived PWOSPF threads.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "sr_pool.h"
+
+#define SR_POOL_COUNT 2
+
+struct sr_pool_obj
+{
+    struct sr_pool_obj* next;
+};
+
+struct sr_pool_cache
+{
+    struct sr_pool_obj* head[SR_POOL_COUNT];
+    unsigned int count[SR_POOL_COUNT];
+};
+
+struct sr_pool sr_frame_pool =
+{ "frame", SR_POOL_FRAME_SZ, 32, 0, PTHREAD_MUTEX_INITIALIZER, 0, 0, 0 };
+struct sr_pool sr_small_pool =
+{ "small", SR_POOL_SMALL_SZ, 64, 1, PTHREAD_MUTEX_INITIALIZER, 0, 0, 0 };
+
+static struct sr_pool* sr_pools[SR_POOL_COUNT] =
+{ &sr_frame_pool, &sr_small_pool };
+
+static __thread struct sr_pool_cache* sr_pool_tcache;
+static pthread_key_t sr_pool_key;
+static pthread_once_t sr_pool_once = PTHREAD_ONCE_INIT;
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_give_back
+ *
+ * Move up to n objects from the thread cache to the depot.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_pool_give_back(struct sr_pool* pool,
+                              struct sr_pool_cache* cache, unsigned int n)
+{
+    struct sr_pool_obj* first = cache->head[pool->id];
+    struct sr_pool_obj* last = first;
+    unsigned int moved = 1;
+
+    if ((first == 0) || (n == 0))
+    { return; }
+
+    while ((moved < n) && (last->next != 0))
+    {
+        last = last->next;
+        moved++;
+    }
+    cache->head[pool->id] = last->next;
+    cache->count[pool->id] -= moved;
+
+    pthread_mutex_lock(&(pool->lock));
+    last->next = pool->depot;
+    pool->depot = first;
+    pool->depot_count += moved;
+    pthread_mutex_unlock(&(pool->lock));
+} /* -- sr_pool_give_back -- */
+
+static void sr_pool_thread_exit(void* arg)
+{
+    struct sr_pool_cache* cache = (struct sr_pool_cache*)arg;
+    unsigned int i;
+
+    for (i = 0; i < SR_POOL_COUNT; i++)
+    { sr_pool_give_back(sr_pools[i], cache, cache->count[i]); }
+
+    free(cache);
+} /* -- sr_pool_thread_exit -- */
+
+static void sr_pool_make_key(void)
+{
+    pthread_key_create(&sr_pool_key, sr_pool_thread_exit);
+} /* -- sr_pool_make_key -- */
+
+static struct sr_pool_cache* sr_pool_cache_get(void)
+{
+    if (sr_pool_tcache == 0)
+    {
+        pthread_once(&sr_pool_once, sr_pool_make_key);
+        sr_pool_tcache =
+            (struct sr_pool_cache*)calloc(1, sizeof(struct sr_pool_cache));
+        assert(sr_pool_tcache);
+        pthread_setspecific(sr_pool_key, sr_pool_tcache);
+    }
+
+    return sr_pool_tcache;
+} /* -- sr_pool_cache_get -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_refill
+ *
+ * Take a batch from the depot, carving a new slab if it is empty.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_pool_refill(struct sr_pool* pool, struct sr_pool_cache* cache)
+{
+    struct sr_pool_obj* obj;
+    unsigned int moved = 0;
+    char* slab;
+
+    pthread_mutex_lock(&(pool->lock));
+
+    while ((moved < pool->batch) && (pool->depot != 0))
+    {
+        obj = pool->depot;
+        pool->depot = obj->next;
+        obj->next = cache->head[pool->id];
+        cache->head[pool->id] = obj;
+        moved++;
+    }
+    pool->depot_count -= moved;
+
+    if (moved == 0)
+    {
+        slab = (char*)malloc(pool->objsz * pool->batch);
+        assert(slab);
+        pool->slabs++;
+
+        for (moved = 0; moved < pool->batch; moved++)
+        {
+            obj = (struct sr_pool_obj*)(slab + moved * pool->objsz);
+            obj->next = cache->head[pool->id];
+            cache->head[pool->id] = obj;
+        }
+    }
+
+    pthread_mutex_unlock(&(pool->lock));
+
+    cache->count[pool->id] += moved;
+} /* -- sr_pool_refill -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_alloc
+ *
+ *---------------------------------------------------------------------*/
+
+void* sr_pool_alloc(struct sr_pool* pool)
+{
+    struct sr_pool_cache* cache = sr_pool_cache_get();
+    struct sr_pool_obj* obj;
+
+    if (cache->head[pool->id] == 0)
+    { sr_pool_refill(pool, cache); }
+
+    obj = cache->head[pool->id];
+    cache->head[pool->id] = obj->next;
+    cache->count[pool->id]--;
+
+    return obj;
+} /* -- sr_pool_alloc -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_free
+ *
+ * Objects may be freed by a thread other than the one that allocated
+ * them; they simply migrate through the depot.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pool_free(struct sr_pool* pool, void* ptr)
+{
+    struct sr_pool_cache* cache = sr_pool_cache_get();
+    struct sr_pool_obj* obj = (struct sr_pool_obj*)ptr;
+
+    if (obj == 0)
+    { return; }
+
+    obj->next = cache->head[pool->id];
+    cache->head[pool->id] = obj;
+    cache->count[pool->id]++;
+
+    if (cache->count[pool->id] >= 2 * pool->batch)
+    { sr_pool_give_back(pool, cache, pool->batch); }
+} /* -- sr_pool_free -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_print_stats
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pool_print_stats(void)
+{
+    unsigned int i;
+    struct sr_pool* pool;
+
+    for (i = 0; i < SR_POOL_COUNT; i++)
+    {
+        pool = sr_pools[i];
+        pthread_mutex_lock(&(pool->lock));
+        fprintf(stderr, "Pool %s: %lu slabs of %u x %lu bytes, %u in depot\n",
+                pool->name, pool->slabs, pool->batch,
+                (unsigned long)pool->objsz, pool->depot_count);
+        pthread_mutex_unlock(&(pool->lock));
+    }
+} /* -- sr_pool_print_stats -- */
@@ -0,0 +1,44 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pool.h
+ *
+ * Description:
+ *
+ * Fixed-size object pools for the per-packet allocations: frame buffers
+ * and the small ARP queue records. Each thread keeps a private free list
+ * per pool and trades objects with a shared depot in batches, so the
+ * common alloc/free pair touches neither a lock nor malloc. Memory is
+ * carved from slabs that are never returned to the system.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_POOL_H
+#define SR_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define SR_POOL_FRAME_SZ 2048   /* VNS header plus an Ethernet MTU frame */
+#define SR_POOL_SMALL_SZ 64     /* sr_packet, sr_arpreq */
+
+struct sr_pool_obj;
+
+struct sr_pool
+{
+    const char* name;
+    size_t objsz;
+    unsigned int batch;             /* objects per slab and per depot trade */
+    unsigned int id;                /* slot in the per-thread caches */
+    pthread_mutex_t lock;           /* guards the fields below */
+    struct sr_pool_obj* depot;      /* free objects no thread holds */
+    unsigned int depot_count;
+    unsigned long slabs;
+};
+
+extern struct sr_pool sr_frame_pool;
+extern struct sr_pool sr_small_pool;
+
+void* sr_pool_alloc(struct sr_pool*);
+void  sr_pool_free(struct sr_pool*, void*);
+void  sr_pool_print_stats(void);
+
+#endif /* -- SR_POOL_H -- */
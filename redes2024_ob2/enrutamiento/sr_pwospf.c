@@ -20,6 +20,10 @@
 #include <stdlib.h>
 
 #include "sr_utils.h"
+#include "sr_cksum.h"
+#include "sr_log.h"
+#include "sr_pool.h"
+#include "sr_workq.h"
 #include "sr_protocol.h"
 #include "pwospf_protocol.h"
 #include "sr_rt.h"
@@ -28,11 +32,7 @@
 #include "dijkstra.h"
 
 /*pthread_t hello_thread;*/
-pthread_t g_hello_packet_thread;
-pthread_t g_all_lsu_thread;
 pthread_t g_lsu_thread;
-pthread_t g_neighbors_thread;
-pthread_t g_topology_entries_thread;
 pthread_t g_rx_lsu_thread;
 pthread_t g_dijkstra_thread;
 
@@ -41,12 +41,173 @@ pthread_mutex_t g_dijkstra_mutex = PTHREAD_MUTEX_INITIALIZER;
 struct in_addr g_router_id;
 uint8_t g_ospf_multicast_mac[ETHER_ADDR_LEN];
 struct ospfv2_neighbor *g_neighbors;
-struct pwospf_topology_entry *g_topology;
+struct pwospf_lsdb *g_topology;
 uint16_t g_sequence_num;
+struct sr_timer g_lsu_timer;
 
 /* -- Declaración de hilo principal de la función del subsistema pwospf --- */
 static void *pwospf_run_thread(void *arg);
 
+/*---------------------------------------------------------------------
+ * Method: pwospf_schedule_spf
+ *
+ * Pide una corrida de Dijkstra. Se junta con la que ya esté pedida o,
+ * si no hay ninguna, arma el timer del planificador.
+ *
+ *---------------------------------------------------------------------*/
+
+static void pwospf_schedule_spf(struct sr_instance *sr)
+{
+    struct pwospf_spf_sched *spf = &(sr->ospf_subsys->spf);
+
+    pthread_mutex_lock(&(spf->lock));
+    spf->triggers++;
+
+    if (spf->scheduled || spf->pending)
+    {
+        /* Ya hay una corrida pedida que va a ver este cambio */
+        spf->coalesced++;
+    }
+    else if (spf->running)
+    {
+        /* La corrida en curso pudo copiar la topología antes del cambio */
+        spf->pending = 1;
+    }
+    else
+    {
+        unsigned long now = sr_timer_now_ms(&(sr->timers));
+        unsigned long since = now - spf->last_done;
+        unsigned long wait = PWOSPF_SPF_DELAY;
+
+        if ((spf->runs == 0) || (since >= 2 * spf->hold))
+        {
+            spf->hold = PWOSPF_SPF_HOLD_MIN;
+            spf->backoff = 0;
+        }
+        else if (since < spf->hold)
+        {
+            /* Inestabilidad: espero a que se cumpla el hold */
+            wait = spf->hold - since;
+            spf->backoff = 1;
+        }
+        else
+        {
+            spf->backoff = 0;
+        }
+
+        spf->scheduled = 1;
+        sr_timer_mod(&(sr->timers), &(spf->timer), wait);
+    }
+
+    pthread_mutex_unlock(&(spf->lock));
+} /* -- pwospf_schedule_spf -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_spf_run
+ *
+ * Corre Dijkstra en un worker y programa la siguiente corrida si hubo
+ * disparos mientras tanto
+ *
+ *---------------------------------------------------------------------*/
+
+static void *pwospf_spf_run(void *arg)
+{
+    dijkstra_param_t *dijkstra_data = (dijkstra_param_t *)arg;
+    struct sr_instance *sr = dijkstra_data->sr;
+    struct pwospf_spf_sched *spf = &(sr->ospf_subsys->spf);
+
+    run_dijkstra(dijkstra_data);
+
+    pthread_mutex_lock(&(spf->lock));
+    spf->running = 0;
+    spf->last_done = sr_timer_now_ms(&(sr->timers));
+
+    if (spf->backoff)
+    {
+        spf->hold *= 2;
+        if (spf->hold > PWOSPF_SPF_HOLD_MAX)
+        {
+            spf->hold = PWOSPF_SPF_HOLD_MAX;
+        }
+    }
+
+    if (spf->pending)
+    {
+        spf->pending = 0;
+        spf->backoff = 1;
+        spf->scheduled = 1;
+        sr_timer_mod(&(sr->timers), &(spf->timer), spf->hold);
+    }
+    pthread_mutex_unlock(&(spf->lock));
+
+    return NULL;
+} /* -- pwospf_spf_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_spf_timeout
+ *
+ * Vence el timer del planificador: encola la corrida de Dijkstra en el
+ * pool de workers
+ *
+ *---------------------------------------------------------------------*/
+
+void pwospf_spf_timeout(struct sr_instance *sr, void *arg)
+{
+    struct pwospf_spf_sched *spf = &(sr->ospf_subsys->spf);
+
+    pthread_mutex_lock(&(spf->lock));
+    spf->scheduled = 0;
+    spf->running = 1;
+    spf->runs++;
+    pthread_mutex_unlock(&(spf->lock));
+
+    dijkstra_param_t *dijkstra_data = (dijkstra_param_t *)sr_pool_alloc(&sr_small_pool);
+
+    assert(sizeof(dijkstra_param_t) <= SR_POOL_SMALL_SZ);
+
+    dijkstra_data->sr = sr;
+    dijkstra_data->topology = g_topology;
+    dijkstra_data->rid = g_router_id;
+    dijkstra_data->mutex = &g_dijkstra_mutex;
+
+    if (sr_workq_submit(&(sr->ospf_subsys->workq), SR_WORK_SPF, pwospf_spf_run,
+                        dijkstra_data, &sr_small_pool) != 0)
+    {
+        /* Pool lleno: reintento después de un hold */
+        pthread_mutex_lock(&(spf->lock));
+        spf->running = 0;
+        spf->runs--;
+        spf->scheduled = 1;
+        sr_timer_mod(&(sr->timers), &(spf->timer), spf->hold);
+        pthread_mutex_unlock(&(spf->lock));
+    }
+} /* -- pwospf_spf_timeout -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_print_spf_stats
+ *
+ *---------------------------------------------------------------------*/
+
+void pwospf_print_spf_stats(struct sr_instance *sr)
+{
+    struct pwospf_spf_sched *spf = &(sr->ospf_subsys->spf);
+    struct dijkstra_stats trees;
+
+    pthread_mutex_lock(&(spf->lock));
+    fprintf(stderr, "SPF: %lu triggers, %lu runs, %lu coalesced, %lu ms hold\n",
+            spf->triggers, spf->runs, spf->coalesced, spf->hold);
+    pthread_mutex_unlock(&(spf->lock));
+
+    dijkstra_get_stats(&trees);
+    fprintf(stderr, "SPF trees: %lu full, %lu incremental, %lu reused, %lu routers settled\n",
+            trees.full, trees.incremental, trees.reused, trees.settled);
+
+    pwospf_lock(sr->ospf_subsys);
+    fprintf(stderr, "LSU: %lu originated, LSAs built %lu times\n",
+            sr->ospf_subsys->lsu.originations, sr->ospf_subsys->lsu.builds);
+    pwospf_unlock(sr->ospf_subsys);
+} /* -- pwospf_print_spf_stats -- */
+
 /*---------------------------------------------------------------------
  * Method: pwospf_init(..)
  *
@@ -66,6 +227,23 @@ int pwospf_init(struct sr_instance *sr)
     fprintf(stdout, "ARRANCADO PWOSPF\n");
     assert(sr->ospf_subsys);
     pthread_mutex_init(&(sr->ospf_subsys->lock), 0);
+    sr_workq_init(&(sr->ospf_subsys->workq), SR_WORKQ_DEPTH);
+    sr->ospf_subsys->links_gen = 0;
+    sr->ospf_subsys->local_gen = 0;
+    memset(&(sr->ospf_subsys->lsu), 0, sizeof(struct pwospf_lsu_cache));
+
+    struct pwospf_spf_sched *spf = &(sr->ospf_subsys->spf);
+    pthread_mutex_init(&(spf->lock), 0);
+    sr_timer_init(&(spf->timer), pwospf_spf_timeout, 0);
+    spf->scheduled = 0;
+    spf->running = 0;
+    spf->pending = 0;
+    spf->backoff = 0;
+    spf->hold = PWOSPF_SPF_HOLD_MIN;
+    spf->last_done = 0;
+    spf->triggers = 0;
+    spf->runs = 0;
+    spf->coalesced = 0;
 
     g_router_id.s_addr = 0;
 
@@ -84,7 +262,7 @@ int pwospf_init(struct sr_instance *sr)
     struct in_addr zero;
     zero.s_addr = 0;
     g_neighbors = create_ospfv2_neighbor(zero);
-    g_topology = create_ospfv2_topology_entry(zero, zero, zero, zero, zero, 0);
+    g_topology = create_pwospf_lsdb();
 
     fprintf(stdout, "g_router_id: %d\n", g_router_id.s_addr);
     /* -- start thread subsystem -- */
@@ -158,6 +336,9 @@ static void *pwospf_run_thread(void *arg)
     Debug("-> PWOSPF: The router ID is [%s]\n", inet_ntoa(g_router_id));
 
     Debug("\nPWOSPF: Detecting the router interfaces and adding their networks to the routing table\n");
+    /* Las redes conectadas se juntan y se publican en una sola vuelta */
+    struct sr_rt *connected = NULL;
+    struct sr_rt **connected_tail = &connected;
     struct sr_if *int_temp = sr->if_list;
     while (int_temp != NULL)
     {
@@ -170,22 +351,33 @@ static void *pwospf_run_thread(void *arg)
         struct in_addr network;
         network.s_addr = ip.s_addr & mask.s_addr;
 
-        if (check_route(sr, network) == 0)
+        if ((check_route(sr, network) == 0) && (sr_rt_list_has(connected, network) == 0))
         {
             Debug("-> PWOSPF: Adding the directly connected network [%s, ", inet_ntoa(network));
             Debug("%s] to the routing table\n", inet_ntoa(mask));
-            sr_add_rt_entry(sr, network, gw, mask, int_temp->name, 1);
+            sr_rt_list_append(connected_tail, network, gw, mask, int_temp->ifindex, 1);
+            connected_tail = &((*connected_tail)->next);
         }
         int_temp = int_temp->next;
     }
+    sr_rt_add_entries(sr, connected);
 
     Debug("\n-> PWOSPF: Printing the forwarding table\n");
     sr_print_routing_table(sr);
 
-    pthread_create(&g_hello_packet_thread, NULL, send_hellos, sr);
-    pthread_create(&g_all_lsu_thread, NULL, send_all_lsu, sr);
-    pthread_create(&g_neighbors_thread, NULL, check_neighbors_life, sr);
-    pthread_create(&g_topology_entries_thread, NULL, check_topology_entries_age, sr);
+    /* Cada interfaz tiene su timer de HELLO; el primero sale ya */
+    int_temp = sr->if_list;
+    while (int_temp != NULL)
+    {
+        int_temp->helloint = OSPF_DEFAULT_HELLOINT;
+        sr_timer_init(&(int_temp->hello_timer), send_hellos, int_temp);
+        sr_timer_mod(&(sr->timers), &(int_temp->hello_timer), 0);
+        int_temp = int_temp->next;
+    }
+
+    /* Los LSUs periódicos; vecinos y topología arman sus timers al aparecer */
+    sr_timer_init(&g_lsu_timer, send_all_lsu, NULL);
+    sr_timer_mod(&(sr->timers), &g_lsu_timer, OSPF_DEFAULT_LSUINT * 1000);
 
     return NULL;
 } /* -- run_ospf_thread -- */
@@ -196,158 +388,113 @@ static void *pwospf_run_thread(void *arg)
  * *********************************************************************************/
 
 /*---------------------------------------------------------------------
- * Method: check_neighbors_life
+ * Method: pwospf_neighbor_timeout
  *
- * Chequea si los vecinos están vivos
+ * Vence un vecino del que no llegó un HELLO en OSPF_NEIGHBOR_TIMEOUT
+ * segundos. Se borra de la lista y de las interfaces donde estaba.
  *
  *---------------------------------------------------------------------*/
 
-void *check_neighbors_life(void *arg)
+void pwospf_neighbor_timeout(struct sr_instance *sr, void *arg)
 {
-    struct sr_instance *sr = (struct sr_instance *)arg;
-    /*
-    Cada 1 segundo, chequea la lista de vecinos.
-    Si hay un cambio, se debe ajustar el neighbor id en la interfaz.
-    */
-   while (1)
-    {
-        usleep(1000000);
-        pwospf_lock(sr->ospf_subsys);
+    struct ospfv2_neighbor *neighbor = (struct ospfv2_neighbor *)arg;
 
-        struct ospfv2_neighbor *removed_neighbors = check_neighbors_alive(g_neighbors);
+    pwospf_lock(sr->ospf_subsys);
 
-        /* Procesar vecinos eliminados (actualizar la interfaz si es necesario) */
-        while (removed_neighbors != NULL)
-        {
-            Debug("PWOSPF: Neighbor [ID = %s] removed from the interface\n", inet_ntoa(removed_neighbors->neighbor_id));
+    /* Si llegó un HELLO mientras esperaba el lock, el vecino sigue vivo */
+    if (sr_timer_pending(&(sr->timers), &(neighbor->timeout)))
+    {
+        pwospf_unlock(sr->ospf_subsys);
+        return;
+    }
 
-            /* Recorrer las interfaces para actualizar el ID del vecino eliminado */
-            struct sr_if *iface = sr->if_list;
-            while (iface != NULL)
-            {
-                if (iface->neighbor_id == removed_neighbors->neighbor_id.s_addr)
-                {
-                    Debug("PWOSPF: Clearing neighbor ID on interface %s\n", iface->name);
-                    iface->neighbor_id = 0; /* Resetear el ID del vecino */
-                }
-                iface = iface->next;
-            }
+    struct in_addr neighbor_id = neighbor->neighbor_id;
+    remove_neighbor(g_neighbors, neighbor);
 
-            struct ospfv2_neighbor *temp = removed_neighbors;
-            removed_neighbors = removed_neighbors->next;
-            free(temp); /* Liberar la memoria de los vecinos eliminados */
+    Debug("PWOSPF: Neighbor [ID = %s] removed from the interface\n", inet_ntoa(neighbor_id));
+
+    /* Recorrer las interfaces para actualizar el ID del vecino eliminado */
+    struct sr_if *iface = sr->if_list;
+    while (iface != NULL)
+    {
+        if (iface->neighbor_id == neighbor_id.s_addr)
+        {
+            Debug("PWOSPF: Clearing neighbor ID on interface %s\n", iface->name);
+            iface->neighbor_id = 0; /* Resetear el ID del vecino */
+            sr->ospf_subsys->local_gen++;
         }
-        pwospf_unlock(sr->ospf_subsys);
+        iface = iface->next;
     }
 
-    return NULL;
-} /* -- check_neighbors_life -- */
+    /* Las rutas que salían por ese vecino se recalculan ya, sin esperar a la topología */
+    pwospf_schedule_spf(sr);
+
+    pwospf_unlock(sr->ospf_subsys);
+} /* -- pwospf_neighbor_timeout -- */
 
 /*---------------------------------------------------------------------
- * Method: check_topology_entries_age
+ * Method: pwospf_topology_timeout
  *
- * Check if the topology entries are alive
- * and if they are not, remove them from the topology table
+ * Vence una entrada de la topología que ningún LSU refrescó en
+ * OSPF_TOPO_ENTRY_TIMEOUT segundos. Se borra y se recalcula Dijkstra.
  *
  *---------------------------------------------------------------------*/
 
-void *check_topology_entries_age(void *arg)
+void pwospf_topology_timeout(struct sr_instance *sr, void *arg)
 {
-    struct sr_instance *sr = (struct sr_instance *)arg;
+    struct pwospf_topology_entry *entry = (struct pwospf_topology_entry *)arg;
 
-    /*
-    Cada 1 segundo, chequea el tiempo de vida de cada entrada
-    de la topologia.
-    Si hay un cambio en la topología, se llama a la función de Dijkstra
-    en un nuevo hilo.
-    Se sugiere también imprimir la topología resultado del chequeo.
-    */
+    pwospf_lock(sr->ospf_subsys);
 
-    while (1)
+    /* Si llegó un LSU mientras esperaba el lock, la entrada sigue vigente */
+    if (sr_timer_pending(&(sr->timers), &(entry->timeout)))
     {
-        usleep(1000000);
+        pwospf_unlock(sr->ospf_subsys);
+        return;
+    }
 
-        pwospf_lock(sr->ospf_subsys);
+    /* Si se va un enlace entre routers hay que rehacer el árbol, si no alcanza con los prefijos */
+    if (entry->neighbor_id.s_addr != 0)
+    {
+        sr->ospf_subsys->links_gen++;
+    }
 
-        uint8_t topology_changed = check_topology_age(g_topology);
+    if (remove_topology_entry(g_topology, entry))
+    {
+        Debug("PWOSPF: Topology table changed. Recomputing shortest paths.\n");
 
-        if (topology_changed)
-        {
-            Debug("PWOSPF: Topology table changed. Recomputing shortest paths.\n");
-
-            /* Ejecuto Dijkstra en un nuevo hilo (run_dijkstra) */
-            dijkstra_param_t *dijkstra_data = ((dijkstra_param_t*)(malloc(sizeof(dijkstra_param_t))));
-            
-            dijkstra_data->sr = sr;
-            dijkstra_data->topology = g_topology;
-            dijkstra_data->rid = g_router_id;
-            dijkstra_data->mutex = g_dijkstra_mutex;
-            sr_print_routing_table(sr);
-            pthread_create(&g_dijkstra_thread, NULL, run_dijkstra, dijkstra_data);
-
-            Debug("PWOSPF: Updated topology table:\n");
-            print_topolgy_table(g_topology); /* Mostrar la tabla de topología actualizada */
-            Debug("Dijkstra thread created.\n");
-            sr_print_routing_table(sr);
-        }
+        /* Encolo Dijkstra en el pool de workers (run_dijkstra) */
+        pwospf_schedule_spf(sr);
 
-        pwospf_unlock(sr->ospf_subsys); 
+        Debug("PWOSPF: Updated topology table:\n");
+        print_topolgy_table(g_topology); /* Mostrar la tabla de topología actualizada */
+        Debug("Dijkstra queued.\n");
     }
 
-    return NULL;
-} /* -- check_topology_entries_age -- */
+    pwospf_unlock(sr->ospf_subsys);
+} /* -- pwospf_topology_timeout -- */
 
 /*---------------------------------------------------------------------
  * Method: send_hellos
  *
- * Para cada interfaz y cada helloint segundos, construye mensaje
- * HELLO y crea un hilo con la función para enviar el mensaje.
+ * Vence el timer de HELLO de una interfaz: encola el envío del HELLO y
+ * rearma el timer para dentro de helloint segundos.
  *
  *---------------------------------------------------------------------*/
 
-void *send_hellos(void *arg)
+void send_hellos(struct sr_instance *sr, void *arg)
 {
-    struct sr_instance *sr = (struct sr_instance *)arg;
-
-    /* While true */
-    while (1)
-    {
-        /* Se ejecuta cada 1 segundo */
-        usleep(1000000);
-
-        /* Bloqueo para evitar mezclar el envío de HELLOs y LSUs */
-        pwospf_lock(sr->ospf_subsys);
+    struct sr_if *interface = (struct sr_if *)arg;
 
-        /* Chequeo todas las interfaces para enviar el paquete HELLO */
-        struct sr_if *interface = sr->if_list;
+    powspf_hello_lsu_param_t *hello_data = ((powspf_hello_lsu_param_t *)(sr_pool_alloc(&sr_small_pool)));
+    hello_data->sr = sr;
+    hello_data->interface = interface;
+    Debug("\n\nPWOSPF: Sending HELLO packet for interface %s: \n", interface->name);
+    sr_workq_submit(&(sr->ospf_subsys->workq), SR_WORK_HELLO_TX,
+                    send_hello_packet, hello_data, &sr_small_pool);
 
-        /*  Recorro las interfaces */
-        while (interface != NULL)
-        {
-            /* Cada interfaz mantiene un contador en segundos para los HELLO */
-            if (interface->helloint > 0)
-            {
-                interface->helloint--;
-            }
-            else /* helloint llega a cero entonces hay que enviar paquete HELLO */
-            {
-                powspf_hello_lsu_param_t *hello_data = ((powspf_hello_lsu_param_t *)(malloc(sizeof(powspf_hello_lsu_param_t))));
-                hello_data->sr = sr;
-                hello_data->interface = interface;
-                Debug("\n\nPWOSPF: Sending HELLO packet for interface %s: \n", interface->name);
-                pthread_create(&g_hello_packet_thread, NULL, send_hello_packet, hello_data);
-
-                /* Reiniciar el contador de segundos para HELLO */
-                interface->helloint = OSPF_DEFAULT_HELLOINT;
-            }
-            interface = interface->next;
-        }
-
-        /* Desbloqueo */
-        pwospf_unlock(sr->ospf_subsys);
-    };
-
-    return NULL;
+    /* Próximo HELLO de esta interfaz */
+    sr_timer_mod(&(sr->timers), &(interface->hello_timer), interface->helloint * 1000);
 } /* -- send_hellos -- */
 
 /*---------------------------------------------------------------------
@@ -366,10 +513,11 @@ void *send_hello_packet(void *arg)
 
     Debug("\n\nPWOSPF: Constructing HELLO packet for interface %s: \n", hello_param->interface->name);
 
-    sr_ethernet_hdr_t *ethernet_header = ((sr_ethernet_hdr_t *)(malloc(sizeof(sr_ethernet_hdr_t))));
-    sr_ip_hdr_t *ip_header = ((sr_ip_hdr_t *)(malloc(sizeof(sr_ip_hdr_t))));
-    ospfv2_hdr_t *ospf_header = ((ospfv2_hdr_t *)(malloc(sizeof(ospfv2_hdr_t))));
-    ospfv2_hello_hdr_t *ospf_hello_header = ((ospfv2_hello_hdr_t *)(malloc(sizeof(ospfv2_hello_hdr_t))));
+    /* Los cabezales se arman en el stack y se copian al frame */
+    sr_ethernet_hdr_t ethernet_header_buf, *ethernet_header = &ethernet_header_buf;
+    sr_ip_hdr_t ip_header_buf, *ip_header = &ip_header_buf;
+    ospfv2_hdr_t ospf_header_buf, *ospf_header = &ospf_header_buf;
+    ospfv2_hello_hdr_t ospf_hello_header_buf, *ospf_hello_header = &ospf_hello_header_buf;
 
     int i;
     /* Seteo la dirección MAC de multicast para la trama a enviar */
@@ -434,7 +582,7 @@ void *send_hello_packet(void *arg)
 
     /* Creo el paquete a transmitir */
     int packet_length = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_hello_hdr_t);
-    uint8_t *send_packet = ((uint8_t *)(malloc(packet_length)));
+    uint8_t *send_packet = sr_frame_alloc(packet_length);
 
     /* Se agregan las cabeceras Ethernet, IP, OSPF y Hello en el orden adecuado. */
     memcpy(send_packet, ethernet_header, sizeof(sr_ethernet_hdr_t));
@@ -446,7 +594,7 @@ void *send_hello_packet(void *arg)
     ((ospfv2_hdr_t *)(send_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)))->csum = ospfv2_cksum((ospfv2_hdr_t *)(send_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)), sizeof(ospfv2_hdr_t) + sizeof(ospfv2_hello_hdr_t));
 
     /* Envío el paquete HELLO */
-    sr_send_packet(hello_param->sr, ((uint8_t *)(send_packet)), packet_length, hello_param->interface->name);
+    sr_send_frame(hello_param->sr, send_packet, packet_length, hello_param->interface);
 
     /* Imprimo información del paquete HELLO enviado */
     /* Debug("-> PWOSPF: Sending HELLO Packet of length = %d, out of the interface: %s\n", packet_length, hello_param->interface->name);
@@ -460,86 +608,174 @@ void *send_hello_packet(void *arg)
 } /* -- send_hello_packet -- */
 
 /*---------------------------------------------------------------------
- * Method: send_all_lsu
+ * Method: pwospf_lsu_build
  *
- * Construye y envía LSUs cada 30 segundos
+ * Deja en lsu->ospf el LSU propio con el número de secuencia actual y
+ * devuelve su largo. Los LSAs salen de las rutas directamente conectadas
+ * y estáticas y sólo se rearman si cambió algo de lo que dependen; si no,
+ * se reescriben los cabezales y el checksum se arma con lsa_sum.
+ * Se llama con el lock del subsistema.
  *
  *---------------------------------------------------------------------*/
 
-void *send_all_lsu(void *arg)
+static unsigned int pwospf_lsu_build(struct sr_instance *sr)
 {
-    struct sr_instance *sr = (struct sr_instance *)arg;
+    struct pwospf_lsu_cache *lsu = &(sr->ospf_subsys->lsu);
+    unsigned int hdr_len = sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t);
+
+    /* Se lee antes de recorrer la tabla: un cambio durante el recorrido
+       deja la caché vieja y se rearma en la próxima originación */
+    unsigned long rt_gen = __atomic_load_n(&(sr->rt_local_gen), __ATOMIC_SEQ_CST);
 
-    /* while true*/
-    while (1)
+    if (!lsu->valid || (lsu->rt_gen != rt_gen) || (lsu->local_gen != sr->ospf_subsys->local_gen))
     {
-        /* Se ejecuta cada OSPF_DEFAULT_LSUINT segundos */
-        usleep(OSPF_DEFAULT_LSUINT * 1000000);
+        /* La tabla se lee entera dentro de una misma sección de lectura */
+        unsigned long rt_epoch = sr_rt_read_lock(sr);
+        uint32_t route_qty = count_routes(sr);
+        unsigned int len = hdr_len + (route_qty * sizeof(ospfv2_lsa_t));
 
-        /* Bloqueo para evitar mezclar el envío de HELLOs y LSUs */
-        pwospf_lock(sr->ospf_subsys);
+        if (len > lsu->size)
+        {
+            lsu->ospf = (uint8_t *)realloc(lsu->ospf, len);
+            assert(lsu->ospf);
+            lsu->size = len;
+        }
 
-        struct sr_if *if_iter = sr->if_list;
-        /* Recorro todas las interfaces para enviar el paquete LSU */
-        while (if_iter != NULL)
+        /* Creo cada LSA iterando en las entradas de la tabla */
+        ospfv2_lsa_t *lsa = (ospfv2_lsa_t *)(lsu->ospf + hdr_len);
+        uint32_t lsa_index = 0;
+        struct sr_rt *route = sr->routing_table;
+        while (route != NULL)
         {
-            /* Si la interfaz tiene un vecino, envío un LSU */
-            if (if_iter->neighbor_id != 0)
+            /* Solo envío entradas directamente conectadas y agreagadas a mano*/
+            if (route->admin_dst <= 1 && lsa_index < route_qty)
             {
-                Debug("\n\nPWOSPF: Sending LSU packet for interface %s: \n", if_iter->name);
-                powspf_hello_lsu_param_t *lsu_param = (powspf_hello_lsu_param_t *)(malloc(sizeof(powspf_hello_lsu_param_t)));
-                lsu_param->sr = sr;
-                lsu_param->interface = if_iter;
-                send_lsu(lsu_param);
-                
+                /* Creo LSA con subnet, mask y routerID (id del vecino de la interfaz)*/
+                lsa[lsa_index].subnet = route->dest.s_addr;
+                lsa[lsa_index].mask = route->mask.s_addr;
+                lsa[lsa_index].rid = sr_get_interface_by_index(sr, route->ifindex)->neighbor_id;
+                lsa_index++;
             }
-           if_iter = if_iter->next;
+            route = route->next;
         }
-        g_sequence_num++;
-        /* Desbloqueo */
-        pwospf_unlock(sr->ospf_subsys);
-    };
-    
-    return NULL;
+        sr_rt_read_unlock(sr, rt_epoch);
+
+        lsu->num_adv = lsa_index;
+        lsu->lsa_sum = sr_cksum_sum(lsa, lsa_index * sizeof(ospfv2_lsa_t));
+        lsu->rt_gen = rt_gen;
+        lsu->local_gen = sr->ospf_subsys->local_gen;
+        lsu->valid = 1;
+        lsu->builds++;
+    }
+
+    unsigned int ospf_len = hdr_len + (lsu->num_adv * sizeof(ospfv2_lsa_t));
+
+    /* Inicializo cabezal de OSPF*/
+    ospfv2_hdr_t *ospf_header = (ospfv2_hdr_t *)lsu->ospf;
+    ospf_header->version = OSPF_V2;    /* Versión de OSPFv2 */
+    ospf_header->type = OSPF_TYPE_LSU; /* Tipo LSU */
+    ospf_header->len = htons(ospf_len);
+    ospf_header->rid = g_router_id.s_addr;
+    ospf_header->aid = htonl(0);
+    ospf_header->csum = 0;
+    ospf_header->autype = 0; /* Tipo de autenticación */
+    ospf_header->audata = 0; /* Datos de autenticación */
+
+    /* Seteo el número de secuencia, el TTL y el número de anuncios */
+    ospfv2_lsu_hdr_t *ospf_lsu_header = (ospfv2_lsu_hdr_t *)(lsu->ospf + sizeof(ospfv2_hdr_t));
+    ospf_lsu_header->seq = g_sequence_num;
+    ospf_lsu_header->ttl = 64;
+    ospf_lsu_header->unused = 0;
+    ospf_lsu_header->num_adv = lsu->num_adv;
+
+    /* Los cabezales ocupan un número par de bytes: su suma y la de los
+       LSAs se juntan sin recorrer los LSAs de nuevo */
+    ospf_header->csum = cksum_fold(sr_cksum_sum(lsu->ospf, hdr_len) + lsu->lsa_sum);
+
+    lsu->originations++;
+    return ospf_len;
+} /* -- pwospf_lsu_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: pwospf_originate_lsu
+ *
+ * Arma el LSU propio una vez y lo envía por cada interfaz con vecino.
+ * Se llama con el lock del subsistema.
+ *
+ *---------------------------------------------------------------------*/
+
+static void pwospf_originate_lsu(struct sr_instance *sr)
+{
+    unsigned int ospf_len = pwospf_lsu_build(sr);
+    const uint8_t *ospf = sr->ospf_subsys->lsu.ospf;
+
+    Debug("\n\nPWOSPF: Constructing LSU packet\n");
+    sr_print_routing_table(sr);
+    print_hdr_ospf((uint8_t *)ospf);
+
+    struct sr_if *if_iter = sr->if_list;
+    /* Recorro todas las interfaces para enviar el paquete LSU */
+    while (if_iter != NULL)
+    {
+        /* Si la interfaz tiene un vecino, envío un LSU */
+        if (if_iter->neighbor_id != 0)
+        {
+            Debug("\n\nPWOSPF: Sending LSU packet for interface %s: \n", if_iter->name);
+            send_lsu(sr, if_iter, ospf, ospf_len);
+        }
+        if_iter = if_iter->next;
+    }
+    g_sequence_num++;
+} /* -- pwospf_originate_lsu -- */
+
+/*---------------------------------------------------------------------
+ * Method: send_all_lsu
+ *
+ * Construye y envía LSUs cada OSPF_DEFAULT_LSUINT segundos
+ *
+ *---------------------------------------------------------------------*/
+
+void send_all_lsu(struct sr_instance *sr, void *arg)
+{
+    /* Bloqueo para evitar mezclar el envío de HELLOs y LSUs */
+    pwospf_lock(sr->ospf_subsys);
+    pwospf_originate_lsu(sr);
+    /* Desbloqueo */
+    pwospf_unlock(sr->ospf_subsys);
+
+    /* Próxima ronda de LSUs */
+    sr_timer_mod(&(sr->timers), &g_lsu_timer, OSPF_DEFAULT_LSUINT * 1000);
 } /* -- send_all_lsu -- */
 
 /*---------------------------------------------------------------------
  * Method: send_lsu
  *
- * Construye y envía paquetes LSU a través de una interfaz específica
+ * Envía el LSU ya armado (cabezal OSPF en adelante) a través de una
+ * interfaz específica; sólo se escriben los cabezales Ethernet e IP
  *
  *---------------------------------------------------------------------*/
 
-void *send_lsu(void *arg)
+void send_lsu(struct sr_instance *sr, struct sr_if *interface, const uint8_t *ospf, unsigned int ospf_len)
 {
     Debug("*********************** ENTRE AL SEND LSU PACKET ***********************************\n");
-    powspf_hello_lsu_param_t *lsu_param = ((powspf_hello_lsu_param_t *)(arg));
-    sr_print_routing_table(lsu_param->sr);
-    /* Solo envío LSUs si del otro lado hay un router*/
 
-    /* Construyo el LSU */
-    Debug("\n\nPWOSPF: Constructing LSU packet\n");
-    sr_ethernet_hdr_t *ethernet_header = ((sr_ethernet_hdr_t *)(malloc(sizeof(sr_ethernet_hdr_t))));
-    sr_ip_hdr_t *ip_header = ((sr_ip_hdr_t *)(malloc(sizeof(sr_ip_hdr_t))));
-    ospfv2_hdr_t *ospf_header = ((ospfv2_hdr_t *)(malloc(sizeof(ospfv2_hdr_t))));
-    ospfv2_lsu_hdr_t *ospf_lsu_header = ((ospfv2_lsu_hdr_t *)(malloc(sizeof(ospfv2_lsu_hdr_t))));
+    /* Creo el paquete; los cabezales se escriben directamente en el frame */
+    uint32_t packet_length = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + ospf_len;
+    uint8_t *send_packet = sr_frame_alloc(packet_length);
+    sr_ethernet_hdr_t *ethernet_header = (sr_ethernet_hdr_t *)send_packet;
+    sr_ip_hdr_t *ip_header = (sr_ip_hdr_t *)(send_packet + sizeof(sr_ethernet_hdr_t));
+
     /* Inicializo cabezal Ethernet */
     /* Dirección MAC destino la dejo para el final ya que hay que hacer ARP */
     ethernet_header->ether_type = htons(ethertype_ip);
-    
-    int i;
     /* Seteo la dirección MAC origen con la dirección de mi interfaz de salida */
-    for (i = 0; i < ETHER_ADDR_LEN; i++)
-    {
-        ethernet_header->ether_shost[i] = ((uint8_t)(lsu_param->interface->addr[i]));
-    }
-    uint32_t route_qty = count_routes(lsu_param->sr);
+    memcpy(ethernet_header->ether_shost, interface->addr, ETHER_ADDR_LEN);
 
     /* Inicializo cabezal IP*/
-    ip_header->ip_v = 4;                                                                              /* Versión IPv4 */
-    ip_header->ip_hl = 5;                                                                             /* Longitud del encabezado IP */
-    ip_header->ip_tos = 0;                                                                            /* Tipo de servicio */
-    ip_header->ip_len = htons(sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) + (route_qty * sizeof(ospfv2_lsa_t))); /* Longitud total */
+    ip_header->ip_v = 4;                                       /* Versión IPv4 */
+    ip_header->ip_hl = 5;                                      /* Longitud del encabezado IP */
+    ip_header->ip_tos = 0;                                     /* Tipo de servicio */
+    ip_header->ip_len = htons(sizeof(sr_ip_hdr_t) + ospf_len); /* Longitud total */
     ip_header->ip_id = rand();         /* Identificación única */
     ip_header->ip_off = htons(0x4000); /* Fragmento */
     ip_header->ip_ttl = 64;            /* Tiempo de vida (TTL) */
@@ -547,100 +783,38 @@ void *send_lsu(void *arg)
     ip_header->ip_p = 89;
 
     /* Seteo IP origen con la IP de mi interfaz de salida */
-    ip_header->ip_src = lsu_param->interface->ip;
+    ip_header->ip_src = interface->ip;
 
     /* La IP destino es la del vecino contectado a mi interfaz*/
-    ip_header->ip_dst = lsu_param->interface->neighbor_ip;
+    ip_header->ip_dst = interface->neighbor_ip;
 
     /* Calculo y seteo el chechsum IP*/
     ip_header->ip_sum = 0;
     ip_header->ip_sum = ip_cksum(ip_header, sizeof(sr_ip_hdr_t));
 
-    /* Inicializo cabezal de OSPF*/
-    ospf_header->version = OSPF_V2;    /* Versión de OSPFv2 */
-    ospf_header->type = OSPF_TYPE_LSU; /* Tipo LSU */
-
-    /* Seteo el Router ID con mi ID */
-    ospf_header->rid = g_router_id.s_addr;
-
-    /* Seteo el Area ID en 0 */
-    ospf_header->aid = htonl(0);
-
-    /* Seteo el Authentication Type y Authentication Data en 0 */
-    ospf_header->autype = 0; /* Tipo de autenticación */
-    ospf_header->audata = 0; /* Datos de autenticación */
-
-    /* Seteo el número de secuencia y avanzo*/
-    uint16_t sequence_num = g_sequence_num;
-    ospf_lsu_header->seq = sequence_num;
-    
-    /* Seteo el TTL en 64 y el resto de los campos del cabezal de LSU */
-    ospf_lsu_header->ttl = 64;
-    ospf_lsu_header->unused = 0;
-    /* Seteo el número de anuncios con la cantidad de rutas a enviar. Uso función count_routes */
-    ospf_lsu_header->num_adv = route_qty;
-
-    /* Creo el paquete y seteo todos los cabezales del paquete a transmitir */
-    uint32_t packet_length = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) + (route_qty * sizeof(ospfv2_lsa_t));
-    uint8_t *send_packet = ((uint8_t *)(malloc(packet_length)));
-    
-    /* Se agregan las cabeceras Ethernet, IP, OSPF y Hello en el orden adecuado. */
-    memcpy(send_packet, ethernet_header, sizeof(sr_ethernet_hdr_t));
-    memcpy(send_packet + sizeof(sr_ethernet_hdr_t), ip_header, sizeof(sr_ip_hdr_t));
-    memcpy(send_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t), ospf_header, sizeof(ospfv2_hdr_t));
-    memcpy(send_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t), ospf_lsu_header, sizeof(ospfv2_lsu_hdr_t));
-
-    /* Creo cada LSA iterando en las enttadas de la tabla */
-    struct sr_rt *route = lsu_param->sr->routing_table; /*  Accede a la tabla de rutas */
-    int lsa_index = 0;                                  /*  Índice para las LSAs dentro del paquete LSU */
-    /*Asigno la memoria para todos los LSA*/
-    
-    while (route != NULL)
-    {
-        /* Solo envío entradas directamente conectadas y agreagadas a mano*/
-        if (route->admin_dst <= 1){
-            ospfv2_lsa_t *lsa = ((ospfv2_lsa_t *)(malloc(sizeof(ospfv2_lsa_t))));
-            
-            /* Creo LSA con subnet, mask y routerID (id del vecino de la interfaz)*/
-            lsa->subnet = route->dest.s_addr;                      /*  Dirección de red (subnet) */
-            lsa->mask = route->mask.s_addr;                        /*  Máscara de red */
-            lsa->rid = sr_get_interface(lsu_param->sr, route->interface)->neighbor_id;         /*  ID del vecino conectado (OBS: Revisar bien esto) */
-
-            memcpy(send_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) + (lsa_index * sizeof(ospfv2_lsa_t)), lsa, sizeof(ospfv2_lsa_t));
-
-            lsa_index++;
-        }
-        route = route->next;
-    }
-
-    /* Calculo y actualizo el checksum del cabezal OSPF */
-    ((ospfv2_hdr_t *)(send_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)))->csum = ospfv2_cksum((ospfv2_hdr_t *)(send_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)), sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) + (route_qty * sizeof(ospfv2_lsa_t)));
+    /* El LSU, con su checksum, es el mismo para todas las interfaces */
+    memcpy(send_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t), ospf, ospf_len);
 
     /* Me falta la MAC para poder enviar el paquete, la busco en la cache ARP*/
     Debug("Neighbor IP: ");
-    print_addr_ip_int(ntohl(lsu_param->interface->neighbor_ip));
-    print_hdr_ospf((uint8_t *)ospf_header);
+    print_addr_ip_int(ntohl(interface->neighbor_ip));
     /* Envío el paquete si obtuve la MAC o lo guardo en la cola para cuando tenga la MAC*/
-    struct sr_arpentry *arp_entry = sr_arpcache_lookup(&lsu_param->sr->cache, lsu_param->interface->neighbor_ip);
-    if (arp_entry)
+    struct sr_arpentry arp_entry;
+    if (sr_arpcache_lookup(&sr->cache, interface->neighbor_ip, &arp_entry))
     {
         /* Reenviar el paquete si la dirección MAC está disponible */
-        fprintf(stdout, "Enviar el paquete LSU.\n");
-        sr_forward_packet(lsu_param->sr, send_packet, packet_length, arp_entry->mac, lsu_param->interface->name);
-        /*free(arp_entry);*/
+        sr_log_debug("Enviar el paquete LSU.\n");
+        memcpy(ethernet_header->ether_dhost, arp_entry.mac, ETHER_ADDR_LEN);
+        sr_send_frame(sr, send_packet, packet_length, interface);
     }
     else
     {
         /* Solicitar ARP si no se conoce la dirección MAC */
-        /* fprintf(stdout, "Solicitando ARP para la dirección %u.\n", ntohl(lsu_param->interface->neighbor_ip));*/
-        struct sr_arpreq *req = sr_arpcache_queuereq(&lsu_param->sr->cache, lsu_param->interface->neighbor_ip, send_packet, packet_length, lsu_param->interface->name);
-        handle_arpreq(lsu_param->sr, req);
+        struct sr_arpreq *req = sr_arpcache_queuereq(&sr->cache, interface->neighbor_ip, send_packet, packet_length, interface->ifindex);
+        sr_frame_free(send_packet);
+        handle_arpreq(sr, req);
     }
-
-    /* Libero memoria */
-    /* free(send_packet); */
     Debug("*********************** SALI DEL SEND LSU PACKET ***********************************\n");
-    return NULL;
 } /* -- send_lsu -- */
 
 /*---------------------------------------------------------------------
@@ -707,41 +881,26 @@ void sr_handle_pwospf_hello_packet(struct sr_instance *sr, uint8_t *packet, unsi
     struct in_addr neighbor_id;
     neighbor_id.s_addr = ospfv2_header->rid;
     
+    pwospf_lock(sr->ospf_subsys);
+
     if (rx_if->neighbor_id != ospfv2_header->rid)
     {
         rx_if->neighbor_id = ospfv2_header->rid;
         rx_if->neighbor_ip = ip_header->ip_src;
-
-        struct ospfv2_neighbor *new_neighbor = create_ospfv2_neighbor(neighbor_id);
-
-        add_neighbor(g_neighbors, new_neighbor);
+        sr->ospf_subsys->local_gen++;
 
         /* Si es un nuevo vecino, debo enviar LSUs por todas mis interfaces*/
-        powspf_hello_lsu_param_t *lsu_param = ((powspf_hello_lsu_param_t*)(malloc(sizeof(powspf_hello_lsu_param_t))));
-        lsu_param->sr = sr;
-        struct sr_if *interface = sr->if_list;
-        
-        pwospf_lock(sr->ospf_subsys);
-        /* Recorro todas las interfaces para enviar el paquete LSU */
-        while (interface!=NULL)
-        {
-            /* Si la interfaz tiene un vecino, envío un LSU */
-            if (interface->neighbor_id != 0) 
-            {
-                lsu_param->interface = interface;
-                send_lsu(lsu_param);
-            }
-
-            interface = interface->next;
-        }
+        pwospf_originate_lsu(sr);
 
-        g_sequence_num++;
-        
-        pwospf_unlock(sr->ospf_subsys);
+        /* Cambió un primer salto: los refrescos de LSU ya no disparan Dijkstra */
+        pwospf_schedule_spf(sr);
     }
 
+    /* Cada HELLO posterga el vencimiento del vecino (lo agrega si es nuevo) */
+    struct ospfv2_neighbor *neighbor = refresh_neighbors_alive(g_neighbors, neighbor_id);
+    sr_timer_mod(&(sr->timers), &(neighbor->timeout), OSPF_NEIGHBOR_TIMEOUT * 1000);
 
-    refresh_neighbors_alive(g_neighbors, neighbor_id);
+    pwospf_unlock(sr->ospf_subsys);
     /* Debug("*********************** SALI DEL HANDLE HELLO PACKET ***********************************\n"); */
 } /* -- sr_handle_pwospf_hello_packet -- */
 
@@ -760,7 +919,7 @@ void *sr_handle_pwospf_lsu_packet(void *arg)
     uint8_t *packet = rx_lsu_param->packet;
     unsigned int length = rx_lsu_param->length;
 
-    fprintf(stdout, "\n\nPWOSPF: Recibiendo LSU Packet\n");
+    sr_log_debug("\n\nPWOSPF: Recibiendo LSU Packet\n");
 
     int valid = is_packet_valid(packet, length);
 
@@ -804,17 +963,31 @@ void *sr_handle_pwospf_lsu_packet(void *arg)
 
     Debug("\n============================================== Sequence Number: %d =========================================================\n", ospfv2_lsu_header->seq);
 
+    /* La topología se actualiza con el lock tomado: sus entradas vencen en otro hilo */
+    pwospf_lock(rx_lsu_param->sr->ospf_subsys);
+
     /* Obtengo el número de secuencia y uso check_sequence_number para ver si ya lo recibí desde ese vecino*/
     int check = check_sequence_number(g_topology,rid_addr,ospfv2_lsu_header->seq);
     Debug(" -------------------- Check: %d\n", check);
     if (check == 0) {
         Debug("-> PWOSPF: LSU Packet dropped, repeated sequence number\n");
+        pwospf_unlock(rx_lsu_param->sr->ospf_subsys);
         return NULL; 
     } 
 
+    /* Los LSA anunciados tienen que caber en el paquete recibido */
+    if (length < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) +
+                 (unsigned long)ospfv2_lsu_header->num_adv * sizeof(ospfv2_lsa_t))
+    {
+        Debug("-> PWOSPF: LSU Packet dropped, truncated LSA list\n");
+        pwospf_unlock(rx_lsu_param->sr->ospf_subsys);
+        return NULL;
+    }
+
     /* Itero en los LSA que forman parte del LSU. Para cada uno, actualizo la topología.*/
 
-    int lsa_index = 0;       /* Índice para las LSAs dentro del paquete LSU */
+    int lsa_index = 0;      /* Índice para las LSAs dentro del paquete LSU */
+    uint8_t changes = TOPO_UNCHANGED;
     while (lsa_index < ospfv2_lsu_header->num_adv)
     {
         Debug("-> PWOSPF: Processing LSAs and updating topology table\n");
@@ -835,26 +1008,42 @@ void *sr_handle_pwospf_lsu_packet(void *arg)
         lsa_rid_addr.s_addr = lsa->rid;
         ip_src_addr.s_addr = ip_header->ip_src;
         
-        refresh_topology_entry(g_topology,rid_addr,subnet_addr,mask_addr,lsa_rid_addr,ip_src_addr,ospfv2_lsu_header->seq);
+        struct pwospf_topology_entry *entry = refresh_topology_entry(g_topology,rid_addr,subnet_addr,mask_addr,lsa_rid_addr,ip_src_addr,ospfv2_lsu_header->seq,&changes);
+
+        /* La entrada anunciada vence OSPF_TOPO_ENTRY_TIMEOUT segundos después de este LSU */
+        if (entry != NULL)
+        {
+            sr_timer_mod(&(rx_lsu_param->sr->timers), &(entry->timeout), OSPF_TOPO_ENTRY_TIMEOUT * 1000);
+        }
 
         /* Incrementa el índice de LSAs */
         lsa_index++;
     }
 
-    /* Imprimo la topología */
-    Debug("\n-> PWOSPF: Printing the topology table\n");
-    print_topolgy_table(g_topology);
-    
+    /* Imprimo la topología si cambió */
+    if (changes != TOPO_UNCHANGED)
+    {
+        Debug("\n-> PWOSPF: Printing the topology table\n");
+        print_topolgy_table(g_topology);
+    }
 
-    /* Ejecuto Dijkstra en un nuevo hilo (run_dijkstra) */
-    dijkstra_param_t *dijkstra_data = ((dijkstra_param_t*)(malloc(sizeof(dijkstra_param_t))));
-    
-    dijkstra_data->sr = rx_lsu_param->sr;
-    dijkstra_data->topology = g_topology;
-    dijkstra_data->rid = g_router_id;
-    dijkstra_data->mutex = g_dijkstra_mutex;
+    if (changes & TOPO_LINK_CHANGED)
+    {
+        rx_lsu_param->sr->ospf_subsys->links_gen++;
+    }
+
+    pwospf_unlock(rx_lsu_param->sr->ospf_subsys);
 
-    pthread_create(&g_dijkstra_thread, NULL, run_dijkstra, dijkstra_data);
+    /* Los refrescos periódicos con el mismo contenido no cambian ninguna ruta */
+    if (changes != TOPO_UNCHANGED)
+    {
+        /* Encolo Dijkstra en el pool de workers (run_dijkstra) */
+        pwospf_schedule_spf(rx_lsu_param->sr);
+    }
+    else
+    {
+        Debug("-> PWOSPF: LSU refresh without changes, Dijkstra skipped\n");
+    }
 
     struct sr_if* interface = rx_lsu_param->sr->if_list;
 
@@ -881,19 +1070,18 @@ void *sr_handle_pwospf_lsu_packet(void *arg)
             ospfv2_header->csum = ospfv2_cksum( ospfv2_header, sizeof(ospfv2_hdr_t) + sizeof(ospfv2_lsu_hdr_t) + (ospfv2_lsu_header->num_adv * sizeof(ospfv2_lsa_t)) );
 
             /* Envío el paquete*/
-            struct sr_arpentry *arp_entry = sr_arpcache_lookup(&rx_lsu_param->sr->cache, interface->neighbor_ip);
-            if (arp_entry)
+            struct sr_arpentry arp_entry;
+            if (sr_arpcache_lookup(&rx_lsu_param->sr->cache, interface->neighbor_ip, &arp_entry))
             {
                 /* Reenviar el paquete si la dirección MAC está disponible */
-                fprintf(stdout, "Enviar el paquete LSU.\n");
-                sr_forward_packet(rx_lsu_param->sr, packet, rx_lsu_param->length, arp_entry->mac, interface->name);
-                /*free(arp_entry);*/
+                sr_log_debug("Enviar el paquete LSU.\n");
+                sr_forward_packet(rx_lsu_param->sr, packet, rx_lsu_param->length, arp_entry.mac, interface);
             }
             else
             {
                 /* Solicitar ARP si no se conoce la dirección MAC */
                 /* fprintf(stdout, "Solicitando ARP para la dirección %u.\n", ntohl(rx_lsu_param->interface->neighbor_ip));*/
-                struct sr_arpreq *req = sr_arpcache_queuereq(&rx_lsu_param->sr->cache, interface->neighbor_ip, packet, rx_lsu_param->length, interface->name);
+                struct sr_arpreq *req = sr_arpcache_queuereq(&rx_lsu_param->sr->cache, interface->neighbor_ip, packet, rx_lsu_param->length, interface->ifindex);
                 handle_arpreq(rx_lsu_param->sr, req);
             }
         }
@@ -934,7 +1122,7 @@ void sr_handle_pwospf_packet(struct sr_instance *sr, uint8_t *packet, unsigned i
     }
 
     ospfv2_hdr_t *rx_ospfv2_hdr = ((ospfv2_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)));
-    powspf_rx_lsu_param_t *rx_lsu_param = ((powspf_rx_lsu_param_t *)(malloc(sizeof(powspf_rx_lsu_param_t))));
+    powspf_rx_lsu_param_t *rx_lsu_param;
 
     Debug("-> PWOSPF: Detecting PWOSPF Packet\n");
     Debug("      [Type = %d]\n", rx_ospfv2_hdr->type);
@@ -945,19 +1133,20 @@ void sr_handle_pwospf_packet(struct sr_instance *sr, uint8_t *packet, unsigned i
         sr_handle_pwospf_hello_packet(sr, packet, length, rx_if);
         break;
     case OSPF_TYPE_LSU:
-        rx_lsu_param->sr = sr;
-        unsigned int i;
-        for (i = 0; i < length; i++)
+        /* El LSU se copia a un buffer del pool y lo procesa un worker */
+        if (length > sizeof(rx_lsu_param->packet))
         {
-            rx_lsu_param->packet[i] = packet[i];
+            Debug("-> PWOSPF: LSU Packet dropped, too long\n");
+            break;
         }
+        assert(sizeof(powspf_rx_lsu_param_t) <= SR_POOL_FRAME_SZ);
+        rx_lsu_param = ((powspf_rx_lsu_param_t *)(sr_pool_alloc(&sr_frame_pool)));
+        rx_lsu_param->sr = sr;
+        memcpy(rx_lsu_param->packet, packet, length);
         rx_lsu_param->length = length;
         rx_lsu_param->rx_if = rx_if;
-        pthread_attr_t attr;
-        pthread_attr_init(&attr);
-        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-        pthread_t pid;
-        pthread_create(&pid, &attr, sr_handle_pwospf_lsu_packet, rx_lsu_param);
+        sr_workq_submit(&(sr->ospf_subsys->workq), SR_WORK_LSU_RX,
+                        sr_handle_pwospf_lsu_packet, rx_lsu_param, &sr_frame_pool);
         break;
     }
 } /* -- sr_handle_pwospf_packet -- */
@@ -13,15 +13,67 @@
 
 #include <pthread.h>
 #include "sr_protocol.h"
+#include "sr_workq.h"
+#include "sr_timer.h"
 
 
 /* forward declare */
 struct sr_instance;
 
+/* -- planificación de Dijkstra -- */
+#define PWOSPF_SPF_DELAY     50    /* ms desde un disparo aislado hasta la corrida */
+#define PWOSPF_SPF_HOLD_MIN  200   /* ms mínimos entre dos corridas seguidas */
+#define PWOSPF_SPF_HOLD_MAX  5000  /* tope del backoff entre corridas */
+
+/* Los disparos (LSUs con cambios, vencimientos, vecinos) no corren Dijkstra:
+   arman un timer. Los que llegan antes de que venza se juntan en la misma
+   corrida y nunca hay más de una corrida en el pool. Si llegan disparos
+   dentro de hold ms de la última corrida, la siguiente espera a que se
+   cumpla hold y hold se duplica, hasta PWOSPF_SPF_HOLD_MAX. Tras 2 * hold
+   sin disparos vuelve a PWOSPF_SPF_HOLD_MIN. */
+struct pwospf_spf_sched
+{
+    pthread_mutex_t lock;       /* guarda todo lo de abajo */
+    struct sr_timer timer;      /* vence cuando toca correr */
+    uint8_t scheduled;          /* timer armado */
+    uint8_t running;            /* hay una corrida en el pool */
+    uint8_t pending;            /* hubo disparos durante la corrida */
+    uint8_t backoff;            /* esta corrida esperó el hold */
+    unsigned long hold;         /* ms entre corridas */
+    unsigned long last_done;    /* fin de la última corrida, ms del timer */
+    unsigned long triggers;     /* disparos recibidos */
+    unsigned long runs;         /* corridas lanzadas */
+    unsigned long coalesced;    /* disparos absorbidos por una corrida ya pedida */
+};
+
+/* El LSU propio: cabezal OSPF, cabezal LSU y LSAs seguidos, tal como van
+   después del cabezal IP. Los LSAs y su suma sin plegar se rearman sólo
+   cuando cambian las rutas conectadas o estáticas (no las que instala
+   Dijkstra) o el vecino de alguna interfaz; cada originación reescribe
+   los dos cabezales y arma el checksum sumándoles lsa_sum. Se usa con el
+   lock del subsistema. */
+struct pwospf_lsu_cache
+{
+    uint8_t* ospf;              /* lo que se copia en cada frame */
+    unsigned int size;          /* bytes reservados en ospf */
+    uint32_t num_adv;           /* LSAs armados */
+    uint64_t lsa_sum;           /* sr_cksum_sum de los LSAs */
+    uint8_t valid;              /* los LSAs están armados */
+    unsigned long rt_gen;       /* sr->rt_local_gen con que se armaron */
+    unsigned long local_gen;    /* local_gen con que se armaron */
+    unsigned long builds;       /* veces que se armaron los LSAs */
+    unsigned long originations; /* LSUs propios originados */
+};
+
 struct pwospf_subsys
 {   /* -- hilo y lock del pwospf subsystem -- */
     pthread_t thread;
     pthread_mutex_t lock;
+    struct sr_workq workq; /* pool de workers para LSUs, HELLOs y Dijkstra */
+    unsigned long links_gen; /* sube con cada cambio en los enlaces entre routers */
+    unsigned long local_gen; /* sube cuando cambia el vecino de alguna interfaz */
+    struct pwospf_lsu_cache lsu; /* el LSU propio, ver arriba */
+    struct pwospf_spf_sched spf; /* cuándo corre Dijkstra */
 };
 
 struct powspf_hello_lsu_param
@@ -41,16 +93,20 @@ struct powspf_rx_lsu_param
 typedef struct powspf_rx_lsu_param powspf_rx_lsu_param_t;
 
 /* -- sr_router.c -- */
-void sr_forward_packet(struct sr_instance *,uint8_t *, unsigned int ,uint8_t *,char *);
+void sr_forward_packet(struct sr_instance *,uint8_t *, unsigned int ,uint8_t *,struct sr_if *);
 
 int pwospf_init(struct sr_instance* sr);
+void pwospf_lock(struct pwospf_subsys*);
+void pwospf_unlock(struct pwospf_subsys*);
 
-void* check_neighbors_life(void*);
-void* check_topology_entries_age(void*);
-void* send_hellos(void*);
+void pwospf_neighbor_timeout(struct sr_instance*, void*);
+void pwospf_topology_timeout(struct sr_instance*, void*);
+void pwospf_spf_timeout(struct sr_instance*, void*);
+void pwospf_print_spf_stats(struct sr_instance*);
+void send_hellos(struct sr_instance*, void*);
 void* send_hello_packet(void*);
-void* send_all_lsu(void*);
-void* send_lsu(void*);
+void send_all_lsu(struct sr_instance*, void*);
+void send_lsu(struct sr_instance*, struct sr_if*, const uint8_t*, unsigned int);
 void sr_handle_pwospf_hello_packet(struct sr_instance*, uint8_t*, unsigned int, struct sr_if*);
 void* sr_handle_pwospf_lsu_packet(void*);
 void sr_handle_pwospf_packet(struct sr_instance*, uint8_t*, unsigned int, struct sr_if*);
@@ -20,6 +20,7 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_log.h"
 #include "pwospf_protocol.h"
 #include "sr_pwospf.h"
 
@@ -37,6 +38,9 @@ void sr_init(struct sr_instance *sr)
 {
   assert(sr);
 
+  /* Inicializa la rueda de timers: vencimientos de ARP, vecinos, topología y HELLOs */
+  sr_timer_wheel_init(&(sr->timers), sr);
+
   /* Inicializa el subsistema OSPF */
   pwospf_init(sr);
 
@@ -48,18 +52,16 @@ void sr_init(struct sr_instance *sr)
   sr_multicast_mac[4] = 0x00;
   sr_multicast_mac[5] = 0x05;
 
-  /* Inicializa la caché y el hilo de limpieza de la caché */
-  sr_arpcache_init(&(sr->cache));
+  /* Inicializa la caché; sus entradas y pedidos vencen en la rueda de timers */
+  sr_arpcache_init(&(sr->cache), sr->arp_cache_size, sr->arp_queue_policy,
+                   &(sr->timers));
+  sr_adj_init(&(sr->adj));
 
   /* Inicializa los atributos del hilo */
   pthread_attr_init(&(sr->attr));
   pthread_attr_setdetachstate(&(sr->attr), PTHREAD_CREATE_JOINABLE);
   pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
   pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
-  pthread_t thread;
-
-  /* Hilo para gestionar el timeout del caché ARP */
-  pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr);
 
 } /* -- sr_init -- */
 
@@ -67,20 +69,12 @@ void sr_forward_packet(struct sr_instance *sr,
                        uint8_t *packet /* lent */,
                        unsigned int len,
                        uint8_t *mac_dest,
-                       char *interface /* lent */)
+                       struct sr_if *out_iface /* lent */)
 {
 
   /* Obtener la cabecera Ethernet y modificar la dirección MAC de destino */
   sr_ethernet_hdr_t *ethernet_hdr = (sr_ethernet_hdr_t *)packet;
 
-  /* Obtener la interfaz de salida */
-  struct sr_if *out_iface = sr_get_interface(sr, interface);
-  if (out_iface == NULL)
-  {
-    fprintf(stdout, "Error: la interfaz de salida %s no se encontró.\n", interface);
-    return;
-  }
-
   /* Configurar la dirección MAC de origen a la MAC de la interfaz de salida */
   memcpy(ethernet_hdr->ether_shost, out_iface->addr, ETHER_ADDR_LEN);
 
@@ -88,50 +82,26 @@ void sr_forward_packet(struct sr_instance *sr,
   memcpy(ethernet_hdr->ether_dhost, mac_dest, ETHER_ADDR_LEN);
 
   /* Enviar el paquete por la interfaz indicada */
-  sr_send_packet(sr, packet, len, interface);
-
-  fprintf(stdout, "Paquete reenviado a la interfaz %s\n", interface);
-}
+  sr_send_packet_if(sr, packet, len, out_iface);
 
-/* Function to count the number of set bits (1s) in the mask */
-int count_set_bits(uint32_t mask)
-{
-  int count = 0;
-  while (mask)
-  {
-    count += mask & 1;
-    mask >>= 1;
-  }
-  return count;
+  sr_log_debug("Paquete reenviado a la interfaz %s\n", out_iface->name);
 }
 
-struct sr_rt *sr_find_rt_entry(struct sr_instance *sr, uint32_t ip)
+/* Longest prefix match over the published FIB. The entry is copied into
+   match so it stays valid after the routing table is swapped. */
+int sr_find_rt_entry(struct sr_instance *sr, uint32_t ip, struct sr_rt *match)
 {
-  /* Find the entry with the longest matching prefix */
-  struct sr_rt *best_match = NULL;
-  uint32_t longest_match_len = 0;
-
-  struct sr_rt *rt_iter = sr->routing_table;
+  unsigned long epoch = sr_rt_read_lock(sr);
+  struct sr_rt *best = sr_fib_lookup(__atomic_load_n(&sr->fib, __ATOMIC_SEQ_CST), ip);
 
-  while (rt_iter != NULL)
+  if (best != NULL)
   {
-    /* Compare the destination IP address with the entry in the routing table using the mask */
-    if ((rt_iter->mask.s_addr & ip) == (rt_iter->dest.s_addr & rt_iter->mask.s_addr))
-    {
-      /* Calculate the prefix length (number of set bits in the mask) */
-      uint32_t mask_len = count_set_bits(ntohl(rt_iter->mask.s_addr));
-
-      /* Find the entry with the longest matching prefix */
-      if (mask_len > longest_match_len)
-      {
-        best_match = rt_iter;
-        longest_match_len = mask_len;
-      }
-    }
-    rt_iter = rt_iter->next;
+    memcpy(match, best, sizeof(struct sr_rt));
+    match->next = NULL;
   }
+  sr_rt_read_unlock(sr, epoch);
 
-  return best_match;
+  return best != NULL;
 }
 
 /* Envía un paquete ICMP de error */
@@ -142,13 +112,9 @@ void sr_send_icmp_error_packet(uint8_t type,
                                uint8_t *ipPacket)
 {
 
-  Debug("\n\n========================================****************************************************** ENTRAMOS EN sr_send_icmp_error_packet *******************************************************===============================\n\n");
-  Debug("IpDst: %u\n", ipDst);
-  Debug("Type: %u\n", type);
-  Debug("Code: %u\n", code);
+  sr_log_debug("Enviando ICMP de error tipo %u código %u a %u\n", type, code, ipDst);
   struct sr_if* if_walker = sr->if_list;
   while(if_walker != NULL){
-    Debug("If Walker IP: %u\n", if_walker->ip);
     if(if_walker->ip == ipDst){
         return;
     }
@@ -157,35 +123,35 @@ void sr_send_icmp_error_packet(uint8_t type,
 
   /* Crear un nuevo paquete ICMP */
   unsigned int icmp_len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t3_hdr_t);
-  uint8_t *icmp_packet = malloc(icmp_len);
+  uint8_t *icmp_packet = sr_frame_alloc(icmp_len);
 
   /* Obtener las cabeceras del paquete original */
   sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(ipPacket + sizeof(sr_ethernet_hdr_t));
 
   /* Buscar la mejor coincidencia en la tabla de enrutamiento */
-  struct sr_rt *rt_match = sr_find_rt_entry(sr, ipDst);
-  if (!rt_match)
+  struct sr_rt rt_match;
+  if (!sr_find_rt_entry(sr, ipDst, &rt_match))
   {
-    fprintf(stdout, "Error: no se encontró una ruta para el destino %u\n", ip_hdr->ip_src);
-    free(icmp_packet);
+    sr_log_info("Error: no se encontró una ruta para el destino %u\n", ip_hdr->ip_src);
+    sr_frame_free(icmp_packet);
     return;
   }
   
   uint32_t arp_ip_dest;
-  if (rt_match->gw.s_addr == 0)
+  if (rt_match.gw.s_addr == 0)
   {
     arp_ip_dest = ipDst;
   } else {
-    arp_ip_dest = rt_match->gw.s_addr;
+    arp_ip_dest = rt_match.gw.s_addr;
   }
     
 
   /* Obtener la interfaz de salida a partir de la entrada de la tabla de enrutamiento */
-  struct sr_if *out_iface = sr_get_interface(sr, rt_match->interface);
+  struct sr_if *out_iface = sr_get_interface_by_index(sr, rt_match.ifindex);
   if (!out_iface)
   {
-    fprintf(stdout, "Error: no se pudo encontrar la interfaz de salida\n");
-    free(icmp_packet);
+    sr_log_error("Error: no se pudo encontrar la interfaz de salida\n");
+    sr_frame_free(icmp_packet);
     return;
   }
 
@@ -225,17 +191,18 @@ void sr_send_icmp_error_packet(uint8_t type,
   icmp_hdr->icmp_sum = cksum(icmp_hdr, sizeof(sr_icmp_t3_hdr_t));
 
    /* Buscar la dirección MAC del próximo salto (mediante ARP) */
-  struct sr_arpentry *arp_entry = sr_arpcache_lookup(&(sr->cache), arp_ip_dest);
-  if (arp_entry)
+  struct sr_arpentry arp_entry;
+  if (sr_arpcache_lookup(&(sr->cache), arp_ip_dest, &arp_entry))
   {
-    memcpy(new_ethernet_hdr->ether_dhost, arp_entry->mac, ETHER_ADDR_LEN); /* MAC de destino (próximo salto) */
+    memcpy(new_ethernet_hdr->ether_dhost, arp_entry.mac, ETHER_ADDR_LEN); /* MAC de destino (próximo salto) */
     /* Enviar el paquete */
-    sr_send_packet(sr, icmp_packet, icmp_len, out_iface->name);
+    sr_send_frame(sr, icmp_packet, icmp_len, out_iface);
   }
   else
   {
     /* Si no existe una entrada ARP, enviar una solicitud ARP */
-    struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), arp_ip_dest, icmp_packet, icmp_len, out_iface->name);
+    struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), arp_ip_dest, icmp_packet, icmp_len, out_iface->ifindex);
+    sr_frame_free(icmp_packet);
     handle_arpreq(sr, req);
   }
 
@@ -248,12 +215,11 @@ void sr_send_icmp(struct sr_instance *sr,
                   unsigned int len,
                   uint8_t icmp_type,
                   uint8_t icmp_code,
-                  char *interface /* lent */)
+                  struct sr_if *iface /* lent */)
 {
-  /* Crear un nuevo paquete ICMP para la respuesta */
+  /* La respuesta se arma sobre el mismo paquete recibido */
   unsigned int new_len = len;
-  uint8_t *icmp_packet = malloc(new_len);
-  memcpy(icmp_packet, original_packet, len);
+  uint8_t *icmp_packet = original_packet;
 
   /* Obtener cabeceras de Ethernet e IP */
   sr_ethernet_hdr_t *ethernet_hdr = (sr_ethernet_hdr_t *)icmp_packet;
@@ -281,10 +247,8 @@ void sr_send_icmp(struct sr_instance *sr,
   ip_hdr->ip_sum = 0;
   ip_hdr->ip_sum = cksum(ip_hdr, sizeof(sr_ip_hdr_t));
 
-  /* Enviar el paquete ICMP */
-  sr_send_packet(sr, icmp_packet, new_len, interface);
-
-  free(icmp_packet);
+  /* Enviar el paquete ICMP por la interfaz por la que llegó */
+  sr_send_packet_if(sr, icmp_packet, new_len, iface);
 }
 
 void sr_handle_ip_packet(struct sr_instance *sr,
@@ -292,39 +256,30 @@ void sr_handle_ip_packet(struct sr_instance *sr,
                          unsigned int len,
                          uint8_t *srcAddr,
                          uint8_t *destAddr,
-                         char *interface /* lent */,
+                         struct sr_if *iface /* lent */,
                          sr_ethernet_hdr_t *eHdr)
 {
 
   /* Verificar que el tamaño del paquete sea suficiente para la cabecera IP */
   if (len < (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)))
   {
-    fprintf(stdout, "Paquete IP demasiado corto. Descartando paquete.\n");
+    sr_log_info("Paquete IP demasiado corto. Descartando paquete.\n");
     return;
   }
 
   /* Extraer cabecera IP */
   sr_ip_hdr_t *ip_header = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
-  print_hdr_ip((uint8_t *)ip_header);
-
-  /* Verificar checksum de la cabecera IP */
-  uint16_t calculated_checksum = ip_cksum(ip_header, sizeof(sr_ip_hdr_t));
-
-  if (ip_header->ip_sum != calculated_checksum)
+  if (sr_log_enabled(SR_LOG_TRACE))
   {
-    fprintf(stdout, "Checksum IP inválido. Descartando paquete.\n");
-    return;
+    print_hdr_ip((uint8_t *)ip_header);
   }
 
+  /* El checksum de la cabecera IP ya lo verificó is_packet_valid */
+
   uint8_t ip_proto = ip_protocol((uint8_t *)ip_header);
   if (ip_proto == ip_protocol_ospfv2)
   {
-    struct sr_if *if_match = sr_get_interface(sr, interface);
-    if (if_match == NULL)
-    {
-      fprintf(stdout, "Error: la interfaz %s no se encontró.\n", interface);
-    }
-    sr_handle_pwospf_packet(sr, packet, len, if_match);
+    sr_handle_pwospf_packet(sr, packet, len, iface);
     return;
   }
 
@@ -332,9 +287,7 @@ void sr_handle_ip_packet(struct sr_instance *sr,
   uint32_t ip_src = ip_header->ip_src;
   uint32_t ip_dst = ip_header->ip_dst;
 
-  fprintf(stdout, "Paquete IP recibido: \n");
-  print_addr_ip_int(ntohl(ip_src));
-  print_addr_ip_int(ntohl(ip_dst));
+  sr_log_debug("Paquete IP recibido: %u -> %u\n", ntohl(ip_src), ntohl(ip_dst));
 
   /* Verificar si el paquete es para una de las interfaces del router */
   struct sr_if *iface_check = sr->if_list;
@@ -352,32 +305,23 @@ void sr_handle_ip_packet(struct sr_instance *sr,
   /* Verificar TTL */
   if (ip_header->ip_ttl <= 1 && !is_for_me)
   {
-    fprintf(stdout, "TTL expirado. Enviando ICMP Time Exceeded.\n");
+    sr_log_info("TTL expirado. Enviando ICMP Time Exceeded.\n");
     sr_send_icmp_error_packet(11, 0, sr, ip_header->ip_src, packet); /* Tipo 11, código 0: TTL Expired */
     return;
   }
 
-  struct sr_rt *rt_match;
-  
-  uint32_t arp_ip_dest;
+  /* Longest Prefix Match y reescritura Ethernet del próximo salto */
+  struct sr_adj adj;
+  int adj_state = SR_ADJ_NO_ROUTE;
   if (!is_for_me)
   {
-    /* Longest Prefix Match */
-    rt_match = sr_find_rt_entry(sr, ip_dst);
-    if (rt_match == NULL)
+    adj_state = sr_adj_resolve(sr, ip_dst, &adj);
+    if (adj_state == SR_ADJ_NO_ROUTE)
     {
-      fprintf(stdout, "No se encontró ruta para %u. Enviando ICMP net unreachable.\n", ip_dst);
+      sr_log_info("No se encontró ruta para %u. Enviando ICMP net unreachable.\n", ip_dst);
       sr_send_icmp_error_packet(3, 0, sr, ip_src, packet); /* Tipo 3, Código 0: Network Unreachable */
       return;
     }
-
-    if (rt_match->gw.s_addr == 0)
-    {
-      arp_ip_dest = ip_dst;
-    } else {
-      arp_ip_dest = rt_match->gw.s_addr;
-    }
-    
   }
 
   if (ip_proto == ip_protocol_icmp)
@@ -388,8 +332,8 @@ void sr_handle_ip_packet(struct sr_instance *sr,
       sr_icmp_hdr_t *icmp_header = (sr_icmp_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
       if ((icmp_header->icmp_type == 8) && (icmp_header->icmp_code == 0))
       {
-        fprintf(stdout, "ICMP Echo Request recibido. Respondiendo con Echo Reply.\n");
-        sr_send_icmp(sr, packet, len, 0, 0, interface); /* Tipo 0, Código 0: Echo Reply*/
+        sr_log_debug("ICMP Echo Request recibido. Respondiendo con Echo Reply.\n");
+        sr_send_icmp(sr, packet, len, 0, 0, iface); /* Tipo 0, Código 0: Echo Reply*/
       }
       return;
     }
@@ -397,25 +341,22 @@ void sr_handle_ip_packet(struct sr_instance *sr,
     {
       /* Reenviar paquete ICMP */
 
-      /* Decrementar TTL y recalcular checksum */
-      ip_header->ip_ttl--;
-      ip_header->ip_sum = 0;
-      ip_header->ip_sum = ip_cksum(ip_header, sizeof(sr_ip_hdr_t));
+      /* Decrementar TTL y actualizar el checksum de forma incremental */
+      ip_decrement_ttl(ip_header);
 
-      /* Obtener la dirección MAC del siguiente salto usando ARP */
-      struct sr_arpentry *arp_entry = sr_arpcache_lookup(&sr->cache, arp_ip_dest);
-      if (arp_entry)
+      /* Reescribir la cabecera Ethernet si se conoce la MAC del siguiente salto */
+      if (adj_state == SR_ADJ_OK)
       {
         /* Reenviar el paquete si la dirección MAC está disponible */
-        fprintf(stdout, "Reenviando el paquete al siguiente salto.\n");
-        sr_forward_packet(sr, packet, len, arp_entry->mac, rt_match->interface);
-        free(arp_entry);
+        sr_log_debug("Reenviando el paquete al siguiente salto.\n");
+        sr_adj_apply(&adj, packet);
+        sr_send_packet_if(sr, packet, len, adj.iface);
       }
       else
       {
         /* Solicitar ARP si no se conoce la dirección MAC */
-        fprintf(stdout, "Solicitando ARP para la dirección %u.\n", ntohl(arp_ip_dest));
-        struct sr_arpreq *req = sr_arpcache_queuereq(&sr->cache, arp_ip_dest, packet, len, interface);
+        sr_log_debug("Solicitando ARP para la dirección %u.\n", ntohl(adj.next_hop));
+        struct sr_arpreq *req = sr_arpcache_queuereq(&sr->cache, adj.next_hop, packet, len, adj.ifindex);
         handle_arpreq(sr, req);
       }
     }
@@ -427,31 +368,28 @@ void sr_handle_ip_packet(struct sr_instance *sr,
     {
       /* Descartar el paquete y enviar codigo de error */
       sr_send_icmp_error_packet(3, 3, sr, ip_src, packet); /*Tipo 3 (Destination unreachable), Código 3 (Port Unreachable)*/
-      fprintf(stdout, "Paquete ICMP no reconocido. Descartando paquete.\n");
+      sr_log_debug("Paquete ICMP no reconocido. Descartando paquete.\n");
       return;
     }
     else
     {
       /* Reenviar el paquete */
-      /* Decrementar TTL y recalcular checksum */
-      ip_header->ip_ttl--;
-      ip_header->ip_sum = 0;
-      ip_header->ip_sum = ip_cksum(ip_header, sizeof(sr_ip_hdr_t));
-
-      /* Obtener la dirección MAC del siguiente salto usando ARP */
-      struct sr_arpentry *arp_entry = sr_arpcache_lookup(&sr->cache, arp_ip_dest);
-      if (arp_entry)
+      /* Decrementar TTL y actualizar el checksum de forma incremental */
+      ip_decrement_ttl(ip_header);
+
+      /* Reescribir la cabecera Ethernet si se conoce la MAC del siguiente salto */
+      if (adj_state == SR_ADJ_OK)
       {
         /* Reenviar el paquete si la dirección MAC está disponible */
-        fprintf(stdout, "Reenviando el paquete al siguiente salto.\n");
-        sr_forward_packet(sr, packet, len, arp_entry->mac, rt_match->interface);
-        free(arp_entry);
+        sr_log_debug("Reenviando el paquete al siguiente salto.\n");
+        sr_adj_apply(&adj, packet);
+        sr_send_packet_if(sr, packet, len, adj.iface);
       }
       else
       {
         /* Solicitar ARP si no se conoce la dirección MAC */
-        fprintf(stdout, "Solicitando ARP para la dirección %u.\n", ntohl(arp_ip_dest));
-        struct sr_arpreq *req = sr_arpcache_queuereq(&sr->cache, arp_ip_dest, packet, len, interface);
+        sr_log_debug("Solicitando ARP para la dirección %u.\n", ntohl(adj.next_hop));
+        struct sr_arpreq *req = sr_arpcache_queuereq(&sr->cache, adj.next_hop, packet, len, adj.ifindex);
         handle_arpreq(sr, req);
       }
     }
@@ -473,7 +411,6 @@ void sr_arp_reply_send_pending_packets(struct sr_instance *sr,
 
   struct sr_packet *currPacket = arpReq->packets;
   sr_ethernet_hdr_t *ethHdr;
-  uint8_t *copyPacket;
 
   while (currPacket != NULL)
   {
@@ -481,11 +418,13 @@ void sr_arp_reply_send_pending_packets(struct sr_instance *sr,
     memcpy(ethHdr->ether_shost, dhost, sizeof(uint8_t) * ETHER_ADDR_LEN);
     memcpy(ethHdr->ether_dhost, shost, sizeof(uint8_t) * ETHER_ADDR_LEN);
 
-    copyPacket = malloc(sizeof(uint8_t) * currPacket->len);
-    memcpy(copyPacket, ethHdr, sizeof(uint8_t) * currPacket->len);
-
-    print_hdrs(copyPacket, currPacket->len);
-    sr_send_packet(sr, copyPacket, currPacket->len, iface->name);
+    /* El buffer encolado pasa a la cola de envío, sin copiarlo */
+    if (sr_log_enabled(SR_LOG_TRACE))
+    {
+      print_hdrs(currPacket->buf, currPacket->len);
+    }
+    sr_send_frame(sr, currPacket->buf, currPacket->len, iface);
+    currPacket->buf = NULL;
     currPacket = currPacket->next;
   }
 }
@@ -496,13 +435,16 @@ void sr_handle_arp_packet(struct sr_instance *sr,
                           unsigned int len,
                           uint8_t *srcAddr,
                           uint8_t *destAddr,
-                          char *interface /* lent */,
+                          struct sr_if *rxInterface /* lent */,
                           sr_ethernet_hdr_t *eHdr)
 {
 
   /* Imprimo el cabezal ARP */
-  printf("*** -> It is an ARP packet. Print ARP header.\n");
-  print_hdr_arp(packet + sizeof(sr_ethernet_hdr_t));
+  sr_log_trace("*** -> It is an ARP packet. Print ARP header.\n");
+  if (sr_log_enabled(SR_LOG_TRACE))
+  {
+    print_hdr_arp(packet + sizeof(sr_ethernet_hdr_t));
+  }
 
   /* Obtengo el cabezal ARP */
   sr_arp_hdr_t *arpHdr = (sr_arp_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
@@ -520,21 +462,67 @@ void sr_handle_arp_packet(struct sr_instance *sr,
   /* Verifico si el paquete ARP es para una de mis interfaces */
   struct sr_if *myInterface = sr_get_interface_given_ip(sr, targetIP);
 
+  /* Contadores de la interfaz por la que llegó */
+  if (op == arp_op_request)
+  {
+    __atomic_fetch_add(&(rxInterface->arp_rx_requests), 1, __ATOMIC_RELAXED);
+  }
+  else if (op == arp_op_reply)
+  {
+    __atomic_fetch_add(&(rxInterface->arp_rx_replies), 1, __ATOMIC_RELAXED);
+  }
+
+  /* Aprendo el mapeo MAC->IP del sender. Si el ARP es para mí lo agrego
+     siempre; si no, sólo con gleaning y si el sender es de la red por la
+     que llegó (una sonda con sender 0.0.0.0 no enseña nada) */
+  struct sr_arpreq *arpReq = NULL;
+  if ((op == arp_op_request) || (op == arp_op_reply))
+  {
+    if (myInterface != 0)
+    {
+      sr_log_trace("***** -> Add MAC->IP mapping of sender to my ARP cache.\n");
+      arpReq = sr_arpcache_insert(&(sr->cache), senderHardAddr, senderIP);
+    }
+    else if ((sr->arp_glean != SR_ARP_GLEAN_OFF) &&
+             (senderIP != 0) && (((senderIP ^ rxInterface->ip) & rxInterface->mask) == 0))
+    {
+      sr_log_trace("***** -> Glean MAC->IP mapping of sender.\n");
+      if (sr->arp_glean == SR_ARP_GLEAN_ALL)
+      {
+        arpReq = sr_arpcache_insert(&(sr->cache), senderHardAddr, senderIP);
+      }
+      else
+      {
+        arpReq = sr_arpcache_glean(&(sr->cache), senderHardAddr, senderIP);
+      }
+    }
+  }
+
+  /* Un pedido pendiente satisfecho así, sea por un request o un reply,
+     libera sus paquetes por la interfaz en la que se resolvía */
+  if (arpReq != NULL)
+  {
+    struct sr_if *outInterface = sr_get_interface_by_index(sr, arpReq->ifindex);
+
+    if (outInterface != 0)
+    {
+      sr_log_trace("****** -> Send outstanding packets.\n");
+      sr_arp_reply_send_pending_packets(sr, arpReq, (uint8_t *)outInterface->addr, (uint8_t *)senderHardAddr, outInterface);
+    }
+    sr_arpreq_destroy(&(sr->cache), arpReq);
+  }
+
   if (op == arp_op_request)
   { /* Si es un request ARP */
-    printf("**** -> It is an ARP request.\n");
+    sr_log_trace("**** -> It is an ARP request.\n");
 
     /* Si el ARP request es para una de mis interfaces */
     if (myInterface != 0)
     {
-      printf("***** -> ARP request is for one of my interfaces.\n");
-
-      /* Agrego el mapeo MAC->IP del sender a mi caché ARP */
-      printf("****** -> Add MAC->IP mapping of sender to my ARP cache.\n");
-      sr_arpcache_insert(&(sr->cache), senderHardAddr, senderIP);
+      sr_log_trace("***** -> ARP request is for one of my interfaces.\n");
 
       /* Construyo un ARP reply y lo envío de vuelta */
-      printf("****** -> Construct an ARP reply and send it back.\n");
+      sr_log_trace("****** -> Construct an ARP reply and send it back.\n");
       memcpy(eHdr->ether_shost, (uint8_t *)myInterface->addr, sizeof(uint8_t) * ETHER_ADDR_LEN);
       memcpy(eHdr->ether_dhost, (uint8_t *)senderHardAddr, sizeof(uint8_t) * ETHER_ADDR_LEN);
       memcpy(arpHdr->ar_sha, myInterface->addr, ETHER_ADDR_LEN);
@@ -544,44 +532,35 @@ void sr_handle_arp_packet(struct sr_instance *sr,
       arpHdr->ar_op = htons(arp_op_reply);
 
       /* Imprimo el cabezal del ARP reply creado */
-      print_hdrs(packet, len);
+      if (sr_log_enabled(SR_LOG_TRACE))
+      {
+        print_hdrs(packet, len);
+      }
 
-      sr_send_packet(sr, packet, len, myInterface->name);
+      __atomic_fetch_add(&(myInterface->arp_tx_replies), 1, __ATOMIC_RELAXED);
+      sr_send_packet_if(sr, packet, len, myInterface);
     }
 
-    printf("******* -> ARP request processing complete.\n");
+    sr_log_trace("******* -> ARP request processing complete.\n");
   }
   else if (op == arp_op_reply)
   { /* Si es un reply ARP */
-
-    printf("**** -> It is an ARP reply.\n");
-
-    /* Agrego el mapeo MAC->IP del sender a mi caché ARP */
-    printf("***** -> Add MAC->IP mapping of sender to my ARP cache.\n");
-    struct sr_arpreq *arpReq = sr_arpcache_insert(&(sr->cache), senderHardAddr, senderIP);
-
-    if (arpReq != NULL)
-    { /* Si hay paquetes pendientes */
-
-      printf("****** -> Send outstanding packets.\n");
-      sr_arp_reply_send_pending_packets(sr, arpReq, (uint8_t *)myInterface->addr, (uint8_t *)senderHardAddr, myInterface);
-      sr_arpreq_destroy(&(sr->cache), arpReq);
-    }
-    printf("******* -> ARP reply processing complete.\n");
+    sr_log_trace("**** -> It is an ARP reply.\n");
+    sr_log_trace("******* -> ARP reply processing complete.\n");
   }
 }
 
 /*---------------------------------------------------------------------
- * Method: sr_handlepacket(uint8_t* p,char* interface)
+ * Method: sr_handlepacket(uint8_t* p,struct sr_if* iface)
  * Scope:  Global
  *
  * This method is called each time the router receives a packet on the
  * interface.  The packet buffer, the packet length and the receiving
- * interface are passed in as parameters. The packet is complete with
- * ethernet headers.
+ * interface, already resolved by sr_vns_comm.c, are passed in as
+ * parameters. The packet is complete with ethernet headers.
  *
- * Note: Both the packet buffer and the character's memory are handled
- * by sr_vns_comm.c that means do NOT delete either.  Make a copy of the
+ * Note: The packet buffer is handled by sr_vns_comm.c that means do NOT
+ * delete it.  Make a copy of the
  * packet instead if you intend to keep it around beyond the scope of
  * the method call.
  *
@@ -590,18 +569,18 @@ void sr_handle_arp_packet(struct sr_instance *sr,
 void sr_handlepacket(struct sr_instance *sr,
                      uint8_t *packet /* lent */,
                      unsigned int len,
-                     char *interface /* lent */)
+                     struct sr_if *iface /* lent */)
 {
   assert(sr);
   assert(packet);
-  assert(interface);
+  assert(iface);
 
-  printf("*** -> Received packet of length %d \n", len);
+  sr_log_trace("*** -> Received packet of length %d \n", len);
 
   /* Obtengo direcciones MAC origen y destino */
   sr_ethernet_hdr_t *eHdr = (sr_ethernet_hdr_t *)packet;
-  uint8_t *destAddr = malloc(sizeof(uint8_t) * ETHER_ADDR_LEN);
-  uint8_t *srcAddr = malloc(sizeof(uint8_t) * ETHER_ADDR_LEN);
+  uint8_t destAddr[ETHER_ADDR_LEN];
+  uint8_t srcAddr[ETHER_ADDR_LEN];
   memcpy(destAddr, eHdr->ether_dhost, sizeof(uint8_t) * ETHER_ADDR_LEN);
   memcpy(srcAddr, eHdr->ether_shost, sizeof(uint8_t) * ETHER_ADDR_LEN);
   uint16_t pktType = ntohs(eHdr->ether_type);
@@ -610,11 +589,11 @@ void sr_handlepacket(struct sr_instance *sr,
   {
     if (pktType == ethertype_arp)
     {
-      sr_handle_arp_packet(sr, packet, len, srcAddr, destAddr, interface, eHdr);
+      sr_handle_arp_packet(sr, packet, len, srcAddr, destAddr, iface, eHdr);
     }
     else if (pktType == ethertype_ip)
     {
-      sr_handle_ip_packet(sr, packet, len, srcAddr, destAddr, interface, eHdr);
+      sr_handle_ip_packet(sr, packet, len, srcAddr, destAddr, iface, eHdr);
     }
   }
 
@@ -14,7 +14,10 @@
 #include <stdio.h>
 
 #include "sr_protocol.h"
+#include "sr_if.h"
 #include "sr_arpcache.h"
+#include "sr_fib.h"
+#include "sr_adj.h"
 
 /* we dont like this debug , but what to do for varargs ? */
 #ifdef _DEBUG_
@@ -35,6 +38,8 @@ struct sr_if;
 struct sr_rt;
 
 struct pwospf_subsys;
+struct sr_vns_io;
+struct sr_capture;
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -46,16 +51,31 @@ struct pwospf_subsys;
 struct sr_instance
 {
     int  sockfd;   /* socket to server */
+    struct sr_vns_io* vns_io; /* buffered I/O on sockfd */
     char user[32]; /* user name */
     char host[32]; /* host name */ 
     char template[30]; /* template name if any */
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
-    struct sr_rt* routing_table; /* routing table */
+    struct sr_if* if_index[SR_IF_MAX]; /* ifindex -> interface, 0 if absent */
+    char if_names[SR_IF_MAX][sr_IFACE_NAMELEN]; /* ifindex -> name */
+    unsigned int if_count; /* ifindexes handed out */
+    struct sr_rt* routing_table; /* routing table, read under sr_rt_read_lock */
+    struct sr_fib* fib; /* prefix index over routing_table */
+    pthread_mutex_t rt_lock; /* serializes routing table writers */
+    unsigned long rt_epoch; /* grace period counter */
+    unsigned long rt_readers[2]; /* readers inside each epoch parity */
+    unsigned long rt_gen; /* bumped on every routing table swap */
+    unsigned long rt_local_gen; /* bumped when connected or static routes may change */
+    struct sr_timer_wheel timers; /* per-object timeouts */
     struct sr_arpcache cache;   /* ARP cache */
+    unsigned int arp_cache_size; /* ARP cache capacity, in entries */
+    int arp_queue_policy; /* SR_ARPQ_DROP_OLDEST or SR_ARPQ_DROP_NEWEST */
+    int arp_glean; /* SR_ARP_GLEAN_OFF, _UPDATE or _ALL */
+    struct sr_adj_table adj; /* next hop rewrites */
     pthread_attr_t attr;
-    FILE* logfile;
+    struct sr_capture* capture; /* -l packet capture, 0 if off */
 
     /* -- pwospf subsystem -- */
     struct pwospf_subsys* ospf_subsys;
@@ -66,15 +86,21 @@ int sr_verify_routing_table(struct sr_instance* sr);
 
 /* -- sr_vns_comm.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_packet_if(struct sr_instance* , uint8_t* , unsigned int , struct sr_if*);
+int sr_send_frame(struct sr_instance* , uint8_t* , unsigned int , struct sr_if*);
+uint8_t* sr_frame_alloc(unsigned int);
+void sr_frame_free(uint8_t*);
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
+void sr_vns_print_stats(struct sr_instance* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
-void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
-void sr_handle_arp_packet(struct sr_instance*, uint8_t *, unsigned int, uint8_t *, uint8_t *, char *, sr_ethernet_hdr_t *);
-void sr_handle_ip_packet(struct sr_instance*, uint8_t *, unsigned int, uint8_t *, uint8_t *, char *, sr_ethernet_hdr_t *);
+void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , struct sr_if* );
+void sr_handle_arp_packet(struct sr_instance*, uint8_t *, unsigned int, uint8_t *, uint8_t *, struct sr_if *, sr_ethernet_hdr_t *);
+void sr_handle_ip_packet(struct sr_instance*, uint8_t *, unsigned int, uint8_t *, uint8_t *, struct sr_if *, sr_ethernet_hdr_t *);
 void sr_send_icmp_error_packet(uint8_t, uint8_t, struct sr_instance*, uint32_t, uint8_t*);
+int sr_find_rt_entry(struct sr_instance*, uint32_t, struct sr_rt*);
 
 /* -- sr_if.c -- */
 void sr_add_interface(struct sr_instance* , const char* );
@@ -5,6 +5,16 @@
  *
  * Description:
  *
+ * Writers build a complete new list (and its FIB) under sr->rt_lock,
+ * publish it with a single pointer store and free the old one once every
+ * reader that could still see it has left its read-side section. Readers
+ * never block.
+ *
+ * Dynamic route updates are the exception: they are spliced into the
+ * published list one link store at a time, and the FIB is derived from
+ * the published one by copying only the trie paths that change. Entries
+ * and nodes taken out are freed after the same grace period.
+ *
  *---------------------------------------------------------------------------*/
 
 #include <stdio.h>
@@ -12,6 +22,7 @@
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
+#include <sched.h>
 
 
 #include <sys/socket.h>
@@ -20,8 +31,511 @@
 #include <arpa/inet.h>
 
 #include "sr_rt.h"
+#include "sr_fib.h"
 #include "sr_router.h"
 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_init
+ *
+ * Set up an empty, published routing table and its grace period state
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_init(struct sr_instance* sr)
+{
+    assert(sr);
+
+    sr->routing_table = 0;
+    sr->fib = (struct sr_fib*)malloc(sizeof(struct sr_fib));
+    assert(sr->fib);
+    sr_fib_init(sr->fib);
+
+    pthread_mutex_init(&(sr->rt_lock), 0);
+    sr->rt_epoch = 0;
+    sr->rt_readers[0] = 0;
+    sr->rt_readers[1] = 0;
+    sr->rt_gen = 0;
+    sr->rt_local_gen = 0;
+} /* -- sr_rt_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_read_lock
+ *
+ * Enter a read-side section. Everything reachable from sr->routing_table
+ * and sr->fib stays allocated until the matching sr_rt_read_unlock.
+ * Sections may nest and never wait on writers.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned long sr_rt_read_lock(struct sr_instance* sr)
+{
+    unsigned long epoch;
+
+    while (1)
+    {
+        epoch = __atomic_load_n(&(sr->rt_epoch), __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&(sr->rt_readers[epoch & 1]), 1, __ATOMIC_SEQ_CST);
+
+        /* -- a writer flipped the epoch under us, count again -- */
+        if (__atomic_load_n(&(sr->rt_epoch), __ATOMIC_SEQ_CST) == epoch)
+        { return epoch; }
+
+        __atomic_fetch_sub(&(sr->rt_readers[epoch & 1]), 1, __ATOMIC_SEQ_CST);
+    }
+} /* -- sr_rt_read_lock -- */
+
+void sr_rt_read_unlock(struct sr_instance* sr, unsigned long epoch)
+{
+    __atomic_fetch_sub(&(sr->rt_readers[epoch & 1]), 1, __ATOMIC_SEQ_CST);
+} /* -- sr_rt_read_unlock -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_synchronize
+ *
+ * Wait until every reader that entered before the call has left.
+ * Writers only, with sr->rt_lock held.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rt_synchronize(struct sr_instance* sr)
+{
+    unsigned long epoch = __atomic_load_n(&(sr->rt_epoch), __ATOMIC_SEQ_CST);
+
+    __atomic_store_n(&(sr->rt_epoch), epoch + 1, __ATOMIC_SEQ_CST);
+
+    while (__atomic_load_n(&(sr->rt_readers[epoch & 1]), __ATOMIC_SEQ_CST) != 0)
+    { sched_yield(); }
+} /* -- sr_rt_synchronize -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_swap
+ *
+ * Index table, publish it and reclaim the previous one. local says
+ * whether directly connected or static routes may have changed too.
+ * Writers only, with sr->rt_lock held.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rt_swap(struct sr_instance* sr, struct sr_rt* table, int local)
+{
+    struct sr_rt* old_table = sr->routing_table;
+    struct sr_fib* old_fib = sr->fib;
+    struct sr_fib* fib;
+    struct sr_rt* entry;
+
+    fib = (struct sr_fib*)malloc(sizeof(struct sr_fib));
+    assert(fib);
+    sr_fib_init(fib);
+    for (entry = table; entry != NULL; entry = entry->next)
+    { sr_fib_insert(fib, entry); }
+
+    __atomic_store_n(&(sr->fib), fib, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&(sr->routing_table), table, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&(sr->rt_gen), 1, __ATOMIC_SEQ_CST);
+    if (local)
+    { __atomic_add_fetch(&(sr->rt_local_gen), 1, __ATOMIC_SEQ_CST); }
+
+    sr_rt_synchronize(sr);
+
+    sr_fib_clear(old_fib);
+    free(old_fib);
+    sr_rt_list_free(old_table);
+} /* -- sr_rt_swap -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_copy
+ *
+ * Private copy of the entries of list whose admin distance is at most
+ * max_admin_dst, leaving out skip.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rt* sr_rt_copy(struct sr_rt* list, uint8_t max_admin_dst,
+                                struct sr_rt* skip)
+{
+    struct sr_rt* copy = 0;
+    struct sr_rt** tail = &copy;
+
+    /* -- appending at the tail keeps the copy linear in the table size -- */
+    for (; list != NULL; list = list->next)
+    {
+        if ((list != skip) && (list->admin_dst <= max_admin_dst))
+        {
+            sr_rt_list_append(tail, list->dest, list->gw, list->mask,
+                              list->ifindex, list->admin_dst);
+            tail = &((*tail)->next);
+        }
+    }
+
+    return copy;
+} /* -- sr_rt_copy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_publish
+ *
+ * Replace the whole routing table with table, which is consumed.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_publish(struct sr_instance* sr, struct sr_rt* table)
+{
+    assert(sr);
+
+    pthread_mutex_lock(&(sr->rt_lock));
+    sr_rt_swap(sr, table, 1);
+    pthread_mutex_unlock(&(sr->rt_lock));
+} /* -- sr_rt_publish -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_splice_dynamic
+ *
+ * Publish the directly connected and static routes followed by routes,
+ * which is consumed. Writers only, with sr->rt_lock held.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rt_splice_dynamic(struct sr_instance* sr, struct sr_rt* routes)
+{
+    struct sr_rt* table;
+    struct sr_rt* tail;
+
+    table = sr_rt_copy(sr->routing_table, 1, 0);
+    if (table == 0)
+    {
+        table = routes;
+    }
+    else
+    {
+        for (tail = table; tail->next != NULL; tail = tail->next);
+        tail->next = routes;
+    }
+    sr_rt_swap(sr, table, 0);
+} /* -- sr_rt_splice_dynamic -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_replace_dynamic
+ *
+ * Keep the directly connected and static routes, replace every dynamic
+ * route with the ones in routes, which is consumed.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_replace_dynamic(struct sr_instance* sr, struct sr_rt* routes)
+{
+    assert(sr);
+
+    pthread_mutex_lock(&(sr->rt_lock));
+    sr_rt_splice_dynamic(sr, routes);
+    pthread_mutex_unlock(&(sr->rt_lock));
+} /* -- sr_rt_replace_dynamic -- */
+
+static int sr_rt_cmp_dest(const void* a, const void* b)
+{
+    const struct sr_rt* ra = *(struct sr_rt* const*)a;
+    const struct sr_rt* rb = *(struct sr_rt* const*)b;
+    uint32_t da = ntohl(ra->dest.s_addr);
+    uint32_t db = ntohl(rb->dest.s_addr);
+
+    if (da != db)
+    { return (da > db) - (da < db); }
+
+    da = ntohl(ra->mask.s_addr);
+    db = ntohl(rb->mask.s_addr);
+    return (da > db) - (da < db);
+} /* -- sr_rt_cmp_dest -- */
+
+/* -- sorted array of the entries of list with admin distance above 1 -- */
+static struct sr_rt** sr_rt_sorted_dynamic(struct sr_rt* list, unsigned int* count)
+{
+    struct sr_rt** sorted;
+    struct sr_rt* entry;
+    unsigned int n = 0;
+
+    for (entry = list; entry != NULL; entry = entry->next)
+    {
+        if (entry->admin_dst > 1)
+        { n++; }
+    }
+
+    sorted = (struct sr_rt**)malloc((n + 1) * sizeof(struct sr_rt*));
+    assert(sorted);
+
+    n = 0;
+    for (entry = list; entry != NULL; entry = entry->next)
+    {
+        if (entry->admin_dst > 1)
+        { sorted[n++] = entry; }
+    }
+    qsort(sorted, n, sizeof(struct sr_rt*), sr_rt_cmp_dest);
+
+    *count = n;
+    return sorted;
+} /* -- sr_rt_sorted_dynamic -- */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rt_change
+ *
+ * A published entry taken out by a dynamic update and the entry that
+ * takes its place in the list, 0 for a withdrawn route.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rt_change
+{
+    struct sr_rt* old;
+    struct sr_rt* new;
+};
+
+static int sr_rt_cmp_change(const void* a, const void* b)
+{
+    uintptr_t pa = (uintptr_t)((const struct sr_rt_change*)a)->old;
+    uintptr_t pb = (uintptr_t)((const struct sr_rt_change*)b)->old;
+
+    return (pa > pb) - (pa < pb);
+} /* -- sr_rt_cmp_change -- */
+
+/* -- orders routes by the prefix they index in the FIB -- */
+static int sr_rt_cmp_prefix(const void* a, const void* b)
+{
+    const struct sr_rt* ra = *(struct sr_rt* const*)a;
+    const struct sr_rt* rb = *(struct sr_rt* const*)b;
+    uint32_t da = ntohl(ra->dest.s_addr & ra->mask.s_addr);
+    uint32_t db = ntohl(rb->dest.s_addr & rb->mask.s_addr);
+
+    if (da != db)
+    { return (da > db) - (da < db); }
+
+    da = ntohl(ra->mask.s_addr);
+    db = ntohl(rb->mask.s_addr);
+    return (da > db) - (da < db);
+} /* -- sr_rt_cmp_prefix -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_apply_dynamic
+ *
+ * Publish the nchanges replacements and withdrawals in changes and the
+ * new routes in added, which are consumed. The list is relinked in
+ * place, since readers only ever follow links and each store swaps one
+ * whole entry. The FIB is derived from the published one: the old routes
+ * are taken out, then every entry of the new list whose prefix was
+ * touched is offered again in list order, so each of those prefixes
+ * ends up with the first-entry-wins route a rebuild would give it and
+ * only their trie paths are copied. Writers only, with sr->rt_lock held.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rt_apply_dynamic(struct sr_instance* sr,
+                                struct sr_rt_change* changes,
+                                unsigned int nchanges, struct sr_rt* added)
+{
+    struct sr_fib* old_fib = sr->fib;
+    struct sr_fib* fib;
+    struct sr_rt** touched;
+    struct sr_rt** link;
+    struct sr_rt* entry;
+    struct sr_rt_change key;
+    struct sr_rt_change* change;
+    unsigned int ntouched = 0;
+    unsigned int i;
+
+    touched = (struct sr_rt**)malloc((nchanges + 1) * sizeof(struct sr_rt*));
+    assert(touched);
+    for (i = 0; i < nchanges; i++)
+    { touched[ntouched++] = changes[i].old; }
+    qsort(touched, ntouched, sizeof(struct sr_rt*), sr_rt_cmp_prefix);
+
+    fib = (struct sr_fib*)malloc(sizeof(struct sr_fib));
+    assert(fib);
+    sr_fib_derive(fib, old_fib);
+    for (i = 0; i < nchanges; i++)
+    { sr_fib_remove(fib, changes[i].old); }
+
+    /* -- relink the list, then hang the new routes off its end -- */
+    qsort(changes, nchanges, sizeof(struct sr_rt_change), sr_rt_cmp_change);
+    link = &(sr->routing_table);
+    while ((entry = *link) != NULL)
+    {
+        key.old = entry;
+        change = (struct sr_rt_change*)bsearch(&key, changes, nchanges,
+                     sizeof(struct sr_rt_change), sr_rt_cmp_change);
+        if (change == 0)
+        {
+            if (bsearch(&entry, touched, ntouched, sizeof(struct sr_rt*),
+                        sr_rt_cmp_prefix) != 0)
+            { sr_fib_insert(fib, entry); }
+            link = &(entry->next);
+        }
+        else if (change->new != 0)
+        {
+            change->new->next = entry->next;
+            sr_fib_insert(fib, change->new);
+            __atomic_store_n(link, change->new, __ATOMIC_SEQ_CST);
+            link = &(change->new->next);
+        }
+        else
+        {
+            __atomic_store_n(link, entry->next, __ATOMIC_SEQ_CST);
+        }
+    }
+    for (entry = added; entry != NULL; entry = entry->next)
+    { sr_fib_insert(fib, entry); }
+    __atomic_store_n(link, added, __ATOMIC_SEQ_CST);
+
+    __atomic_store_n(&(sr->fib), fib, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&(sr->rt_gen), 1, __ATOMIC_SEQ_CST);
+
+    sr_rt_synchronize(sr);
+
+    /* -- old_fib's nodes live on in fib, only its header goes -- */
+    sr_fib_reclaim(fib);
+    free(old_fib);
+    for (i = 0; i < nchanges; i++)
+    { free(changes[i].old); }
+    free(touched);
+} /* -- sr_rt_apply_dynamic -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_update_dynamic
+ *
+ * Diff the dynamic routes in routes, which is consumed and holds only
+ * dynamic routes, against the published ones. Nothing is published when
+ * they are the same set; otherwise only the routes that were added,
+ * withdrawn or changed are published, see sr_rt_apply_dynamic. Returns
+ * their number.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_rt_update_dynamic(struct sr_instance* sr, struct sr_rt* routes)
+{
+    struct sr_rt** cur;
+    struct sr_rt** upd;
+    struct sr_rt_change* taken;
+    struct sr_rt* added = 0;
+    struct sr_rt** added_tail = &added;
+    unsigned int ncur, nupd, ntaken = 0;
+    unsigned int i = 0, j = 0;
+    unsigned int changes = 0;
+    int cmp;
+
+    assert(sr);
+
+    pthread_mutex_lock(&(sr->rt_lock));
+
+    cur = sr_rt_sorted_dynamic(sr->routing_table, &ncur);
+    upd = sr_rt_sorted_dynamic(routes, &nupd);
+    taken = (struct sr_rt_change*)malloc((ncur + 1) * sizeof(struct sr_rt_change));
+    assert(taken);
+
+    while ((i < ncur) || (j < nupd))
+    {
+        if (i == ncur)
+        { cmp = 1; }
+        else if (j == nupd)
+        { cmp = -1; }
+        else
+        { cmp = sr_rt_cmp_dest(&cur[i], &upd[j]); }
+
+        if (cmp < 0)
+        {
+            /* -- withdrawn -- */
+            taken[ntaken].old = cur[i++];
+            taken[ntaken++].new = 0;
+            changes++;
+        }
+        else if (cmp > 0)
+        {
+            /* -- new -- */
+            *added_tail = upd[j++];
+            added_tail = &((*added_tail)->next);
+            changes++;
+        }
+        else if ((cur[i]->gw.s_addr != upd[j]->gw.s_addr) ||
+                 (cur[i]->ifindex != upd[j]->ifindex) ||
+                 (cur[i]->admin_dst != upd[j]->admin_dst))
+        {
+            /* -- changed -- */
+            taken[ntaken].old = cur[i++];
+            taken[ntaken++].new = upd[j++];
+            changes++;
+        }
+        else
+        {
+            /* -- unchanged, the published entry stays -- */
+            free(upd[j++]);
+            i++;
+        }
+    }
+    *added_tail = 0;
+
+    if (changes != 0)
+    { sr_rt_apply_dynamic(sr, taken, ntaken, added); }
+
+    pthread_mutex_unlock(&(sr->rt_lock));
+
+    free(taken);
+    free(cur);
+    free(upd);
+
+    return changes;
+} /* -- sr_rt_update_dynamic -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_list_append
+ *
+ * Append a route to a private (unpublished) list
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_list_append(struct sr_rt** list, struct in_addr dest,
+struct in_addr gw, struct in_addr mask, unsigned int ifindex, uint8_t admin_dst)
+{
+    struct sr_rt* entry;
+
+    assert(list);
+
+    entry = (struct sr_rt*)malloc(sizeof(struct sr_rt));
+    assert(entry);
+    entry->next = 0;
+    entry->dest = dest;
+    entry->gw   = gw;
+    entry->mask = mask;
+    entry->ifindex = ifindex;
+    entry->admin_dst = admin_dst;
+
+    while (*list != NULL)
+    { list = &((*list)->next); }
+    *list = entry;
+} /* -- sr_rt_list_append -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_list_has
+ *
+ * Check route existance in a list
+ *
+ *---------------------------------------------------------------------*/
+
+uint8_t sr_rt_list_has(struct sr_rt* list, struct in_addr route)
+{
+    for (; list != NULL; list = list->next)
+    {
+        if (list->dest.s_addr == route.s_addr)
+        { return 1; }
+    }
+
+    return 0;
+} /* -- sr_rt_list_has -- */
+
+void sr_rt_list_free(struct sr_rt* list)
+{
+    struct sr_rt* next;
+
+    for (; list != NULL; list = next)
+    {
+        next = list->next;
+        free(list);
+    }
+} /* -- sr_rt_list_free -- */
+
 /*---------------------------------------------------------------------
  * Method:
  *
@@ -38,7 +552,10 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
     struct in_addr dest_addr;
     struct in_addr gw_addr;
     struct in_addr mask_addr;
+    unsigned int ifindex;
     int clear_routing_table = 0;
+    struct sr_rt* table = 0;
+    struct sr_rt** tail = &table;
 
     /* -- REQUIRES -- */
     assert(filename);
@@ -54,83 +571,96 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
     {
         sscanf(line,"%s %s %s %s",dest,gw,mask,iface);
         if(inet_aton(dest,&dest_addr) == 0)
-        { 
+        {
             fprintf(stderr,
                     "Error loading routing table, cannot convert %s to valid IP\n",
                     dest);
-            return -1; 
+            sr_rt_list_free(table);
+            return -1;
         }
         if(inet_aton(gw,&gw_addr) == 0)
-        { 
+        {
             fprintf(stderr,
                     "Error loading routing table, cannot convert %s to valid IP\n",
                     gw);
-            return -1; 
+            sr_rt_list_free(table);
+            return -1;
         }
         if(inet_aton(mask,&mask_addr) == 0)
-        { 
+        {
             fprintf(stderr,
                     "Error loading routing table, cannot convert %s to valid IP\n",
                     mask);
-            return -1; 
+            sr_rt_list_free(table);
+            return -1;
+        }
+        ifindex = sr_if_index(sr,iface);
+        if(ifindex >= SR_IF_MAX)
+        {
+            fprintf(stderr,
+                    "Error loading routing table, no ifindex left for %s\n",
+                    iface);
+            sr_rt_list_free(table);
+            return -1;
         }
         if( clear_routing_table == 0 ){
             printf("Loading routing table from server, clear local routing table.\n");
-            sr->routing_table = 0;
             clear_routing_table = 1;
         }
-        sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface, 0);
+        sr_rt_list_append(tail,dest_addr,gw_addr,mask_addr,ifindex,0);
+        tail = &((*tail)->next);
     } /* -- while -- */
 
+    if (clear_routing_table)
+    { sr_rt_publish(sr, table); }
+
     return 0; /* -- success -- */
 } /* -- sr_load_rt -- */
 
 /*---------------------------------------------------------------------
- * Method:
+ * Method: sr_rt_add_entries
+ *
+ * Append routes, which is consumed, to the table in a single swap, so
+ * adding n routes costs one copy, one FIB build and one grace period.
  *
  *---------------------------------------------------------------------*/
 
-void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
-struct in_addr gw, struct in_addr mask, char* if_name, uint8_t admin_dst)
+void sr_rt_add_entries(struct sr_instance* sr, struct sr_rt* routes)
 {
-    struct sr_rt* rt_walker = 0;
+    struct sr_rt* table;
+    struct sr_rt** tail;
 
     /* -- REQUIRES -- */
-    assert(if_name);
     assert(sr);
 
-    /* -- empty list special case -- */
-    if(sr->routing_table == 0)
-    {
-        sr->routing_table = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-        assert(sr->routing_table);
-        sr->routing_table->next = 0;
-        sr->routing_table->dest = dest;
-        sr->routing_table->gw   = gw;
-        sr->routing_table->mask = mask;
-        strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
-        sr->routing_table->admin_dst = admin_dst;
+    if (routes == 0)
+    { return; }
 
-        return;
-    }
+    pthread_mutex_lock(&(sr->rt_lock));
 
-    /* -- find the end of the list -- */
-    rt_walker = sr->routing_table;
-    while(rt_walker->next){
-      rt_walker = rt_walker->next; 
-    }
+    table = sr_rt_copy(sr->routing_table, 0xff, 0);
+    for (tail = &table; *tail != NULL; tail = &((*tail)->next));
+    *tail = routes;
+    sr_rt_swap(sr, table, 1);
+
+    pthread_mutex_unlock(&(sr->rt_lock));
+} /* -- sr_rt_add_entries -- */
 
-    rt_walker->next = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-    assert(rt_walker->next);
-    rt_walker = rt_walker->next;
+/*---------------------------------------------------------------------
+ * Method:
+ *
+ *---------------------------------------------------------------------*/
 
-    rt_walker->next = 0;
-    rt_walker->dest = dest;
-    rt_walker->gw   = gw;
-    rt_walker->mask = mask;
-    strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
-    rt_walker->admin_dst = admin_dst;
+void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
+struct in_addr gw, struct in_addr mask, unsigned int ifindex, uint8_t admin_dst)
+{
+    struct sr_rt* routes = 0;
 
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    sr_rt_list_append(&routes, dest, gw, mask, ifindex, admin_dst);
+    sr_rt_add_entries(sr, routes);
 } /* -- sr_add_entry -- */
 
 /*---------------------------------------------------------------------
@@ -141,10 +671,12 @@ struct in_addr gw, struct in_addr mask, char* if_name, uint8_t admin_dst)
 void sr_print_routing_table(struct sr_instance* sr)
 {
     struct sr_rt* rt_walker = 0;
+    unsigned long epoch = sr_rt_read_lock(sr);
 
     if(sr->routing_table == 0)
     {
         printf(" *warning* Routing table empty \n");
+        sr_rt_read_unlock(sr, epoch);
         return;
     }
 
@@ -153,14 +685,16 @@ void sr_print_routing_table(struct sr_instance* sr)
     printf("-----------------------------------------------------------------------\n");
 
     rt_walker = sr->routing_table;
-    
-    sr_print_routing_entry(rt_walker);
+
+    sr_print_routing_entry(sr, rt_walker);
     while(rt_walker->next)
     {
-        rt_walker = rt_walker->next; 
-        sr_print_routing_entry(rt_walker);
+        rt_walker = rt_walker->next;
+        sr_print_routing_entry(sr, rt_walker);
     }
 
+    sr_rt_read_unlock(sr, epoch);
+
 } /* -- sr_print_routing_table -- */
 
 /*---------------------------------------------------------------------
@@ -168,16 +702,15 @@ void sr_print_routing_table(struct sr_instance* sr)
  *
  *---------------------------------------------------------------------*/
 
-void sr_print_routing_entry(struct sr_rt* entry)
+void sr_print_routing_entry(struct sr_instance* sr, struct sr_rt* entry)
 {
     /* -- REQUIRES --*/
     assert(entry);
-    assert(entry->interface);
 
     printf("%-18s",inet_ntoa(entry->dest));
     printf("%-18s",inet_ntoa(entry->gw));
     printf("%-18s",inet_ntoa(entry->mask));
-    printf("%-8s",entry->interface);
+    printf("%-8s",sr_if_name(sr, entry->ifindex));
     printf("%d\n",entry->admin_dst);
 
 } /* -- sr_print_routing_entry -- */
@@ -185,13 +718,14 @@ void sr_print_routing_entry(struct sr_rt* entry)
 /*---------------------------------------------------------------------
  * Method: count_routes
  *
- * Counting directly connected and static routes in the routing table 
+ * Counting directly connected and static routes in the routing table
  *
  *---------------------------------------------------------------------*/
 
 int count_routes(struct sr_instance* sr)
 {
     int count = 0;
+    unsigned long epoch = sr_rt_read_lock(sr);
     struct sr_rt* entry = sr->routing_table;
     while(entry != NULL)
     {
@@ -201,59 +735,39 @@ int count_routes(struct sr_instance* sr)
         }
         entry = entry->next;
     }
+    sr_rt_read_unlock(sr, epoch);
     return count;
 } /* -- count_routes -- */
 
 /*---------------------------------------------------------------------
  * Method: clean_routes
  *
- * Clean the dynamic routes from the routing table 
+ * Clean the dynamic routes from the routing table
  *
  *---------------------------------------------------------------------*/
 
 void clear_routes(struct sr_instance* sr)
 {
-    struct sr_rt* entry = sr->routing_table;
-    while(entry/*->next*/ != NULL)
-    {
-/*printf("entry: %s\t", inet_ntoa(entry->dest));*/
-        if (entry->next == NULL)
-        {
-            break;
-        }
-/*printf("entry->next: %s\n", inet_ntoa(entry->next->dest));*/
-        if (entry->next->admin_dst > 1)
-        {
-            sr_del_rt_entry(entry);
-        }
-        else
-        {
-            entry = entry->next;
-        }
-    }
+    sr_rt_replace_dynamic(sr, 0);
 } /* -- clean_routes -- */
 
 /*---------------------------------------------------------------------
  * Method: sr_del_rt_entry
  *
- * Delete route
+ * Delete the route following previous_entry
  *
  *---------------------------------------------------------------------*/
 
-void sr_del_rt_entry(struct sr_rt* previous_entry)
+void sr_del_rt_entry(struct sr_instance* sr, struct sr_rt* previous_entry)
 {
-    struct sr_rt* temp = previous_entry->next;
+    struct sr_rt* table;
 
-    if (previous_entry->next->next != NULL)
-    {
-        previous_entry->next = previous_entry->next->next;
-    }
-    else
-    {
-        previous_entry->next = NULL;
-    }
+    pthread_mutex_lock(&(sr->rt_lock));
+
+    table = sr_rt_copy(sr->routing_table, 0xff, previous_entry->next);
+    sr_rt_swap(sr, table, 1);
 
-    free(temp);
+    pthread_mutex_unlock(&(sr->rt_lock));
 } /* -- sr_del_rt_entry -- */
 
 /*---------------------------------------------------------------------
@@ -265,16 +779,39 @@ void sr_del_rt_entry(struct sr_rt* previous_entry)
 
 uint8_t check_route(struct sr_instance* sr, struct in_addr route)
 {
+    unsigned long epoch = sr_rt_read_lock(sr);
+    uint8_t found = sr_rt_list_has(sr->routing_table, route);
+
+    sr_rt_read_unlock(sr, epoch);
+
+    return found;
+} /* -- check_route -- */
+
+/*---------------------------------------------------------------------
+ * Method: check_static_route
+ *
+ * Check existance of a directly connected or static route
+ *
+ *---------------------------------------------------------------------*/
+
+uint8_t check_static_route(struct sr_instance* sr, struct in_addr route)
+{
+    unsigned long epoch = sr_rt_read_lock(sr);
     struct sr_rt* entry = sr->routing_table;
+    uint8_t found = 0;
+
     while(entry != NULL)
     {
-        if (entry->dest.s_addr == route.s_addr)
+        if ((entry->admin_dst <= 1) && (entry->dest.s_addr == route.s_addr))
         {
-            return 1;
+            found = 1;
+            break;
         }
 
         entry = entry->next;
     }
 
-    return 0;
-} /* -- check_route -- */
+    sr_rt_read_unlock(sr, epoch);
+
+    return found;
+} /* -- check_static_route -- */
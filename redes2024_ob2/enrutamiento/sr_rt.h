@@ -32,7 +32,7 @@ struct sr_rt
     struct in_addr dest;
     struct in_addr gw;
     struct in_addr mask;
-    char   interface[sr_IFACE_NAMELEN];
+    unsigned int ifindex;
     struct sr_rt* next;
 
     /* New Field */
@@ -41,16 +41,29 @@ struct sr_rt
 };
 
 
+void sr_rt_init(struct sr_instance*);
+unsigned long sr_rt_read_lock(struct sr_instance*);
+void sr_rt_read_unlock(struct sr_instance*, unsigned long);
+void sr_rt_publish(struct sr_instance*, struct sr_rt*);
+void sr_rt_replace_dynamic(struct sr_instance*, struct sr_rt*);
+unsigned int sr_rt_update_dynamic(struct sr_instance*, struct sr_rt*);
+void sr_rt_list_append(struct sr_rt**, struct in_addr, struct in_addr,
+                  struct in_addr, unsigned int, uint8_t);
+uint8_t sr_rt_list_has(struct sr_rt*, struct in_addr);
+void sr_rt_list_free(struct sr_rt*);
+
 int sr_load_rt(struct sr_instance*,const char*);
 void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
-                  struct in_addr, char*, uint8_t);
+                  struct in_addr, unsigned int, uint8_t);
+void sr_rt_add_entries(struct sr_instance*, struct sr_rt*);
 void sr_print_routing_table(struct sr_instance* sr);
-void sr_print_routing_entry(struct sr_rt* entry);
+void sr_print_routing_entry(struct sr_instance* sr, struct sr_rt* entry);
 
 
 int count_routes(struct sr_instance*);
 void clear_routes(struct sr_instance*);
-void sr_del_rt_entry(struct sr_rt*);
+void sr_del_rt_entry(struct sr_instance*, struct sr_rt*);
 uint8_t check_route(struct sr_instance*, struct in_addr);
+uint8_t check_static_route(struct sr_instance*, struct in_addr);
 
 #endif  /* --  sr_RT_H -- */
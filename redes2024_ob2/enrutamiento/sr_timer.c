@@ -0,0 +1,309 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.c
+ *
+ * Description:
+ *
+ * Timer wheel, see sr_timer.h. Slots are doubly linked lists through
+ * the pprev pointer so a timer can be unlinked without knowing where it
+ * sits. Timers that come due are first moved to a list on the timer
+ * thread's stack, still linked, so that one cancelled by another thread
+ * before its turn is simply unlinked and never run.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "sr_timer.h"
+
+#define SR_TIMER_MASK (SR_TIMER_SLOTS - 1)
+#define SR_TIMER_SPAN (1UL << (SR_TIMER_BITS * SR_TIMER_LEVELS))
+
+static unsigned long sr_timer_clock_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sr_timer_link(struct sr_timer** head, struct sr_timer* t)
+{
+    t->next = *head;
+    if (*head != 0)
+    { (*head)->pprev = &(t->next); }
+    *head = t;
+    t->pprev = head;
+}
+
+static void sr_timer_unlink(struct sr_timer* t)
+{
+    *(t->pprev) = t->next;
+    if (t->next != 0)
+    { t->next->pprev = t->pprev; }
+    t->next = 0;
+    t->pprev = 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_place
+ *
+ * Put t in the slot for its expiry: the lowest level whose range,
+ * counted from now, still reaches it. Caller holds the lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_timer_place(struct sr_timer_wheel* wheel, struct sr_timer* t)
+{
+    unsigned long delta;
+    int level;
+
+    if ((long)(t->expires - wheel->now) < 0)
+    { t->expires = wheel->now; }
+
+    delta = t->expires - wheel->now;
+    if (delta >= SR_TIMER_SPAN)
+    {
+        delta = SR_TIMER_SPAN - 1;
+        t->expires = wheel->now + delta;
+    }
+
+    for (level = 0; level < SR_TIMER_LEVELS - 1; level++)
+    {
+        if (delta < (1UL << (SR_TIMER_BITS * (level + 1))))
+        { break; }
+    }
+
+    sr_timer_link(&(wheel->slots[level][(t->expires >> (SR_TIMER_BITS * level))
+                                        & SR_TIMER_MASK]), t);
+} /* -- sr_timer_place -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_cascade
+ *
+ * Move the timers of one higher level slot down to where they belong
+ * now. Returns the slot index, 0 meaning that level wrapped as well.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_timer_cascade(struct sr_timer_wheel* wheel, int level)
+{
+    unsigned int index = (wheel->now >> (SR_TIMER_BITS * level)) & SR_TIMER_MASK;
+    struct sr_timer* list = wheel->slots[level][index];
+    struct sr_timer* t;
+
+    wheel->slots[level][index] = 0;
+    while (list != 0)
+    {
+        t = list;
+        list = t->next;
+        sr_timer_place(wheel, t);
+    }
+
+    return index;
+} /* -- sr_timer_cascade -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_run_tick
+ *
+ * Run the timers due at tick now and advance. Called and returns with
+ * the lock held; drops it around each callback.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_timer_run_tick(struct sr_timer_wheel* wheel)
+{
+    unsigned int index = wheel->now & SR_TIMER_MASK;
+    struct sr_timer* due = 0;
+    struct sr_timer* t;
+    sr_timer_fn fn;
+    void* arg;
+    int level;
+
+    if (index == 0)
+    {
+        for (level = 1; level < SR_TIMER_LEVELS; level++)
+        {
+            if (sr_timer_cascade(wheel, level) != 0)
+            { break; }
+        }
+    }
+
+    /* -- take the whole slot, keeping it linked -- */
+    due = wheel->slots[0][index];
+    wheel->slots[0][index] = 0;
+    if (due != 0)
+    { due->pprev = &due; }
+    wheel->now++;
+
+    while (due != 0)
+    {
+        t = due;
+        sr_timer_unlink(t);
+        wheel->pending--;
+        wheel->fired++;
+        fn = t->fn;
+        arg = t->arg;
+
+        /* -- t may be re-armed or freed by fn, so it is not touched after -- */
+        pthread_mutex_unlock(&(wheel->lock));
+        fn(wheel->sr, arg);
+        pthread_mutex_lock(&(wheel->lock));
+    }
+} /* -- sr_timer_run_tick -- */
+
+static void* sr_timer_thread(void* arg)
+{
+    struct sr_timer_wheel* wheel = (struct sr_timer_wheel*)arg;
+    struct timespec tick;
+    unsigned long target;
+
+    tick.tv_sec = 0;
+    tick.tv_nsec = SR_TIMER_TICK_MS * 1000000L;
+
+    for (;;)
+    {
+        nanosleep(&tick, 0);
+
+        target = (sr_timer_clock_ms() - wheel->start_ms) / SR_TIMER_TICK_MS;
+
+        pthread_mutex_lock(&(wheel->lock));
+        while ((long)(target - wheel->now) >= 0)
+        { sr_timer_run_tick(wheel); }
+        pthread_mutex_unlock(&(wheel->lock));
+    }
+
+    return 0;
+} /* -- sr_timer_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_wheel_init
+ *
+ * Set up an empty wheel and start its thread. Callbacks get sr.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_wheel_init(struct sr_timer_wheel* wheel, struct sr_instance* sr)
+{
+    assert(wheel);
+
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+    pthread_mutex_init(&(wheel->lock), 0);
+    wheel->sr = sr;
+    wheel->now = 0;
+    wheel->start_ms = sr_timer_clock_ms();
+    wheel->pending = 0;
+    wheel->fired = 0;
+
+    if (pthread_create(&(wheel->thread), 0, sr_timer_thread, wheel))
+    {
+        perror("pthread_create");
+        assert(0);
+    }
+} /* -- sr_timer_wheel_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_init
+ *
+ * Set the callback of an unarmed timer.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_init(struct sr_timer* t, sr_timer_fn fn, void* arg)
+{
+    t->next = 0;
+    t->pprev = 0;
+    t->expires = 0;
+    t->fn = fn;
+    t->arg = arg;
+} /* -- sr_timer_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_mod
+ *
+ * Arm t to fire ms milliseconds from now, moving it if already armed.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_mod(struct sr_timer_wheel* wheel, struct sr_timer* t,
+                  unsigned long ms)
+{
+    assert(t->fn);
+
+    pthread_mutex_lock(&(wheel->lock));
+    if (t->pprev != 0)
+    { sr_timer_unlink(t); }
+    else
+    { wheel->pending++; }
+
+    t->expires = wheel->now + (ms + SR_TIMER_TICK_MS - 1) / SR_TIMER_TICK_MS;
+    sr_timer_place(wheel, t);
+    pthread_mutex_unlock(&(wheel->lock));
+} /* -- sr_timer_mod -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_del
+ *
+ * Disarm t. Returns 1 if it was armed. A callback already running is
+ * not waited for.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_timer_del(struct sr_timer_wheel* wheel, struct sr_timer* t)
+{
+    int armed;
+
+    pthread_mutex_lock(&(wheel->lock));
+    armed = (t->pprev != 0);
+    if (armed)
+    {
+        sr_timer_unlink(t);
+        wheel->pending--;
+    }
+    pthread_mutex_unlock(&(wheel->lock));
+
+    return armed;
+} /* -- sr_timer_del -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_pending
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_timer_pending(struct sr_timer_wheel* wheel, struct sr_timer* t)
+{
+    int armed;
+
+    pthread_mutex_lock(&(wheel->lock));
+    armed = (t->pprev != 0);
+    pthread_mutex_unlock(&(wheel->lock));
+
+    return armed;
+} /* -- sr_timer_pending -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_now_ms
+ *
+ * Milliseconds since the wheel was started, on the clock it runs on.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned long sr_timer_now_ms(struct sr_timer_wheel* wheel)
+{
+    return sr_timer_clock_ms() - wheel->start_ms;
+} /* -- sr_timer_now_ms -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_print_stats
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_print_stats(struct sr_timer_wheel* wheel)
+{
+    pthread_mutex_lock(&(wheel->lock));
+    fprintf(stderr, "Timers: %lu armed, %lu fired, %lu ms tick\n",
+            wheel->pending, wheel->fired, (unsigned long)SR_TIMER_TICK_MS);
+    pthread_mutex_unlock(&(wheel->lock));
+} /* -- sr_timer_print_stats -- */
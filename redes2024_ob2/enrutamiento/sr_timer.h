@@ -0,0 +1,66 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.h
+ *
+ * Description:
+ *
+ * Hierarchical timer wheel. Every object that times out (a neighbor, a
+ * topology entry, an ARP entry or request, an interface's next HELLO)
+ * arms its own timer for its own deadline, and one thread runs the
+ * callbacks as they come due. Arming, re-arming and cancelling are O(1)
+ * and the thread does work per expiring timer, not per object.
+ *
+ * Four levels of 64 slots cover 2^24 ticks of SR_TIMER_TICK_MS each;
+ * longer delays are clamped. A timer in a higher level is moved down a
+ * level each time the level below wraps around.
+ *
+ * Callbacks run on the timer thread with no lock held. A callback that
+ * takes its owner's lock should first check sr_timer_pending(): another
+ * thread may have re-armed the timer while it was waiting for the lock,
+ * in which case there is nothing to do.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TIMER_H
+#define SR_TIMER_H
+
+#include <pthread.h>
+
+#define SR_TIMER_TICK_MS 10     /* resolution */
+#define SR_TIMER_BITS    6      /* log2 of the slots per level */
+#define SR_TIMER_SLOTS   (1 << SR_TIMER_BITS)
+#define SR_TIMER_LEVELS  4
+
+struct sr_instance;
+
+typedef void (*sr_timer_fn)(struct sr_instance*, void*);
+
+struct sr_timer
+{
+    struct sr_timer* next;
+    struct sr_timer** pprev;    /* link pointing at us, 0 if not armed */
+    unsigned long expires;      /* tick */
+    sr_timer_fn fn;
+    void* arg;
+};
+
+struct sr_timer_wheel
+{
+    pthread_mutex_t lock;       /* guards everything below */
+    struct sr_instance* sr;     /* handed to every callback */
+    unsigned long now;          /* next tick to run */
+    unsigned long start_ms;     /* clock at tick 0 */
+    unsigned long pending;      /* timers armed */
+    unsigned long fired;        /* callbacks run */
+    struct sr_timer* slots[SR_TIMER_LEVELS][SR_TIMER_SLOTS];
+    pthread_t thread;
+};
+
+void sr_timer_wheel_init(struct sr_timer_wheel*, struct sr_instance*);
+void sr_timer_init(struct sr_timer*, sr_timer_fn fn, void* arg);
+void sr_timer_mod(struct sr_timer_wheel*, struct sr_timer*, unsigned long ms);
+int  sr_timer_del(struct sr_timer_wheel*, struct sr_timer*);
+int  sr_timer_pending(struct sr_timer_wheel*, struct sr_timer*);
+unsigned long sr_timer_now_ms(struct sr_timer_wheel*);
+void sr_timer_print_stats(struct sr_timer_wheel*);
+
+#endif /* -- SR_TIMER_H -- */
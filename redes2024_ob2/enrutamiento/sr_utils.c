@@ -4,22 +4,57 @@
 #include "sr_protocol.h"
 #include "pwospf_protocol.h"
 #include "sr_utils.h"
+#include "sr_cksum.h"
+#include "sr_log.h"
 
 
+/* Internet checksum (RFC 1071). The kernels in sr_cksum.c sum native-order
+   words; one's complement addition does not care about byte order, so the
+   folded and inverted sum is already in network order. */
 uint16_t cksum (const void *_data, int len) {
-  const uint8_t *data = _data;
-  uint32_t sum;
-
-  for (sum = 0;len >= 2; data += 2, len -= 2)
-    sum += data[0] << 8 | data[1];
-  if (len > 0)
-    sum += data[0] << 8;
-  while (sum > 0xffff)
-    sum = (sum >> 16) + (sum & 0xffff);
-  sum = htons (~sum);
+  return cksum_fold(sr_cksum_sum(_data, len));
+}
+
+/* Folds and inverts a sum from sr_cksum_sum. Sums of pieces that start at
+   even offsets add up, so a checksum can be built from cached parts. */
+uint16_t cksum_fold (uint64_t sum) {
+  uint16_t result;
+
+  sum = (sum >> 32) + (sum & 0xffffffff);
+  sum = (sum >> 32) + (sum & 0xffffffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  result = (uint16_t) ~sum;
+  return result ? result : 0xffff;
+}
+
+/* Incremental checksum update (RFC 1624, eqn. 3): the checksum sum covered
+   a 16-bit field that changed from old_word to new_word. All three are
+   taken as stored in the packet. Like cksum, never returns 0. */
+uint16_t cksum_update (uint16_t sum, uint16_t old_word, uint16_t new_word) {
+  uint32_t acc;
+
+  acc = (uint16_t) ~sum;
+  acc += (uint16_t) ~old_word;
+  acc += new_word;
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+  sum = (uint16_t) ~acc;
   return sum ? sum : 0xffff;
 }
 
+/* Decrement the TTL of a header whose checksum is known to be valid,
+   patching the checksum instead of recomputing it. */
+void ip_decrement_ttl (sr_ip_hdr_t *ipHdr) {
+  uint16_t oldWord, newWord;
+
+  memcpy(&oldWord, &(ipHdr->ip_ttl), 2);
+  ipHdr->ip_ttl--;
+  memcpy(&newWord, &(ipHdr->ip_ttl), 2);
+  ipHdr->ip_sum = cksum_update(ipHdr->ip_sum, oldWord, newWord);
+}
+
 uint32_t ip_cksum (sr_ip_hdr_t *ipHdr, int len) {
     uint16_t currChksum, calcChksum;
 
@@ -70,59 +105,59 @@ int is_packet_valid(uint8_t *packet /* lent */,
   int cumulative_sz = sizeof(sr_ethernet_hdr_t);
   sr_ethernet_hdr_t *eHdr = (sr_ethernet_hdr_t *) packet;
     
-  printf("*** -> Perform validation on the packet.\n");
+  sr_log_trace("*** -> Perform validation on the packet.\n");
 
   if (eHdr->ether_type == htons(ethertype_arp)) {
-    printf("**** -> Validate ARP packet.\n");
+    sr_log_trace("**** -> Validate ARP packet.\n");
     cumulative_sz += sizeof(sr_arp_hdr_t);
     if (len >= cumulative_sz) {
-      printf("***** -> Packet length is correct.\n");
+      sr_log_trace("***** -> Packet length is correct.\n");
       return 1;
     }
   } else if (eHdr->ether_type == htons(ethertype_ip)) {
-    printf("**** -> Validate IP packet.\n");
+    sr_log_trace("**** -> Validate IP packet.\n");
     sr_ip_hdr_t *ipHdr = (sr_ip_hdr_t *) (packet + cumulative_sz);
     cumulative_sz += sizeof(sr_ip_hdr_t);
 
     if (len >= cumulative_sz) {
-      printf("***** -> Packet length is correct.\n");
+      sr_log_trace("***** -> Packet length is correct.\n");
       if (ip_cksum(ipHdr, sizeof(sr_ip_hdr_t)) == ipHdr->ip_sum) {
-        printf("***** -> IP packet checksum is correct.\n");
+        sr_log_trace("***** -> IP packet checksum is correct.\n");
         if (ipHdr->ip_p == ip_protocol_icmp) {
-          printf("***** -> IP packet is ICMP packet. Validate ICMP packet.\n");
+          sr_log_trace("***** -> IP packet is ICMP packet. Validate ICMP packet.\n");
           int icmpOffset = cumulative_sz;
           sr_icmp_hdr_t *icmpHdr = (sr_icmp_hdr_t *) (packet + cumulative_sz);
           cumulative_sz += sizeof(sr_icmp_hdr_t);
 
           if (len >= cumulative_sz) {
-            printf("****** -> Packet length is correct.\n");
+            sr_log_trace("****** -> Packet length is correct.\n");
             if (icmp_cksum(icmpHdr, len - icmpOffset) == icmpHdr->icmp_sum) {
-              printf("****** -> ICMP packet checksum is correct.\n");
+              sr_log_trace("****** -> ICMP packet checksum is correct.\n");
               return 1;
             }
           }
         } else if (ipHdr->ip_p == ip_protocol_ospfv2) {
-          printf("***** -> IP packet is OSPF packet. Validate OSPF packet.\n");
+          sr_log_trace("***** -> IP packet is OSPF packet. Validate OSPF packet.\n");
           int ospfOffset = cumulative_sz;
           ospfv2_hdr_t *ospfHdr = (ospfv2_hdr_t *) (packet + cumulative_sz);
           cumulative_sz += sizeof(ospfv2_hdr_t);
 
           if (len >= cumulative_sz) {
-            printf("****** -> Packet length is correct.\n");
+            sr_log_trace("****** -> Packet length is correct.\n");
             if (ospfv2_cksum(ospfHdr, len - ospfOffset) == ospfHdr->csum) {
-              printf("****** -> OSPF packet checksum is correct.\n");
+              sr_log_trace("****** -> OSPF packet checksum is correct.\n");
               return 1;
             }
           }
         } else {
           /* TODO */
-          printf("***** -> IP packet is of unknown protocol. No further validation is required.\n");
+          sr_log_trace("***** -> IP packet is of unknown protocol. No further validation is required.\n");
 	        return 1;
         }
       }
     }
   }
-  printf("*** -> Packet validation complete. Packet is INVALID.\n");
+  sr_log_debug("*** -> Packet validation complete. Packet is INVALID.\n");
   return 0;
 }
 
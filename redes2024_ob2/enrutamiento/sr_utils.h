@@ -31,6 +31,9 @@
 #include "pwospf_protocol.h"
 
 uint16_t cksum(const void *_data, int len);
+uint16_t cksum_fold(uint64_t sum);
+uint16_t cksum_update(uint16_t sum, uint16_t old_word, uint16_t new_word);
+void ip_decrement_ttl(sr_ip_hdr_t *ipHdr);
 uint32_t ip_cksum (sr_ip_hdr_t *ipHdr, int len);
 uint32_t icmp_cksum (sr_icmp_hdr_t *icmpHdr, int len);
 uint32_t icmp3_cksum(sr_icmp_t3_hdr_t *icmp3_hdr, int len);
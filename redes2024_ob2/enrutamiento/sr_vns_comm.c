@@ -30,8 +30,10 @@
 #include <unistd.h>
 #include <netdb.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
@@ -41,6 +43,9 @@
 #include "sr_if.h"
 #include "sr_protocol.h"
 
+#include "sr_pool.h"
+#include "sr_capture.h"
+#include "sr_pwospf.h"
 #include "sha1.h"
 #include "vnscommand.h"
 
@@ -48,9 +53,58 @@ static void sr_log_packet(struct sr_instance* , uint8_t* , int );
 static int  sr_arp_req_not_for_us(struct sr_instance* sr,
                                   uint8_t * packet /* lent */,
                                   unsigned int len,
-                                  char* interface  /* lent */);
+                                  struct sr_if* iface  /* lent */);
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
 
+#define SR_VNS_RXBUF_SZ     65536   /* must hold the largest command (10000) */
+#define SR_VNS_TXBUF_SZ     65536
+#define SR_VNS_TXQ_LEN      64      /* frames per writev */
+#define SR_VNS_TX_FLUSH_US  1000    /* max time a frame waits in the queue */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_vns_io
+ *
+ * Buffered I/O on the server socket. One recv pulls in as many commands
+ * as the kernel has ready and they are then handed out one at a time
+ * from rx_buf. Outgoing frames are written with a single writev per
+ * batch: when the queue fills up, when the reader runs out of input, or
+ * SR_VNS_TX_FLUSH_US after the first frame was queued.
+ *
+ * Queued frames are never copied if they have room for the VNS header in
+ * front of them: frames from sr_frame_alloc, which the queue then owns,
+ * and received frames sent back out from rx_buf, whose own VNS header is
+ * rewritten. Anything else is staged in tx_buf.
+ *
+ * writev runs with tx_lock held, which keeps batches whole and in order
+ * but means that while the socket is slow every sender, the PWOSPF
+ * threads included, waits on the lock behind it.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_vns_io
+{
+    /* -- receive side, reader thread only -- */
+    unsigned char rx_buf[SR_VNS_RXBUF_SZ];
+    unsigned int rx_head;               /* first byte not yet handed out */
+    unsigned int rx_tail;               /* end of the bytes received */
+    unsigned long rx_msgs;
+    unsigned long rx_calls;
+
+    /* -- send side, guarded by tx_lock -- */
+    pthread_mutex_t tx_lock;
+    pthread_cond_t tx_cond;             /* queue went from empty to not */
+    unsigned char tx_buf[SR_VNS_TXBUF_SZ];
+    unsigned int tx_used;
+    struct iovec tx_iov[SR_VNS_TXQ_LEN];
+    uint8_t* tx_owned[SR_VNS_TXQ_LEN];  /* sr_frame_alloc frames to free */
+    unsigned int tx_count;
+    struct timespec tx_deadline;        /* flush the queue by then */
+    unsigned long tx_frames;            /* written out whole */
+    unsigned long tx_dropped;           /* lost to writev errors */
+    unsigned long tx_calls;
+    unsigned long tx_copied;            /* frame bytes staged in tx_buf */
+};
+
 /*-----------------------------------------------------------------------------
  * Method: sr_session_closed_help(..)
  *
@@ -61,6 +115,243 @@ static void sr_session_closed_help()
 {
 }
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_tx_flush_locked(..)
+ * Scope: Local
+ *
+ * Write every queued frame with as few writev calls as possible. On an
+ * error the frames not yet written, a partly written one included, are
+ * dropped and counted in tx_dropped. Caller holds tx_lock.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void sr_vns_tx_flush_locked(struct sr_instance* sr)
+{
+    struct sr_vns_io* io = sr->vns_io;
+    struct iovec* iov = io->tx_iov;
+    int iovcnt = io->tx_count;
+    ssize_t ret;
+
+    while ( iovcnt > 0 )
+    {
+        ret = writev(sr->sockfd, iov, iovcnt);
+        if ( ret == -1 )
+        {
+            if ( errno == EINTR )
+            { continue; }
+            perror("writev(..):sr_client.c::sr_vns_tx_flush");
+            break;
+        }
+        io->tx_calls++;
+
+        /* -- skip what went out, a partial write may split a frame -- */
+        while ( (iovcnt > 0) && ((size_t)ret >= iov->iov_len) )
+        {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if ( iovcnt > 0 )
+        {
+            iov->iov_base = (uint8_t*)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    /* -- iovcnt frames are left if writev failed -- */
+    io->tx_frames += io->tx_count - iovcnt;
+    io->tx_dropped += iovcnt;
+
+    for ( iovcnt = 0; iovcnt < (int)io->tx_count; iovcnt++ )
+    {
+        if ( io->tx_owned[iovcnt] )
+        { sr_frame_free(io->tx_owned[iovcnt]); }
+    }
+
+    io->tx_count = 0;
+    io->tx_used = 0;
+} /* -- sr_vns_tx_flush_locked -- */
+
+static void sr_vns_tx_flush(struct sr_instance* sr)
+{
+    struct sr_vns_io* io = sr->vns_io;
+
+    pthread_mutex_lock(&(io->tx_lock));
+    if ( io->tx_count > 0 )
+    { sr_vns_tx_flush_locked(sr); }
+    pthread_mutex_unlock(&(io->tx_lock));
+} /* -- sr_vns_tx_flush -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_tx_flusher(..)
+ * Scope: Local
+ *
+ * Thread bounding the time a frame sits in the queue when nothing else
+ * triggers a flush, e.g. frames sent by the PWOSPF threads.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void* sr_vns_tx_flusher(void* sr_ptr)
+{
+    struct sr_instance* sr = (struct sr_instance*)sr_ptr;
+    struct sr_vns_io* io = sr->vns_io;
+
+    pthread_mutex_lock(&(io->tx_lock));
+    while (1)
+    {
+        while ( io->tx_count == 0 )
+        { pthread_cond_wait(&(io->tx_cond), &(io->tx_lock)); }
+
+        while ( (io->tx_count > 0) &&
+                (pthread_cond_timedwait(&(io->tx_cond), &(io->tx_lock),
+                                        &(io->tx_deadline)) != ETIMEDOUT) );
+
+        if ( io->tx_count > 0 )
+        { sr_vns_tx_flush_locked(sr); }
+    }
+
+    return NULL;
+} /* -- sr_vns_tx_flusher -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_io_init(..)
+ * Scope: Local
+ *
+ *----------------------------------------------------------------------------*/
+
+static int sr_vns_io_init(struct sr_instance* sr)
+{
+    struct sr_vns_io* io;
+    pthread_t thread;
+
+    io = (struct sr_vns_io*)malloc(sizeof(struct sr_vns_io));
+    if ( io == 0 )
+    {
+        fprintf(stderr,"Error: out of memory (sr_vns_io_init)\n");
+        return -1;
+    }
+
+    io->rx_head = io->rx_tail = 0;
+    io->rx_msgs = io->rx_calls = 0;
+    io->tx_used = io->tx_count = 0;
+    io->tx_frames = io->tx_dropped = io->tx_calls = io->tx_copied = 0;
+    pthread_mutex_init(&(io->tx_lock), NULL);
+    pthread_cond_init(&(io->tx_cond), NULL);
+    sr->vns_io = io;
+
+    if ( pthread_create(&thread, NULL, sr_vns_tx_flusher, sr) != 0 )
+    {
+        perror("pthread_create(..):sr_client.c::sr_vns_io_init");
+        return -1;
+    }
+    pthread_detach(thread);
+
+    return 0;
+} /* -- sr_vns_io_init -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_print_stats(..)
+ * Scope: Global
+ *
+ *----------------------------------------------------------------------------*/
+
+void sr_vns_print_stats(struct sr_instance* sr)
+{
+    struct sr_vns_io* io = sr->vns_io;
+
+    if ( io == 0 )
+    { return; }
+
+    pthread_mutex_lock(&(io->tx_lock));
+    fprintf(stderr, "VNS rx: %lu commands in %lu recv calls (%.2f per call)\n",
+            io->rx_msgs, io->rx_calls,
+            io->rx_calls ? (double)io->rx_msgs / io->rx_calls : 0.0);
+    fprintf(stderr, "VNS tx: %lu frames in %lu writev calls (%.2f per call)\n",
+            io->tx_frames, io->tx_calls,
+            io->tx_calls ? (double)io->tx_frames / io->tx_calls : 0.0);
+    fprintf(stderr, "VNS tx: %lu frame bytes copied (%.2f per frame)\n",
+            io->tx_copied,
+            io->tx_frames ? (double)io->tx_copied / io->tx_frames : 0.0);
+    fprintf(stderr, "VNS tx: %lu frames dropped on writev errors\n",
+            io->tx_dropped);
+    pthread_mutex_unlock(&(io->tx_lock));
+} /* -- sr_vns_print_stats -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_next_command(..)
+ * Scope: Local
+ *
+ * Return the next complete command in rx_buf, receiving more data only
+ * when none is left. The command stays valid until the next call. Pending
+ * frames are flushed before blocking so replies never wait for input.
+ *
+ *----------------------------------------------------------------------------*/
+
+static unsigned char* sr_vns_next_command(struct sr_instance* sr, int* len)
+{
+    struct sr_vns_io* io = sr->vns_io;
+    unsigned char* cmd;
+    uint32_t cmd_len;
+    int ret;
+
+    while (1)
+    {
+        if ( io->rx_tail - io->rx_head >= 4 )
+        {
+            memcpy(&cmd_len, io->rx_buf + io->rx_head, 4);
+            *len = ntohl(cmd_len);
+
+            if ( *len > 10000 || *len < 8 )
+            {
+                fprintf(stderr,"Error: command length to large %d\n",*len);
+                close(sr->sockfd);
+                return 0;
+            }
+
+            if ( io->rx_tail - io->rx_head >= (unsigned int)*len )
+            {
+                cmd = io->rx_buf + io->rx_head;
+                io->rx_head += *len;
+                io->rx_msgs++;
+                return cmd;
+            }
+        }
+
+        /* -- queued frames may still point into rx_buf -- */
+        sr_vns_tx_flush(sr);
+
+        /* -- move the partial command to the front to make room -- */
+        if ( io->rx_head > 0 )
+        {
+            memmove(io->rx_buf, io->rx_buf + io->rx_head,
+                    io->rx_tail - io->rx_head);
+            io->rx_tail -= io->rx_head;
+            io->rx_head = 0;
+        }
+
+        do
+        { /* -- just in case SIGALRM breaks recv -- */
+            errno = 0; /* -- hacky glibc workaround -- */
+            ret = recv(sr->sockfd, io->rx_buf + io->rx_tail,
+                       SR_VNS_RXBUF_SZ - io->rx_tail, 0);
+        } while ( ret == -1 && errno == EINTR ); /* be mindful of signals */
+
+        if ( ret == -1 )
+        {
+            perror("recv(..):sr_client.c::sr_read_from_server");
+            return 0;
+        }
+        if ( ret == 0 )
+        {
+            fprintf(stderr,"Error: server closed the connection\n");
+            return 0;
+        }
+
+        io->rx_calls++;
+        io->rx_tail += ret;
+    }
+} /* -- sr_vns_next_command -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_connect_to_server()
  * Scope: Global
@@ -121,6 +412,12 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
         return -1;
     }
 
+    if (sr_vns_io_init(sr) != 0)
+    {
+        close(sr->sockfd);
+        return -1;
+    }
+
     /* wait for authentication to be completed (server sends the first message) */
     if(sr_read_from_server_expect(sr, VNS_AUTH_REQUEST)!= 1 ||
        sr_read_from_server_expect(sr, VNS_AUTH_STATUS) != 1)
@@ -337,7 +634,8 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
     int command, len;
     unsigned char *buf = 0;
     c_packet_ethernet_header* sr_pkt = 0;
-    int ret = 0, bytes_read = 0;
+    struct sr_if* iface = 0;
+    int ret = 0;
 
     /* REQUIRES */
     assert(sr);
@@ -346,66 +644,8 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
       Read a command from the server
       -------------------------------------------------------------------------*/
 
-    bytes_read = 0;
-
-    /* attempt to read the size of the incoming packet */
-    while( bytes_read < 4)
-    {
-        do
-        { /* -- just in case SIGALRM breaks recv -- */
-            errno = 0; /* -- hacky glibc workaround -- */
-            if((ret = recv(sr->sockfd,((uint8_t*)&len) + bytes_read,
-                            4 - bytes_read, 0)) == -1)
-            {
-                if ( errno == EINTR )
-                { continue; }
-
-                perror("recv(..):sr_client.c::sr_read_from_server");
-                return -1;
-            }
-            bytes_read += ret;
-        } while ( errno == EINTR); /* be mindful of signals */
-
-    }
-
-    len = ntohl(len);
-
-    if ( len > 10000 || len < 0 )
-    {
-        fprintf(stderr,"Error: command length to large %d\n",len);
-        close(sr->sockfd);
-        return -1;
-    }
-
-    if((buf = malloc(len)) == 0)
-    {
-        fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
-        return -1;
-    }
-
-    /* set first field of command since we've already read it */
-    *((int *)buf) = htonl(len);
-
-    bytes_read = 0;
-
-    /* read the rest of the command */
-    while ( bytes_read < len - 4)
-    {
-        do
-        {/* -- just in case SIGALRM breaks recv -- */
-            errno = 0; /* -- hacky glibc workaround -- */
-            if ((ret = read(sr->sockfd, buf+4+bytes_read, len - 4 - bytes_read)) ==
-                    -1)
-            {
-                if ( errno == EINTR )
-                { continue; }
-                fprintf(stderr,"Error: failed reading command body %d\n",ret);
-                close(sr->sockfd);
-                return -1;
-            }
-            bytes_read += ret;
-        } while (errno == EINTR); /* be mindful of signals */
-    }
+    if((buf = sr_vns_next_command(sr, &len)) == 0)
+    { return -1; }
 
     /* My entry for most unreadable line of code - guido */
     /* ... you win - mc                                  */
@@ -427,12 +667,24 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         case VNSPACKET:
             sr_pkt = (c_packet_ethernet_header *)buf;
 
-            /* -- check if it is an ARP to another router if so drop   -- */
-            if ( sr_arp_req_not_for_us(sr,
+            /* -- resolve the receiving interface once for the whole path -- */
+            iface = sr_get_interface(sr, sr_pkt->mInterfaceName);
+            if ( iface == 0 )
+            {
+                fprintf(stderr, "** Error, packet on unknown interface %.*s\n",
+                        (int)sizeof(sr_pkt->mInterfaceName),
+                        sr_pkt->mInterfaceName);
+                break;
+            }
+
+            /* -- check if it is an ARP to another router if so drop,
+             * unless the router gleans mappings from those too      -- */
+            if ( (sr->arp_glean == SR_ARP_GLEAN_OFF) &&
+                 sr_arp_req_not_for_us(sr,
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
+                    iface) )
             { break; }
 
             /* -- log packet -- */
@@ -444,7 +696,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base)));
+                    iface);
 
             break;
 
@@ -454,9 +706,17 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             fprintf(stderr,"VNS server closed session.\n");
             fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
             sr_session_closed_help();
+            sr_vns_print_stats(sr);
+            sr_pool_print_stats();
+            sr_timer_print_stats(&(sr->timers));
+            sr_arpcache_print_stats(&(sr->cache));
+            sr_if_print_arp_stats(sr);
+            if (sr->ospf_subsys)
+            {
+                sr_workq_print_stats(&(sr->ospf_subsys->workq));
+                pwospf_print_spf_stats(sr);
+            }
 
-            if(buf)
-            { free(buf); }
             return 0;
             break;
 
@@ -502,8 +762,6 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     }/* -- switch -- */
 
-    if(buf)
-    { free(buf); }
     return ret;
 }/* -- sr_read_from_server -- */
 
@@ -518,23 +776,16 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 static int
 sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
                                 uint8_t* buf, /* borrowed */
-                                const char* name /* borrowed */ )
+                                struct sr_if* iface /* borrowed */ )
 {
     struct sr_ethernet_hdr* ether_hdr = 0;
-    struct sr_if* iface = 0;
 
     /* -- REQUIRES -- */
     assert(sr);
     assert(buf);
-    assert(name);
+    assert(iface);
 
     ether_hdr = (struct sr_ethernet_hdr*)buf;
-    iface = sr_get_interface(sr, name);
-
-    if ( iface == 0 ){
-        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
-        return 0;
-    }
 
     if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 ){
         fprintf( stderr, "** Error, source address does not match interface\n");
@@ -563,51 +814,220 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
 int sr_send_packet(struct sr_instance* sr /* borrowed */,
                          uint8_t* buf /* borrowed */ ,
                          unsigned int len,
-                         const char* iface /* borrowed */)
+                         const char* name /* borrowed */)
 {
-    c_packet_header *sr_pkt;
-    unsigned int total_len =  len + (sizeof(c_packet_header));
+    struct sr_if* iface = 0;
 
     /* REQUIRES */
     assert(sr);
-    assert(buf);
-    assert(iface);
+    assert(name);
+
+    iface = sr_get_interface(sr, name);
+    if ( iface == 0 ){
+        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
+        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
+        return -1;
+    }
+
+    return sr_send_packet_if(sr, buf, len, iface);
+} /* -- sr_send_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_frame_alloc(..)
+ * Scope: Global
+ *
+ * Allocate a frame of len bytes with room for the VNS header in front of
+ * it, so that sr_send_frame can queue it as is. Frames come from the
+ * frame pool unless they are too big for it; the pool they came from is
+ * recorded in front of the header.
+ *
+ *---------------------------------------------------------------------------*/
+
+#define SR_FRAME_PREFIX 16      /* keeps the frame 16-byte aligned */
+
+uint8_t* sr_frame_alloc(unsigned int len)
+{
+    unsigned int need = SR_FRAME_PREFIX + sizeof(c_packet_header) + len;
+    struct sr_pool* pool = (need <= SR_POOL_FRAME_SZ) ? &sr_frame_pool : 0;
+    uint8_t* raw;
+
+    raw = pool ? (uint8_t*)sr_pool_alloc(pool) : (uint8_t*)malloc(need);
+    assert(raw);
+    *((struct sr_pool**)raw) = pool;
+
+    return raw + SR_FRAME_PREFIX + sizeof(c_packet_header);
+} /* -- sr_frame_alloc -- */
+
+void sr_frame_free(uint8_t* frame)
+{
+    uint8_t* raw;
+    struct sr_pool* pool;
+
+    if ( frame == 0 )
+    { return; }
+
+    raw = frame - sizeof(c_packet_header) - SR_FRAME_PREFIX;
+    pool = *((struct sr_pool**)raw);
+    if ( pool )
+    { sr_pool_free(pool, raw); }
+    else
+    { free(raw); }
+} /* -- sr_frame_free -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_tx_queue(..)
+ * Scope: Local
+ *
+ * Put a frame on the send queue. If hdr is not 0 the frame sits right
+ * after it and is sent in place, and if owned is not 0 the frame is freed
+ * once written. Otherwise the frame is copied into tx_buf.
+ *
+ *---------------------------------------------------------------------------*/
 
+static void sr_vns_tx_queue(struct sr_instance* sr, c_packet_header* hdr,
+                            uint8_t* buf, unsigned int len,
+                            struct sr_if* iface, uint8_t* owned)
+{
+    struct sr_vns_io* io = sr->vns_io;
+    unsigned int total_len = len + sizeof(c_packet_header);
+    struct timeval now;
+
+    pthread_mutex_lock(&(io->tx_lock));
+
+    if ( (io->tx_count == SR_VNS_TXQ_LEN) ||
+         ((hdr == 0) && (io->tx_used + total_len > SR_VNS_TXBUF_SZ)) )
+    { sr_vns_tx_flush_locked(sr); }
+
+    if ( hdr == 0 )
+    {
+        /* Stage packet */
+        hdr = (c_packet_header *)(io->tx_buf + io->tx_used);
+        memcpy(((uint8_t*)hdr) + sizeof(c_packet_header), buf, len);
+        io->tx_used += total_len;
+        io->tx_copied += len;
+    }
+
+    hdr->mLen  = htonl(total_len);
+    hdr->mType = htonl(VNSPACKET);
+    strncpy(hdr->mInterfaceName,iface->name,16);
+
+    io->tx_iov[io->tx_count].iov_base = hdr;
+    io->tx_iov[io->tx_count].iov_len = total_len;
+    io->tx_owned[io->tx_count] = owned;
+
+    /* -- first frame of a batch arms the flusher -- */
+    if ( io->tx_count++ == 0 )
+    {
+        gettimeofday(&now, 0);
+        now.tv_usec += SR_VNS_TX_FLUSH_US;
+        io->tx_deadline.tv_sec = now.tv_sec + now.tv_usec / 1000000;
+        io->tx_deadline.tv_nsec = (now.tv_usec % 1000000) * 1000;
+        pthread_cond_signal(&(io->tx_cond));
+    }
+
+    pthread_mutex_unlock(&(io->tx_lock));
+} /* -- sr_vns_tx_queue -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_check_frame(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_check_frame(struct sr_instance* sr, uint8_t* buf,
+                              unsigned int len, struct sr_if* iface)
+{
     /* don't waste my time ... */
     if ( len < sizeof(struct sr_ethernet_hdr) ){
         fprintf(stderr , "** Error: packet is wayy to short \n");
-        return -1;
+        return 0;
+    }
+    if ( len + sizeof(c_packet_header) > SR_VNS_TXBUF_SZ ){
+        fprintf(stderr , "** Error: packet is wayy to long \n");
+        return 0;
     }
-
-    /* Create packet */
-    sr_pkt = (c_packet_header *)malloc(len +
-            sizeof(c_packet_header));
-    assert(sr_pkt);
-    sr_pkt->mLen  = htonl(total_len);
-    sr_pkt->mType = htonl(VNSPACKET);
-    strncpy(sr_pkt->mInterfaceName,iface,16);
-    memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
-            buf,len);
 
     /* -- log packet -- */
     sr_log_packet(sr,buf,len);
 
     if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
         fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
-        return -1;
+        return 0;
     }
 
-    if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
-        fprintf(stderr, "Error writing packet\n");
-        free(sr_pkt);
+    return 1;
+} /* -- sr_vns_check_frame -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_if(..)
+ * Scope: Global
+ *
+ * Same as sr_send_packet for callers that already hold the interface
+ * record, which saves looking it up by name.
+ *
+ * A frame handed to sr_handlepacket may be sent back out as is; its VNS
+ * header, including the interface name passed along with it, is then
+ * reused for the outgoing copy.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet_if(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */ ,
+                         unsigned int len,
+                         struct sr_if* iface /* borrowed */)
+{
+    struct sr_vns_io* io;
+    c_packet_header* hdr = 0;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+    assert(iface);
+
+    if ( ! sr_vns_check_frame(sr, buf, len, iface) )
+    { return -1; }
+
+    /* -- frames inside rx_buf always have their VNS header in front -- */
+    io = sr->vns_io;
+    if ( (buf >= io->rx_buf + sizeof(c_packet_header)) &&
+         (buf + len <= io->rx_buf + io->rx_head) )
+    { hdr = (c_packet_header*)(buf - sizeof(c_packet_header)); }
+
+    sr_vns_tx_queue(sr, hdr, buf, len, iface, 0);
+
+    return 0;
+} /* -- sr_send_packet_if -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_frame(..)
+ * Scope: Global
+ *
+ * Send a frame obtained from sr_frame_alloc without copying it. The frame
+ * belongs to the send queue from now on, even if sending fails.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_frame(struct sr_instance* sr /* borrowed */,
+                  uint8_t* frame /* given */,
+                  unsigned int len,
+                  struct sr_if* iface /* borrowed */)
+{
+    /* REQUIRES */
+    assert(sr);
+    assert(frame);
+    assert(iface);
+
+    if ( ! sr_vns_check_frame(sr, frame, len, iface) )
+    {
+        sr_frame_free(frame);
         return -1;
     }
 
-    free(sr_pkt);
+    sr_vns_tx_queue(sr, (c_packet_header*)(frame - sizeof(c_packet_header)),
+                    frame, len, iface, frame);
 
     return 0;
-} /* -- sr_send_packet -- */
+} /* -- sr_send_frame -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_log_packet()
@@ -617,23 +1037,14 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
 
 void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
 {
-    struct pcap_pkthdr h;
-    int size;
-
     /* REQUIRES */
     assert(sr);
 
-    if(!sr->logfile)
+    if(!sr->capture)
     {return; }
 
-    size = min(PACKET_DUMP_SIZE, len);
-
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
-
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
+    /* -- copied into the capture ring, written by the capture thread -- */
+    sr_capture_packet(sr->capture, buf, len);
 } /* -- sr_log_packet -- */
 
 /*-----------------------------------------------------------------------------
@@ -645,9 +1056,8 @@ void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
 int  sr_arp_req_not_for_us(struct sr_instance* sr,
                            uint8_t * packet /* lent */,
                            unsigned int len,
-                           char* interface  /* lent */)
+                           struct sr_if* iface  /* lent */)
 {
-    struct sr_if* iface = sr_get_interface(sr, interface);
     struct sr_ethernet_hdr* e_hdr = 0;
     struct sr_arp_hdr*       a_hdr = 0;
 
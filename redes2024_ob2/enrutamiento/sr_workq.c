@@ -0,0 +1,174 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_workq.c
+ *
+ * Description:
+ *
+ * Worker pool, see sr_workq.h. Task records and the task arguments come
+ * from the slab pools, so a task costs no malloc either.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "sr_workq.h"
+#include "sr_pool.h"
+
+static const char* sr_work_names[SR_WORK_TYPES] =
+{ "lsu-rx", "hello-tx", "spf" };
+
+struct sr_work
+{
+    int type;
+    void* (*fn)(void*);
+    void* arg;
+    struct sr_pool* arg_pool;   /* arg goes back here once run, if set */
+    struct sr_work* next;
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_workq_worker
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_workq_worker(void* arg)
+{
+    struct sr_workq* wq = (struct sr_workq*)arg;
+    struct sr_work* work;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&(wq->lock));
+        while (wq->head == 0)
+        { pthread_cond_wait(&(wq->ready), &(wq->lock)); }
+
+        work = wq->head;
+        wq->head = work->next;
+        if (wq->head == 0)
+        { wq->tail = 0; }
+        wq->depth--;
+        pthread_mutex_unlock(&(wq->lock));
+
+        work->fn(work->arg);
+
+        if (work->arg_pool != 0)
+        { sr_pool_free(work->arg_pool, work->arg); }
+
+        pthread_mutex_lock(&(wq->lock));
+        wq->stats[work->type].done++;
+        pthread_mutex_unlock(&(wq->lock));
+
+        sr_pool_free(&sr_small_pool, work);
+    }
+
+    return 0;
+} /* -- sr_workq_worker -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workq_init
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workq_init(struct sr_workq* wq, unsigned int capacity)
+{
+    unsigned int i;
+
+    assert(wq);
+    assert(sizeof(struct sr_work) <= SR_POOL_SMALL_SZ);
+
+    pthread_mutex_init(&(wq->lock), 0);
+    pthread_cond_init(&(wq->ready), 0);
+    wq->head = 0;
+    wq->tail = 0;
+    wq->depth = 0;
+    wq->max_depth = 0;
+    wq->capacity = capacity;
+    for (i = 0; i < SR_WORK_TYPES; i++)
+    {
+        wq->stats[i].submitted = 0;
+        wq->stats[i].rejected = 0;
+        wq->stats[i].done = 0;
+    }
+
+    for (i = 0; i < SR_WORKQ_THREADS; i++)
+    {
+        if (pthread_create(&(wq->threads[i]), 0, sr_workq_worker, wq))
+        {
+            perror("pthread_create");
+            assert(0);
+        }
+    }
+} /* -- sr_workq_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workq_submit
+ *
+ * Queue fn(arg) to run on a worker. The queue owns arg from here on:
+ * if arg_pool is set, arg is returned to it after fn has run, or right
+ * away if the task is rejected. Returns 0 if queued, -1 if rejected.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_workq_submit(struct sr_workq* wq, int type, void* (*fn)(void*),
+                    void* arg, struct sr_pool* arg_pool)
+{
+    struct sr_work* work;
+
+    assert(wq);
+    assert(fn);
+    assert((type >= 0) && (type < SR_WORK_TYPES));
+
+    work = (struct sr_work*)sr_pool_alloc(&sr_small_pool);
+    work->type = type;
+    work->fn = fn;
+    work->arg = arg;
+    work->arg_pool = arg_pool;
+    work->next = 0;
+
+    pthread_mutex_lock(&(wq->lock));
+    wq->stats[type].submitted++;
+    if (wq->depth >= wq->capacity)
+    {
+        wq->stats[type].rejected++;
+        pthread_mutex_unlock(&(wq->lock));
+
+        sr_pool_free(&sr_small_pool, work);
+        if (arg_pool != 0)
+        { sr_pool_free(arg_pool, arg); }
+        return -1;
+    }
+
+    if (wq->tail != 0)
+    { wq->tail->next = work; }
+    else
+    { wq->head = work; }
+    wq->tail = work;
+    wq->depth++;
+    if (wq->depth > wq->max_depth)
+    { wq->max_depth = wq->depth; }
+    pthread_cond_signal(&(wq->ready));
+    pthread_mutex_unlock(&(wq->lock));
+
+    return 0;
+} /* -- sr_workq_submit -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workq_print_stats
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workq_print_stats(struct sr_workq* wq)
+{
+    int i;
+
+    pthread_mutex_lock(&(wq->lock));
+    for (i = 0; i < SR_WORK_TYPES; i++)
+    {
+        fprintf(stderr, "Work %s: %lu submitted, %lu done, %lu rejected\n",
+                sr_work_names[i], wq->stats[i].submitted, wq->stats[i].done,
+                wq->stats[i].rejected);
+    }
+    fprintf(stderr, "Work queue: %u queued now, %u at most, %u allowed\n",
+            wq->depth, wq->max_depth, wq->capacity);
+    pthread_mutex_unlock(&(wq->lock));
+} /* -- sr_workq_print_stats -- */
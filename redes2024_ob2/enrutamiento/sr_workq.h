@@ -0,0 +1,56 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_workq.h
+ *
+ * Description:
+ *
+ * Fixed pool of worker threads behind a bounded FIFO of tasks. PWOSPF
+ * hands its per-event work (received LSUs, HELLOs to send, SPF runs) to
+ * the pool instead of starting a thread per event. When the queue is
+ * full a task is rejected and counted; this is the back-pressure, the
+ * protocol tolerates a lost HELLO or LSU.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_WORKQ_H
+#define SR_WORKQ_H
+
+#include <pthread.h>
+
+#define SR_WORKQ_THREADS 2      /* workers */
+#define SR_WORKQ_DEPTH   256    /* tasks waiting, at most */
+
+/* task types, for the counters */
+#define SR_WORK_LSU_RX   0      /* process a received LSU */
+#define SR_WORK_HELLO_TX 1      /* build and send one HELLO */
+#define SR_WORK_SPF      2      /* recompute the dynamic routes */
+#define SR_WORK_TYPES    3
+
+struct sr_pool;
+struct sr_work;
+
+struct sr_workq_stats
+{
+    unsigned long submitted;
+    unsigned long rejected;     /* queue full */
+    unsigned long done;
+};
+
+struct sr_workq
+{
+    pthread_mutex_t lock;       /* guards everything below */
+    pthread_cond_t ready;       /* signalled when a task is queued */
+    struct sr_work* head;
+    struct sr_work* tail;
+    unsigned int depth;         /* tasks queued */
+    unsigned int max_depth;     /* highest depth seen */
+    unsigned int capacity;
+    struct sr_workq_stats stats[SR_WORK_TYPES];
+    pthread_t threads[SR_WORKQ_THREADS];
+};
+
+void sr_workq_init(struct sr_workq*, unsigned int capacity);
+int  sr_workq_submit(struct sr_workq*, int type, void* (*fn)(void*),
+                     void* arg, struct sr_pool* arg_pool);
+void sr_workq_print_stats(struct sr_workq*);
+
+#endif /* -- SR_WORKQ_H -- */
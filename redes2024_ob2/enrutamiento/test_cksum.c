@@ -0,0 +1,352 @@
+/*-----------------------------------------------------------------------------
+ * file:  test_cksum.c
+ *
+ * Description:
+ *
+ * Property checks for the checksum code, run with "make test". Random
+ * headers and buffers are checked against a byte-wise RFC 1071 reference
+ * or a full recompute; the first disagreement is printed and the program
+ * exits non-zero. An optional argument seeds the generator. Vector
+ * kernels the CPU lacks are skipped.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sr_cksum.h"
+
+#define TEST_ROUNDS 100000
+#define TEST_MAX_LEN 9216   /* jumbo frame */
+#define TEST_MAX_OFF 64
+#define TEST_BIG_LEN (1 << 20) /* several vector blocks, see sr_cksum.c */
+
+struct test_kernel
+{
+    const char* name;
+    uint64_t (*sum)(const void*, int);
+    const char* cpu;    /* feature it needs, 0 if none */
+};
+
+static struct test_kernel test_kernels[] =
+{
+    { "scalar", sr_cksum_sum_scalar, 0 },
+    { "sse2", sr_cksum_sum_sse2, "sse2" },
+    { "avx2", sr_cksum_sum_avx2, "avx2" },
+    { "dispatch", sr_cksum_sum, 0 }
+};
+
+#define TEST_NKERNELS (sizeof(test_kernels) / sizeof(test_kernels[0]))
+
+static uint32_t test_seed = 0x2545f491;
+static int test_failed = 0;
+
+/*---------------------------------------------------------------------
+ * Method: test_rand
+ *
+ * xorshift32, so a failure can be replayed from its seed.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t test_rand(void)
+{
+    test_seed ^= test_seed << 13;
+    test_seed ^= test_seed >> 17;
+    test_seed ^= test_seed << 5;
+    return test_seed;
+} /* -- test_rand -- */
+
+static void test_fill(uint8_t* buf, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+    { buf[i] = (uint8_t)test_rand(); }
+} /* -- test_fill -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_ref_cksum
+ *
+ * RFC 1071 taken literally: big-endian words, odd byte padded with a
+ * zero, carries folded at the end. Returned in network order, mapped
+ * away from 0 like cksum.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint16_t test_ref_cksum(const uint8_t* data, int len)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i + 1 < len; i += 2)
+    {
+        sum += (data[i] << 8) | data[i + 1];
+        sum = (sum >> 16) + (sum & 0xffff);
+    }
+    if (len & 1)
+    {
+        sum += data[len - 1] << 8;
+        sum = (sum >> 16) + (sum & 0xffff);
+    }
+
+    sum = (uint16_t)~sum;
+    return htons(sum ? sum : 0xffff);
+} /* -- test_ref_cksum -- */
+
+static int test_kernel_usable(struct test_kernel* kernel)
+{
+    if (kernel->cpu == 0)
+    { return 1; }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (strcmp(kernel->cpu, "sse2") == 0)
+    { return __builtin_cpu_supports("sse2"); }
+    if (strcmp(kernel->cpu, "avx2") == 0)
+    { return __builtin_cpu_supports("avx2"); }
+#endif
+    return 0;
+} /* -- test_kernel_usable -- */
+
+static int test_kernel_check(struct test_kernel* kernel, const uint8_t* data,
+                             int len, int off)
+{
+    uint16_t got = cksum_fold(kernel->sum(data, len));
+    uint16_t want = test_ref_cksum(data, len);
+
+    if (got == want)
+    { return 1; }
+
+    fprintf(stderr, "%s: len %d offset %d gave %04x, want %04x\n",
+            kernel->name, len, off, got, want);
+    test_failed = 1;
+    return 0;
+} /* -- test_kernel_check -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_kernels_random
+ *
+ * Every kernel against the reference on random data, odd lengths up to
+ * a jumbo frame and unaligned starts. Buffers of all ones and of all
+ * zeros push the carries and the 0 / 0xffff case.
+ *
+ *---------------------------------------------------------------------*/
+
+static void test_kernels_random(void)
+{
+    static uint8_t buf[TEST_MAX_OFF + TEST_MAX_LEN];
+    unsigned int k;
+    int i, len, off;
+
+    for (k = 0; k < TEST_NKERNELS; k++)
+    {
+        if (!test_kernel_usable(&test_kernels[k]))
+        {
+            printf("%s: not supported here, skipped\n", test_kernels[k].name);
+            continue;
+        }
+
+        for (i = 0; i < TEST_ROUNDS / 10; i++)
+        {
+            len = test_rand() % (TEST_MAX_LEN + 1);
+            if (i & 1)
+            { len = test_rand() % 130; }
+            off = test_rand() % TEST_MAX_OFF;
+            switch (test_rand() % 8)
+            {
+                case 0: memset(buf + off, 0xff, len); break;
+                case 1: memset(buf + off, 0, len); break;
+                default: test_fill(buf + off, len); break;
+            }
+            if (!test_kernel_check(&test_kernels[k], buf + off, len, off))
+            { return; }
+        }
+        printf("%s: %d buffers ok\n", test_kernels[k].name, TEST_ROUNDS / 10);
+    }
+} /* -- test_kernels_random -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_kernels_big
+ *
+ * A megabyte of 0xff fills the vector lanes to the spill limit.
+ *
+ *---------------------------------------------------------------------*/
+
+static void test_kernels_big(void)
+{
+    uint8_t* buf = (uint8_t*)malloc(TEST_BIG_LEN + 1);
+    unsigned int k;
+
+    if (buf == 0)
+    { return; }
+    memset(buf, 0xff, TEST_BIG_LEN + 1);
+
+    for (k = 0; k < TEST_NKERNELS; k++)
+    {
+        if (!test_kernel_usable(&test_kernels[k]))
+        { continue; }
+        if (!test_kernel_check(&test_kernels[k], buf, TEST_BIG_LEN, 0) ||
+            !test_kernel_check(&test_kernels[k], buf + 1, TEST_BIG_LEN - 1, 1))
+        { break; }
+    }
+    if (!test_failed)
+    { printf("all kernels: %d byte buffers ok\n", TEST_BIG_LEN); }
+
+    free(buf);
+} /* -- test_kernels_big -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_split
+ *
+ * Sums of pieces that start at even offsets add up, as cksum_fold
+ * promises to callers that cache partial sums.
+ *
+ *---------------------------------------------------------------------*/
+
+static void test_split(void)
+{
+    static uint8_t buf[TEST_MAX_LEN];
+    uint16_t got, want;
+    int i, len, cut;
+
+    for (i = 0; i < TEST_ROUNDS / 10; i++)
+    {
+        len = test_rand() % TEST_MAX_LEN + 1;
+        cut = 2 * (test_rand() % (len / 2 + 1));
+        test_fill(buf, len);
+
+        got = cksum_fold(sr_cksum_sum(buf, cut) + sr_cksum_sum(buf + cut, len - cut));
+        want = cksum(buf, len);
+        if (got != want)
+        {
+            fprintf(stderr, "split sum: len %d cut %d gave %04x, want %04x\n",
+                    len, cut, got, want);
+            test_failed = 1;
+            return;
+        }
+    }
+    printf("split sums: %d rounds ok\n", TEST_ROUNDS / 10);
+} /* -- test_split -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_ip_hdr
+ *
+ * Random IPv4 header with a valid checksum.
+ *
+ *---------------------------------------------------------------------*/
+
+static void test_ip_hdr(sr_ip_hdr_t* hdr)
+{
+    test_fill((uint8_t*)hdr, sizeof(sr_ip_hdr_t));
+    hdr->ip_sum = 0;
+    hdr->ip_sum = cksum(hdr, sizeof(sr_ip_hdr_t));
+} /* -- test_ip_hdr -- */
+
+static uint16_t test_recompute(sr_ip_hdr_t* hdr)
+{
+    sr_ip_hdr_t copy = *hdr;
+
+    copy.ip_sum = 0;
+    return cksum(&copy, sizeof(sr_ip_hdr_t));
+} /* -- test_recompute -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_update
+ *
+ * cksum_update after rewriting any 16-bit word of the header, the
+ * checksum itself aside, must match a full recompute.
+ *
+ *---------------------------------------------------------------------*/
+
+static void test_update(void)
+{
+    sr_ip_hdr_t hdr;
+    uint16_t old_word, new_word, want;
+    uint8_t* raw = (uint8_t*)&hdr;
+    int i, off;
+
+    for (i = 0; i < TEST_ROUNDS; i++)
+    {
+        test_ip_hdr(&hdr);
+        do
+        { off = 2 * (test_rand() % (sizeof(sr_ip_hdr_t) / 2)); }
+        while (off == 10);
+
+        memcpy(&old_word, raw + off, 2);
+        new_word = (uint16_t)test_rand();
+        if ((test_rand() & 7) == 0)
+        { new_word = (test_rand() & 1) ? 0 : 0xffff; }
+        memcpy(raw + off, &new_word, 2);
+
+        hdr.ip_sum = cksum_update(hdr.ip_sum, old_word, new_word);
+        want = test_recompute(&hdr);
+        if (hdr.ip_sum != want)
+        {
+            fprintf(stderr, "cksum_update: word %d %04x -> %04x gave %04x, want %04x\n",
+                    off, old_word, new_word, hdr.ip_sum, want);
+            test_failed = 1;
+            return;
+        }
+    }
+    printf("cksum_update: %d rounds ok\n", TEST_ROUNDS);
+} /* -- test_update -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_ttl
+ *
+ * ip_decrement_ttl must leave the header as a full recompute would,
+ * for every TTL including the ones that borrow into the protocol byte's
+ * word.
+ *
+ *---------------------------------------------------------------------*/
+
+static void test_ttl(void)
+{
+    sr_ip_hdr_t hdr;
+    uint16_t want;
+    uint8_t ttl;
+    int i;
+
+    for (i = 0; i < TEST_ROUNDS; i++)
+    {
+        test_ip_hdr(&hdr);
+        if (hdr.ip_ttl == 0)
+        { continue; }
+        ttl = hdr.ip_ttl;
+
+        ip_decrement_ttl(&hdr);
+        want = test_recompute(&hdr);
+        if ((hdr.ip_ttl != ttl - 1) || (hdr.ip_sum != want))
+        {
+            fprintf(stderr, "ip_decrement_ttl: ttl %u gave sum %04x, want %04x\n",
+                    ttl, hdr.ip_sum, want);
+            test_failed = 1;
+            return;
+        }
+        if (ip_cksum(&hdr, sizeof(sr_ip_hdr_t)) != hdr.ip_sum)
+        {
+            fprintf(stderr, "ip_decrement_ttl: ttl %u left an invalid header\n", ttl);
+            test_failed = 1;
+            return;
+        }
+    }
+    printf("ip_decrement_ttl: %d rounds ok\n", TEST_ROUNDS);
+} /* -- test_ttl -- */
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+    { test_seed = (uint32_t)strtoul(argv[1], 0, 0) | 1; }
+    printf("seed %#x, cksum uses %s\n", test_seed, sr_cksum_impl());
+
+    test_kernels_random();
+    test_kernels_big();
+    test_split();
+    test_update();
+    test_ttl();
+
+    return test_failed;
+} /* -- main -- */
@@ -0,0 +1,182 @@
+/*-----------------------------------------------------------------------------
+ * file:  test_lsdb.c
+ *
+ * Description:
+ *
+ * Checks for the link-state database, run with "make test". A few LSAs
+ * go through refresh_topology_entry and check_sequence_number by hand:
+ * new links and stubs, refreshes with and without changes, conflicting
+ * entries from other routers, and an own entry refreshed while another
+ * router's conflicting entry for the same network sorts first. Then a
+ * database grows well past its first index size and every entry must
+ * still be found, before and after half of them are removed. The
+ * router's debug output goes to /dev/null.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "pwospf_topology.h"
+
+#define TEST_ROUTERS 200
+#define TEST_ENTRIES 4000    /* well past TOPO_HASH_MIN */
+
+static int test_failed = 0;
+static FILE* test_out;
+
+/* -- the timer wheel does not run here -- */
+void pwospf_topology_timeout(struct sr_instance* sr, void* arg)
+{
+} /* -- pwospf_topology_timeout -- */
+
+static struct in_addr test_addr(uint32_t host)
+{
+    struct in_addr addr;
+
+    addr.s_addr = htonl(host);
+    return addr;
+} /* -- test_addr -- */
+
+static void test_expect(int ok, const char* what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "lsdb: %s\n", what);
+        test_failed = 1;
+    }
+} /* -- test_expect -- */
+
+/* -- refresh_topology_entry with a fresh change mask -- */
+static struct pwospf_topology_entry* test_refresh(struct pwospf_lsdb* lsdb, uint32_t rid, uint32_t net,
+                                                  uint32_t mask, uint32_t neighbor, uint16_t seq,
+                                                  uint8_t* changes)
+{
+    *changes = TOPO_UNCHANGED;
+    return refresh_topology_entry(lsdb, test_addr(rid), test_addr(net), test_addr(mask),
+                                  test_addr(neighbor), test_addr(0), seq, changes);
+} /* -- test_refresh -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_cases
+ *
+ * Routers A, B, C and X; N1 is a link between A and B, N2 a link of A
+ * that C also claims, N3 a stub of A.
+ *
+ *---------------------------------------------------------------------*/
+
+static void test_cases(void)
+{
+    const uint32_t a = 0xc0000001, b = 0xc0000002, c = 0xc0000003, x = 0xc0000004;
+    const uint32_t n1 = 0x0a000000, n2 = 0x0a000004, n3 = 0x0b000000;
+    const uint32_t link = 0xfffffffc, stub = 0xffffff00;
+    struct pwospf_lsdb* lsdb = create_pwospf_lsdb();
+    struct pwospf_topology_entry* own;
+    struct pwospf_topology_entry* entry;
+    uint8_t changes;
+
+    test_expect(check_sequence_number(lsdb, test_addr(a), 0), "unknown router rejected");
+
+    own = test_refresh(lsdb, a, n1, link, b, 5, &changes);
+    test_expect((own != NULL) && (changes == TOPO_LINK_CHANGED), "new link not added as a link change");
+    test_expect(!check_sequence_number(lsdb, test_addr(a), 5), "same sequence number accepted");
+    test_expect(!check_sequence_number(lsdb, test_addr(a), 4), "older sequence number accepted");
+    test_expect(check_sequence_number(lsdb, test_addr(a), 6), "newer sequence number rejected");
+    test_expect(check_sequence_number(lsdb, test_addr(b), 1), "router without entries rejected");
+
+    entry = test_refresh(lsdb, b, n1, link, a, 7, &changes);
+    test_expect((entry != NULL) && (entry != own) && (changes == TOPO_LINK_CHANGED),
+                "other end of a link not added");
+
+    entry = test_refresh(lsdb, c, n1, link, x, 1, &changes);
+    test_expect((entry == NULL) && (changes == TOPO_UNCHANGED), "conflicting link added");
+    test_expect(check_sequence_number(lsdb, test_addr(c), 1), "rejected LSA left a sequence number");
+
+    entry = test_refresh(lsdb, a, n1, link, b, 6, &changes);
+    test_expect((entry == own) && (changes == TOPO_UNCHANGED), "plain refresh changed the topology");
+    test_expect((own->sequence_num == 6) && !check_sequence_number(lsdb, test_addr(a), 6),
+                "refresh did not take the sequence number");
+
+    entry = test_refresh(lsdb, a, n3, stub, 0, 7, &changes);
+    test_expect((entry != NULL) && (changes == TOPO_PREFIX_CHANGED), "new stub not a prefix change");
+    entry = test_refresh(lsdb, a, n3, stub, 0, 8, &changes);
+    test_expect(changes == TOPO_UNCHANGED, "stub refresh changed the topology");
+    test_expect(search_topolgy_table(lsdb, htonl(n3)) && !search_topolgy_table(lsdb, htonl(n3 + 256)),
+                "search_topolgy_table");
+
+    /* -- C's entry for N2 is newer and sorts first. The list walk used
+     * to meet it before A's own entry and drop A's refresh; the own
+     * entry is now looked up first. -- */
+    own = test_refresh(lsdb, a, n2, link, x, 9, &changes);
+    test_expect(own != NULL, "link to X not added");
+    add_topology_entry(lsdb, create_ospfv2_topology_entry(test_addr(c), test_addr(n2), test_addr(link),
+                                                          test_addr(b), test_addr(0), 1));
+    test_expect(lsdb->head.next->router_id.s_addr == htonl(c), "C's entry does not sort first");
+    entry = test_refresh(lsdb, a, n2, link, x, 10, &changes);
+    test_expect((entry == own) && (changes == TOPO_UNCHANGED), "own refresh dropped for C's entry");
+    entry = test_refresh(lsdb, a, n2, link, b, 11, &changes);
+    test_expect((entry == own) && (changes == TOPO_LINK_CHANGED) && (own->neighbor_id.s_addr == htonl(b)),
+                "new neighbor on an own entry not a link change");
+
+    test_expect((lsdb->count == 5) && (lsdb->routers == 3), "entry or router count");
+} /* -- test_cases -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_grow
+ *
+ * TEST_ENTRIES stubs over TEST_ROUTERS routers, through several index
+ * growths; then every other one is removed.
+ *
+ *---------------------------------------------------------------------*/
+
+static void test_grow(void)
+{
+    static struct pwospf_topology_entry* entries[TEST_ENTRIES];
+    struct pwospf_lsdb* lsdb = create_pwospf_lsdb();
+    uint8_t changes;
+    unsigned int i, found;
+
+    for (i = 0; i < TEST_ENTRIES; i++)
+    { entries[i] = test_refresh(lsdb, 0xc0000000 | (i % TEST_ROUTERS), i << 8, 0xffffff00, 0, 1, &changes); }
+    test_expect((lsdb->count == TEST_ENTRIES) && (lsdb->routers == TEST_ROUTERS) &&
+                (lsdb->size >= TEST_ENTRIES), "count after growing");
+
+    for (i = 0, found = 0; i < TEST_ENTRIES; i++)
+    {
+        if ((test_refresh(lsdb, 0xc0000000 | (i % TEST_ROUTERS), i << 8, 0xffffff00, 0, 2, &changes) == entries[i]) &&
+            (changes == TOPO_UNCHANGED) && search_topolgy_table(lsdb, htonl(i << 8)))
+        { found++; }
+    }
+    test_expect(found == TEST_ENTRIES, "entries lost while growing");
+    test_expect(!check_sequence_number(lsdb, test_addr(0xc0000000), 2), "sequence number lost while growing");
+
+    for (i = 0; i < TEST_ENTRIES; i += 2)
+    { remove_topology_entry(lsdb, entries[i]); }
+    for (i = 0, found = 0; i < TEST_ENTRIES; i++)
+    { found += search_topolgy_table(lsdb, htonl(i << 8)) == (i & 1); }
+    test_expect((found == TEST_ENTRIES) && (lsdb->count == TEST_ENTRIES / 2), "removal");
+
+    /* -- the even routers advertise nothing now and are forgotten -- */
+    test_expect((lsdb->routers == TEST_ROUTERS / 2) &&
+                check_sequence_number(lsdb, test_addr(0xc0000000), 1) &&
+                !check_sequence_number(lsdb, test_addr(0xc0000001), 2), "routers after removal");
+} /* -- test_grow -- */
+
+int main(void)
+{
+    test_out = fdopen(dup(1), "w");
+    if ((test_out == 0) || (freopen("/dev/null", "w", stdout) == 0))
+    { return 1; }
+
+    test_cases();
+    test_grow();
+
+    if (!test_failed)
+    { fprintf(test_out, "lsdb: %u entries ok\n", TEST_ENTRIES); }
+    fclose(test_out);
+    return test_failed;
+} /* -- main -- */
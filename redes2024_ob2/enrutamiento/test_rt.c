@@ -0,0 +1,357 @@
+/*-----------------------------------------------------------------------------
+ * file:  test_rt.c
+ *
+ * Description:
+ *
+ * Checks for the routing table updates, run with "make test". Random
+ * sets of dynamic routes over nested prefixes are pushed through
+ * sr_rt_update_dynamic, with the occasional full replacement and static
+ * add in between. After every update the list must hold the expected
+ * routes and every FIB lookup must match a longest prefix match walk of
+ * the list. A reader thread does lookups and list walks the whole time;
+ * build with -fsanitize=address to catch anything freed under it. An
+ * optional argument seeds the generator.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+
+#define TEST_ROUNDS 2000
+#define TEST_PREFIXES 200
+#define TEST_STATIC 8
+#define TEST_LOOKUPS 500
+
+struct test_route
+{
+    uint32_t dest;      /* host byte order, masked */
+    uint32_t mask;
+    uint32_t gw;
+    unsigned int ifindex;
+    int present;
+};
+
+static uint32_t test_seed = 0x2545f491;
+static int test_failed = 0;
+
+static struct test_route test_pool[TEST_PREFIXES];
+static struct test_route test_static[TEST_STATIC + 1];
+static unsigned int test_nstatic = TEST_STATIC;
+
+static struct sr_instance test_sr;
+static volatile int test_stop = 0;
+static unsigned long test_reads = 0;
+
+static uint32_t test_rand(void)
+{
+    test_seed ^= test_seed << 13;
+    test_seed ^= test_seed >> 17;
+    test_seed ^= test_seed << 5;
+    return test_seed;
+} /* -- test_rand -- */
+
+static uint32_t test_mask(unsigned int len)
+{
+    return len ? 0xffffffffU << (32 - len) : 0;
+} /* -- test_mask -- */
+
+/* Prefixes inside 10.0.0.0/16 so that many of them nest. */
+static void test_prefix(struct test_route* route)
+{
+    unsigned int len = 8 + test_rand() % 25;
+
+    route->mask = test_mask(len);
+    route->dest = (0x0a000000 | (test_rand() & 0xffff)) & route->mask;
+} /* -- test_prefix -- */
+
+static void test_append(struct sr_rt** tail, struct test_route* route,
+                        uint8_t admin_dst)
+{
+    struct in_addr dest, gw, mask;
+
+    dest.s_addr = htonl(route->dest);
+    gw.s_addr = htonl(route->gw);
+    mask.s_addr = htonl(route->mask);
+    sr_rt_list_append(tail, dest, gw, mask, route->ifindex, admin_dst);
+} /* -- test_append -- */
+
+static struct sr_rt* test_dynamic_list(void)
+{
+    struct sr_rt* list = 0;
+    struct sr_rt** tail = &list;
+    unsigned int i;
+
+    for (i = 0; i < TEST_PREFIXES; i++)
+    {
+        if (test_pool[i].present)
+        {
+            test_append(tail, &test_pool[i], 110);
+            tail = &((*tail)->next);
+        }
+    }
+    return list;
+} /* -- test_dynamic_list -- */
+
+static int test_fail(const char* what, unsigned int round)
+{
+    fprintf(stderr, "round %u: %s\n", round, what);
+    test_failed = 1;
+    return 0;
+} /* -- test_fail -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_lpm
+ *
+ * Longest prefix match by walking the list; the first of equally long
+ * matches wins, as in the FIB.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rt* test_lpm(struct sr_rt* list, uint32_t ip)
+{
+    struct sr_rt* best = 0;
+
+    for (; list != NULL; list = list->next)
+    {
+        if (((ip ^ list->dest.s_addr) & list->mask.s_addr) != 0)
+        { continue; }
+        if ((best == 0) || (ntohl(list->mask.s_addr) > ntohl(best->mask.s_addr)))
+        { best = list; }
+    }
+    return best;
+} /* -- test_lpm -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_check
+ *
+ * The published list holds the static routes in order plus exactly the
+ * present pool routes, and the FIB agrees with test_lpm.
+ *
+ *---------------------------------------------------------------------*/
+
+static int test_check(unsigned int round)
+{
+    struct sr_rt* entry;
+    int seen[TEST_PREFIXES];
+    unsigned int nstatic = 0, ndynamic = 0, npresent = 0;
+    unsigned int i;
+    uint32_t ip;
+
+    memset(seen, 0, sizeof(seen));
+
+    for (entry = test_sr.routing_table; entry != NULL; entry = entry->next)
+    {
+        if (entry->admin_dst <= 1)
+        {
+            if ((nstatic >= test_nstatic) ||
+                (ntohl(entry->dest.s_addr) != test_static[nstatic].dest) ||
+                (ntohl(entry->mask.s_addr) != test_static[nstatic].mask))
+            { return test_fail("static routes out of order", round); }
+            nstatic++;
+            continue;
+        }
+
+        for (i = 0; i < TEST_PREFIXES; i++)
+        {
+            if ((ntohl(entry->dest.s_addr) == test_pool[i].dest) &&
+                (ntohl(entry->mask.s_addr) == test_pool[i].mask))
+            { break; }
+        }
+        if ((i == TEST_PREFIXES) || !test_pool[i].present || seen[i])
+        { return test_fail("unexpected dynamic route", round); }
+        if ((ntohl(entry->gw.s_addr) != test_pool[i].gw) ||
+            (entry->ifindex != test_pool[i].ifindex))
+        { return test_fail("stale dynamic route", round); }
+        seen[i] = 1;
+        ndynamic++;
+    }
+
+    for (i = 0; i < TEST_PREFIXES; i++)
+    { npresent += test_pool[i].present; }
+    if ((nstatic != test_nstatic) || (ndynamic != npresent))
+    { return test_fail("routes missing from the list", round); }
+
+    if (test_sr.fib->routes > nstatic + ndynamic)
+    { return test_fail("FIB holds more routes than the list", round); }
+
+    for (i = 0; i < TEST_LOOKUPS; i++)
+    {
+        ip = test_pool[test_rand() % TEST_PREFIXES].dest;
+        ip = htonl(ip | (test_rand() & (test_rand() >> (test_rand() % 32))));
+        if (sr_fib_lookup(test_sr.fib, ip) != test_lpm(test_sr.routing_table, ip))
+        { return test_fail("FIB and list disagree", round); }
+    }
+
+    return 1;
+} /* -- test_check -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_reader
+ *
+ * Lookups and list walks inside read-side sections while the table
+ * changes. Every route found must cover the address looked up.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* test_reader(void* arg)
+{
+    struct sr_rt* route;
+    struct sr_rt* entry;
+    unsigned long epoch;
+    uint32_t seed = 12345, ip;
+    unsigned int n;
+
+    while (!test_stop)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        ip = htonl(0x0a000000 | (seed & 0xffff));
+
+        epoch = sr_rt_read_lock(&test_sr);
+        route = sr_fib_lookup(__atomic_load_n(&(test_sr.fib), __ATOMIC_SEQ_CST), ip);
+        if ((route != 0) && (((ip ^ route->dest.s_addr) & route->mask.s_addr) != 0))
+        { test_failed = 1; }
+        n = 0;
+        for (entry = __atomic_load_n(&(test_sr.routing_table), __ATOMIC_SEQ_CST);
+             entry != NULL; entry = entry->next)
+        { n++; }
+        if (n > TEST_STATIC + 1 + TEST_PREFIXES)
+        { test_failed = 1; }
+        sr_rt_read_unlock(&test_sr, epoch);
+
+        test_reads++;
+    }
+
+    return arg;
+} /* -- test_reader -- */
+
+int main(int argc, char** argv)
+{
+    struct sr_rt* table = 0;
+    struct sr_rt** tail = &table;
+    struct test_route extra;
+    struct in_addr dest, gw, mask;
+    pthread_t reader;
+    unsigned int round, i, want, got, updates = 0, replaces = 0;
+
+    if (argc > 1)
+    { test_seed = (uint32_t)strtoul(argv[1], 0, 0) | 1; }
+    printf("seed %#x\n", test_seed);
+
+    memset(&test_sr, 0, sizeof(test_sr));
+    sr_rt_init(&test_sr);
+    sr_if_index(&test_sr, "eth0");
+    sr_if_index(&test_sr, "eth1");
+    sr_if_index(&test_sr, "eth2");
+
+    /* -- dynamic prefixes are unique, as SPF hands them out -- */
+    for (i = 0; i < TEST_PREFIXES; i++)
+    {
+        test_prefix(&test_pool[i]);
+        for (round = 0; round < i; round++)
+        {
+            if ((test_pool[round].dest == test_pool[i].dest) &&
+                (test_pool[round].mask == test_pool[i].mask))
+            {
+                test_prefix(&test_pool[i]);
+                round = (unsigned int)-1;
+            }
+        }
+    }
+
+    /* -- some static routes shadow pool prefixes -- */
+    for (i = 0; i < TEST_STATIC; i++)
+    {
+        if (i & 1)
+        { test_static[i] = test_pool[test_rand() % TEST_PREFIXES]; }
+        else
+        { test_prefix(&test_static[i]); }
+        test_static[i].gw = 0;
+        test_static[i].ifindex = i % 3;
+        test_append(tail, &test_static[i], i & 1);
+        tail = &((*tail)->next);
+    }
+    sr_rt_publish(&test_sr, table);
+
+    pthread_create(&reader, 0, test_reader, 0);
+
+    for (round = 0; (round < TEST_ROUNDS) && !test_failed; round++)
+    {
+        if (round == TEST_ROUNDS / 2)
+        {
+            /* -- a static add rebuilds the table from a derived FIB; it
+             * lands after a dynamic route with the same prefix, which
+             * then holds the prefix until it is withdrawn -- */
+            i = test_rand() % TEST_PREFIXES;
+            while (!test_pool[i].present)
+            { i = (i + 1) % TEST_PREFIXES; }
+            extra = test_pool[i];
+            extra.gw = 0;
+            extra.ifindex = 0;
+            test_static[test_nstatic++] = extra;
+            dest.s_addr = htonl(extra.dest);
+            gw.s_addr = 0;
+            mask.s_addr = htonl(extra.mask);
+            sr_add_rt_entry(&test_sr, dest, gw, mask, 0, 1);
+        }
+
+        want = 0;
+        for (i = 0; i < TEST_PREFIXES; i++)
+        {
+            struct test_route before = test_pool[i];
+
+            if ((test_rand() % 8) == 0)
+            { test_pool[i].present = !test_pool[i].present; }
+            if ((test_rand() % 16) == 0)
+            {
+                test_pool[i].gw = 0x0a000000 | (test_rand() % 4);
+                test_pool[i].ifindex = test_rand() % 3;
+            }
+
+            if (before.present != test_pool[i].present)
+            { want++; }
+            else if (before.present &&
+                     ((before.gw != test_pool[i].gw) ||
+                      (before.ifindex != test_pool[i].ifindex)))
+            { want++; }
+        }
+
+        if ((round % 50) == 49)
+        {
+            sr_rt_replace_dynamic(&test_sr, test_dynamic_list());
+            replaces++;
+        }
+        else
+        {
+            got = sr_rt_update_dynamic(&test_sr, test_dynamic_list());
+            if (got != want)
+            {
+                fprintf(stderr, "round %u: %u changes reported, want %u\n",
+                        round, got, want);
+                test_failed = 1;
+            }
+            updates++;
+        }
+
+        test_check(round);
+    }
+
+    test_stop = 1;
+    pthread_join(reader, 0);
+
+    if (!test_failed)
+    {
+        printf("routing table: %u diffs, %u replaces ok, %lu concurrent reads\n",
+               updates, replaces, test_reads);
+    }
+
+    return test_failed;
+} /* -- main -- */
@@ -0,0 +1,472 @@
+/*-----------------------------------------------------------------------------
+ * file:  test_spf.c
+ *
+ * Description:
+ *
+ * Checks for run_dijkstra, run with "make test". A random topology of
+ * routers joined by point to point links, plus stub networks, is changed
+ * a little between runs: one end of a link comes or goes, a router goes
+ * down or comes back, a stub network appears, an interface loses its
+ * neighbor. Most runs are then incremental, some reuse the tree and some
+ * start from scratch. After every run each prefix must have a route
+ * exactly when it is reachable, through an interface that starts one of
+ * its shortest paths, as found by a breadth first search per interface.
+ * The router's debug output goes to /dev/null. An optional argument
+ * seeds the generator.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_pwospf.h"
+#include "pwospf_topology.h"
+#include "dijkstra.h"
+
+#define TEST_ROUNDS 1000
+#define TEST_ROUTERS 300    /* router 0 is this one */
+#define TEST_WIRES 700      /* the first TEST_IFACES join router 0 to 1.. */
+#define TEST_STUBS 200
+#define TEST_IFACES 4
+#define TEST_INF 0xffffffffU
+
+struct test_end
+{
+    unsigned int router;
+    struct pwospf_topology_entry* entry;    /* 0 while not advertised */
+};
+
+struct test_wire
+{
+    struct in_addr net;
+    struct test_end end[2];
+};
+
+static uint32_t test_seed = 0x2545f491;
+static int test_failed = 0;
+static FILE* test_out;
+
+static struct sr_instance test_sr;
+static struct pwospf_lsdb* test_lsdb;
+static pthread_mutex_t test_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct test_wire test_wires[TEST_WIRES];
+static struct test_end test_stubs[TEST_STUBS];
+static struct in_addr test_stub_nets[TEST_STUBS];
+static uint8_t test_down[TEST_ROUTERS];
+static struct sr_if* test_ifaces[TEST_IFACES];
+
+/* -- directed links of the current topology, by router -- */
+static unsigned int test_out_first[TEST_ROUTERS + 1];
+static unsigned int test_links[2 * TEST_WIRES];
+static unsigned int test_entries[TEST_ROUTERS];
+static unsigned int test_dist[TEST_IFACES][TEST_ROUTERS];
+
+/* -- the timer wheel does not run here -- */
+void pwospf_topology_timeout(struct sr_instance* sr, void* arg)
+{
+} /* -- pwospf_topology_timeout -- */
+
+static uint32_t test_rand(void)
+{
+    test_seed ^= test_seed << 13;
+    test_seed ^= test_seed >> 17;
+    test_seed ^= test_seed << 5;
+    return test_seed;
+} /* -- test_rand -- */
+
+static struct in_addr test_rid(unsigned int router)
+{
+    struct in_addr rid;
+
+    rid.s_addr = htonl(0xc0a80000 | (router + 1));
+    return rid;
+} /* -- test_rid -- */
+
+static struct in_addr test_addr(uint32_t host)
+{
+    struct in_addr addr;
+
+    addr.s_addr = htonl(host);
+    return addr;
+} /* -- test_addr -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_set
+ *
+ * Advertise or withdraw one entry of router end->router for net. A
+ * router that is down advertises nothing.
+ *
+ *---------------------------------------------------------------------*/
+
+static void test_set(struct test_end* end, struct in_addr net, struct in_addr mask,
+                     struct in_addr neighbor, int on)
+{
+    if (on && (end->entry == 0) && !test_down[end->router])
+    {
+        end->entry = create_ospfv2_topology_entry(test_rid(end->router), net, mask,
+                                                  neighbor, test_addr(0), 0);
+        add_topology_entry(test_lsdb, end->entry);
+    }
+    else if (!on && (end->entry != 0))
+    {
+        remove_topology_entry(test_lsdb, end->entry);
+        end->entry = 0;
+    }
+} /* -- test_set -- */
+
+static void test_set_end(unsigned int w, unsigned int side, int on)
+{
+    struct test_wire* wire = &test_wires[w];
+
+    test_set(&wire->end[side], wire->net, test_addr(0xfffffffc),
+             test_rid(wire->end[!side].router), on);
+} /* -- test_set_end -- */
+
+static void test_set_stub(unsigned int s, int on)
+{
+    test_set(&test_stubs[s], test_stub_nets[s], test_addr(0xffffff00), test_addr(0), on);
+} /* -- test_set_stub -- */
+
+/* -- a router going down withdraws everything, coming back restores it -- */
+static void test_toggle_router(unsigned int router)
+{
+    unsigned int w, s;
+    int up = test_down[router];
+
+    if (!up)
+    {
+        for (w = 0; w < TEST_WIRES; w++)
+        {
+            if (test_wires[w].end[0].router == router) { test_set_end(w, 0, 0); }
+            if (test_wires[w].end[1].router == router) { test_set_end(w, 1, 0); }
+        }
+        for (s = 0; s < TEST_STUBS; s++)
+        {
+            if (test_stubs[s].router == router) { test_set_stub(s, 0); }
+        }
+    }
+    test_down[router] = !up;
+    if (up)
+    {
+        for (w = 0; w < TEST_WIRES; w++)
+        {
+            if (test_wires[w].end[0].router == router) { test_set_end(w, 0, 1); }
+            if (test_wires[w].end[1].router == router) { test_set_end(w, 1, 1); }
+        }
+        for (s = 0; s < TEST_STUBS; s++)
+        {
+            if (test_stubs[s].router == router) { test_set_stub(s, 1); }
+        }
+    }
+} /* -- test_toggle_router -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_mutate
+ *
+ * One random change, returns 1 if it changed links between routers.
+ *
+ *---------------------------------------------------------------------*/
+
+static int test_mutate(void)
+{
+    unsigned int r = test_rand() % 100;
+    unsigned int w = TEST_IFACES + test_rand() % (TEST_WIRES - TEST_IFACES);
+    unsigned int side = test_rand() & 1;
+    unsigned int i;
+
+    if (r < 40)
+    {
+        test_set_end(w, side, test_wires[w].end[side].entry == 0);
+        return 1;
+    }
+    if (r < 55)
+    {
+        i = (test_wires[w].end[0].entry == 0);
+        test_set_end(w, 0, i);
+        test_set_end(w, 1, i);
+        return 1;
+    }
+    if (r < 60)
+    {
+        /* -- the neighbor's end of one of our own links -- */
+        w = test_rand() % TEST_IFACES;
+        test_set_end(w, 1, test_wires[w].end[1].entry == 0);
+        return 1;
+    }
+    if (r < 70)
+    {
+        i = test_rand() % TEST_STUBS;
+        test_set_stub(i, test_stubs[i].entry == 0);
+        return 0;
+    }
+    if (r < 80)
+    {
+        test_toggle_router(1 + test_rand() % (TEST_ROUTERS - 1));
+        return 1;
+    }
+    if (r < 85)
+    {
+        i = test_rand() % TEST_IFACES;
+        test_ifaces[i]->neighbor_id = test_ifaces[i]->neighbor_id ? 0 : test_rid(i + 1).s_addr;
+        return 0;
+    }
+    if (r < 88)
+    {
+        dijkstra_drop_tree();
+    }
+    return 0;
+} /* -- test_mutate -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_distances
+ *
+ * test_dist[i][v]: hops to router v leaving through interface i, as
+ * run_dijkstra counts them. The neighbor costs 1, only routers that
+ * advertise something are in the graph and router 0 is never crossed.
+ *
+ *---------------------------------------------------------------------*/
+
+static void test_distances(void)
+{
+    static unsigned int queue[TEST_ROUTERS];
+    unsigned int w, s, i, v, k, head, tail;
+
+    memset(test_entries, 0, sizeof(test_entries));
+    memset(test_out_first, 0, sizeof(test_out_first));
+    for (w = 0; w < TEST_WIRES; w++)
+    {
+        for (s = 0; s < 2; s++)
+        {
+            if (test_wires[w].end[s].entry != 0)
+            {
+                test_entries[test_wires[w].end[s].router]++;
+                test_out_first[test_wires[w].end[s].router + 1]++;
+            }
+        }
+    }
+    for (s = 0; s < TEST_STUBS; s++)
+    {
+        if (test_stubs[s].entry != 0)
+        { test_entries[test_stubs[s].router]++; }
+    }
+    for (v = 1; v <= TEST_ROUTERS; v++)
+    { test_out_first[v] += test_out_first[v - 1]; }
+    for (w = 0; w < TEST_WIRES; w++)
+    {
+        for (s = 0; s < 2; s++)
+        {
+            if (test_wires[w].end[s].entry != 0)
+            { test_links[test_out_first[test_wires[w].end[s].router]++] = test_wires[w].end[!s].router; }
+        }
+    }
+    for (v = TEST_ROUTERS; v > 0; v--)
+    { test_out_first[v] = test_out_first[v - 1]; }
+    test_out_first[0] = 0;
+
+    for (i = 0; i < TEST_IFACES; i++)
+    {
+        for (v = 0; v < TEST_ROUTERS; v++)
+        { test_dist[i][v] = TEST_INF; }
+        if ((test_ifaces[i]->neighbor_id == 0) || (test_entries[i + 1] == 0))
+        { continue; }
+
+        head = tail = 0;
+        test_dist[i][i + 1] = 1;
+        queue[tail++] = i + 1;
+        while (head < tail)
+        {
+            v = queue[head++];
+            for (k = test_out_first[v]; k < test_out_first[v + 1]; k++)
+            {
+                unsigned int u = test_links[k];
+
+                if ((u == 0) || (test_entries[u] == 0) || (test_dist[i][u] != TEST_INF))
+                { continue; }
+                test_dist[i][u] = test_dist[i][v] + 1;
+                queue[tail++] = u;
+            }
+        }
+    }
+} /* -- test_distances -- */
+
+/*---------------------------------------------------------------------
+ * Method: test_prefix
+ *
+ * Checks the route for net, advertised by the routers in ends. Returns
+ * 1 if the prefix is reachable.
+ *
+ *---------------------------------------------------------------------*/
+
+static int test_prefix(unsigned int round, struct in_addr net, struct test_end* ends,
+                       unsigned int nends, int root_net)
+{
+    struct sr_rt* route = sr_fib_lookup(test_sr.fib, net.s_addr);
+    unsigned int best = TEST_INF, cost, i, e;
+    int ok = 0;
+
+    if ((root_net >= 0) && (test_ifaces[root_net]->neighbor_id != 0))
+    { best = 1; }
+    for (e = 0; e < nends; e++)
+    {
+        if ((ends[e].entry == 0) || (ends[e].router == 0))
+        { continue; }
+        for (i = 0; i < TEST_IFACES; i++)
+        {
+            if ((test_dist[i][ends[e].router] != TEST_INF) && (test_dist[i][ends[e].router] + 1 < best))
+            { best = test_dist[i][ends[e].router] + 1; }
+        }
+    }
+
+    if (best == TEST_INF)
+    {
+        if (route != 0)
+        {
+            fprintf(stderr, "round %u: route to unreachable %s\n", round, inet_ntoa(net));
+            test_failed = 1;
+        }
+        return 0;
+    }
+
+    if ((route == 0) || (route->dest.s_addr != net.s_addr))
+    {
+        fprintf(stderr, "round %u: no route to %s\n", round, inet_ntoa(net));
+        test_failed = 1;
+        return 1;
+    }
+
+    for (i = 0; (i < TEST_IFACES) && !ok; i++)
+    {
+        if ((test_ifaces[i]->neighbor_id == 0) || (route->ifindex != test_ifaces[i]->ifindex) ||
+            (route->gw.s_addr != test_ifaces[i]->neighbor_ip))
+        { continue; }
+        if ((root_net == (int)i) && (best == 1))
+        { ok = 1; }
+        for (e = 0; e < nends; e++)
+        {
+            if ((ends[e].entry == 0) || (ends[e].router == 0))
+            { continue; }
+            cost = test_dist[i][ends[e].router];
+            if ((cost != TEST_INF) && (cost + 1 == best))
+            { ok = 1; }
+        }
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "round %u: %s not routed on a shortest path (%u hops)\n",
+                round, inet_ntoa(net), best);
+        test_failed = 1;
+    }
+    return 1;
+} /* -- test_prefix -- */
+
+static void test_check(unsigned int round)
+{
+    struct sr_rt* entry;
+    unsigned int w, s, reachable = 0, routes = 0;
+
+    test_distances();
+    for (w = 0; (w < TEST_WIRES) && !test_failed; w++)
+    {
+        reachable += test_prefix(round, test_wires[w].net, test_wires[w].end, 2,
+                                 (w < TEST_IFACES) ? (int)w : -1);
+    }
+    for (s = 0; (s < TEST_STUBS) && !test_failed; s++)
+    { reachable += test_prefix(round, test_stub_nets[s], &test_stubs[s], 1, -1); }
+
+    for (entry = test_sr.routing_table; entry != NULL; entry = entry->next)
+    { routes++; }
+    if (!test_failed && (routes != reachable))
+    {
+        fprintf(stderr, "round %u: %u routes for %u reachable prefixes\n", round, routes, reachable);
+        test_failed = 1;
+    }
+} /* -- test_check -- */
+
+int main(int argc, char** argv)
+{
+    struct dijkstra_param param;
+    struct dijkstra_stats stats;
+    unsigned int round, w, s, i;
+    char name[8];
+
+    if (argc > 1)
+    { test_seed = (uint32_t)strtoul(argv[1], 0, 0) | 1; }
+    test_out = fdopen(dup(1), "w");
+    if ((test_out == 0) || (freopen("/dev/null", "w", stdout) == 0))
+    { return 1; }
+    fprintf(test_out, "seed %#x\n", test_seed);
+
+    memset(&test_sr, 0, sizeof(test_sr));
+    sr_rt_init(&test_sr);
+    test_sr.ospf_subsys = (struct pwospf_subsys*)calloc(1, sizeof(struct pwospf_subsys));
+    pthread_mutex_init(&(test_sr.ospf_subsys->lock), 0);
+    test_lsdb = create_pwospf_lsdb();
+
+    for (i = 0; i < TEST_IFACES; i++)
+    {
+        sprintf(name, "eth%u", i);
+        sr_add_interface(&test_sr, name);
+        sr_set_ether_ip(&test_sr, htonl(0x0a000000 | (i << 2) | 1));
+        sr_set_ether_mask(&test_sr, htonl(0xfffffffc));
+        test_ifaces[i] = sr_get_interface(&test_sr, name);
+        test_ifaces[i]->neighbor_id = test_rid(i + 1).s_addr;
+        test_ifaces[i]->neighbor_ip = htonl(0x0a000000 | (i << 2) | 2);
+    }
+
+    for (w = 0; w < TEST_WIRES; w++)
+    {
+        test_wires[w].net = test_addr(0x0a000000 | (w << 2));
+        test_wires[w].end[0].router = (w < TEST_IFACES) ? 0 : 1 + test_rand() % (TEST_ROUTERS - 1);
+        test_wires[w].end[1].router = (w < TEST_IFACES) ? w + 1 : 1 + test_rand() % (TEST_ROUTERS - 1);
+        if (test_wires[w].end[1].router == test_wires[w].end[0].router)
+        { test_wires[w].end[1].router = 1 + test_wires[w].end[0].router % (TEST_ROUTERS - 1); }
+        test_set_end(w, 0, 1);
+        test_set_end(w, 1, 1);
+    }
+    for (s = 0; s < TEST_STUBS; s++)
+    {
+        test_stub_nets[s] = test_addr(0x0b000000 | (s << 8));
+        test_stubs[s].router = test_rand() % TEST_ROUTERS;
+        test_set_stub(s, 1);
+    }
+
+    param.sr = &test_sr;
+    param.topology = test_lsdb;
+    param.rid = test_rid(0);
+    param.mutex = &test_mutex;
+
+    for (round = 0; (round < TEST_ROUNDS) && !test_failed; round++)
+    {
+        if (round > 0)
+        {
+            for (i = 1 + test_rand() % 3; i > 0; i--)
+            { test_sr.ospf_subsys->links_gen += test_mutate(); }
+        }
+        run_dijkstra(&param);
+        test_check(round);
+    }
+
+    dijkstra_get_stats(&stats);
+    if (!test_failed && ((stats.full == 0) || (stats.incremental == 0) || (stats.reused == 0)))
+    {
+        fprintf(stderr, "runs: %lu full, %lu incremental, %lu reused\n",
+                stats.full, stats.incremental, stats.reused);
+        test_failed = 1;
+    }
+
+    if (!test_failed)
+    {
+        fprintf(test_out, "spf: %u runs ok, %lu full, %lu incremental, %lu reused, %lu routers settled\n",
+                round, stats.full, stats.incremental, stats.reused, stats.settled);
+    }
+    fclose(test_out);
+
+    return test_failed;
+} /* -- main -- */